@@ -0,0 +1,238 @@
+#ifndef _ASYNC_LOGGER_HPP_
+#define _ASYNC_LOGGER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// 编译期日志级别，低于 MY_LOG_LEVEL 的 PRETTY_TRACE / PRETTY_DEBUG 连同参数的求值一起被去掉
+// 发布构建由 Makefile 设为 MY_LOG_LEVEL_DEBUG，逐帧的 TRACE 日志不产生任何指令
+#define MY_LOG_LEVEL_TRACE 0
+#define MY_LOG_LEVEL_DEBUG 1
+#define MY_LOG_LEVEL_INFO 2
+#ifndef MY_LOG_LEVEL
+#define MY_LOG_LEVEL MY_LOG_LEVEL_TRACE
+#endif
+
+// 用法: PRETTY_TRACE(pretty_log, "Send data frame {}({}/{})", num, index, count);
+// 只记下格式串与参数，由后台线程格式化并写出，参数须为算术类型
+#define PRETTY_TRACE(sink, ...)                               \
+    do {                                                      \
+        if constexpr (MY_LOG_LEVEL <= MY_LOG_LEVEL_TRACE) {   \
+            (sink).defer(__VA_ARGS__);                        \
+        }                                                     \
+    } while (0)
+#define PRETTY_DEBUG(sink, ...)                               \
+    do {                                                      \
+        if constexpr (MY_LOG_LEVEL <= MY_LOG_LEVEL_DEBUG) {   \
+            (sink).defer(__VA_ARGS__);                        \
+        }                                                     \
+    } while (0)
+
+namespace my
+{
+    // 同步日志与后台线程写出时共用，保证各行不交错
+    inline ::std::mutex g_log_mutex;
+
+    // 异步日志后端：每个写日志的线程有一个单生产者单消费者的无锁环形缓冲，
+    // 热路径只拷贝格式串指针与参数，后台线程统一格式化，按批写出后才 flush
+    // 缓冲满时生产者让出 CPU 等待，不丢日志
+    class AsyncLogger
+    {
+    public:
+        static constexpr int RING_SIZE = 1024;
+        static constexpr int ARGS_SIZE = 48;
+        // 缓冲都为空时后台线程的休眠时长
+        static constexpr int IDLE_SLEEP_US = 500;
+
+        ~AsyncLogger()
+        {
+            m_stop.store(true, ::std::memory_order_release);
+            if (m_thread.joinable()) {
+                m_thread.join();
+            }
+        }
+        AsyncLogger(const AsyncLogger &) = delete;
+        AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+        template <class... Args>
+        static void push(::std::ostream &os, const ::std::string &prefix, const char *fmt, const Args &...args)
+        {
+            static_assert((::std::is_arithmetic_v<Args> && ...), "Deferred log arguments must be arithmetic");
+            static_assert(sizeof(::std::tuple<Args...>) <= ARGS_SIZE, "Too many deferred log arguments");
+
+            Ring &ring = instance().localRing();
+            unsigned long long head = ring.head.load(::std::memory_order_relaxed);
+            while (head - ring.tail.load(::std::memory_order_acquire) >= RING_SIZE) {
+                ::std::this_thread::yield();
+            }
+            Record &record = ring.records[head % RING_SIZE];
+            record.format = &formatRecord<Args...>;
+            record.fmt = fmt;
+            record.os = &os;
+            record.prefix = &prefix;
+            new (record.args)::std::tuple<Args...>(args...);
+            ring.head.store(head + 1, ::std::memory_order_release);
+        }
+
+        // 等到此前提交的记录都已写出，同步日志输出前调用，保持先后顺序
+        static void drain()
+        {
+            if (!s_started.load(::std::memory_order_acquire)) {
+                return;
+            }
+            instance().waitDrained();
+        }
+
+    private:
+        struct Record {
+            void (*format)(const Record &, ::std::string &);
+            const char *fmt;
+            ::std::ostream *os;
+            const ::std::string *prefix;
+            alignas(::std::max_align_t) unsigned char args[ARGS_SIZE];
+        };
+        struct Ring {
+            alignas(64)::std::atomic<unsigned long long> head{0};
+            alignas(64)::std::atomic<unsigned long long> tail{0};
+            ::std::atomic<bool> closed{false};
+            Record records[RING_SIZE];
+        };
+        // 线程退出时标记其缓冲，后台线程写完剩余记录后释放
+        struct RingHandle {
+            ::std::shared_ptr<Ring> ring;
+            ~RingHandle()
+            {
+                if (ring) {
+                    ring->closed.store(true, ::std::memory_order_release);
+                }
+            }
+        };
+
+        static inline ::std::atomic<bool> s_started{false};
+
+        ::std::mutex m_rings_mutex;
+        ::std::vector<::std::shared_ptr<Ring>> m_rings;
+        ::std::atomic<bool> m_stop{false};
+        ::std::thread m_thread;
+
+        AsyncLogger() : m_thread([this] { run(); })
+        {
+            s_started.store(true, ::std::memory_order_release);
+        }
+
+        static AsyncLogger &instance()
+        {
+            static AsyncLogger logger;
+            return logger;
+        }
+
+        Ring &localRing()
+        {
+            thread_local RingHandle handle;
+            if (!handle.ring) {
+                handle.ring = ::std::make_shared<Ring>();
+                ::std::lock_guard<::std::mutex> lock(m_rings_mutex);
+                m_rings.push_back(handle.ring);
+            }
+            return *handle.ring;
+        }
+
+        template <class... Args>
+        static void formatRecord(const Record &record, ::std::string &text)
+        {
+            const auto &args = *::std::launder(reinterpret_cast<const ::std::tuple<Args...> *>(record.args));
+            ::std::apply([&](const Args &...values) { text = ::std::vformat(record.fmt, ::std::make_format_args(values...)); }, args);
+        }
+
+        void waitDrained()
+        {
+            ::std::vector<::std::pair<::std::shared_ptr<Ring>, unsigned long long>> marks;
+            {
+                ::std::lock_guard<::std::mutex> lock(m_rings_mutex);
+                for (const auto &ring : m_rings) {
+                    marks.emplace_back(ring, ring->head.load(::std::memory_order_acquire));
+                }
+            }
+            for (const auto &[ring, head] : marks) {
+                while (ring->tail.load(::std::memory_order_acquire) < head) {
+                    ::std::this_thread::yield();
+                }
+            }
+        }
+
+        // 写出所有缓冲中的记录，返回写出的条数
+        int consume(::std::vector<::std::shared_ptr<Ring>> &rings, ::std::string &text)
+        {
+            {
+                ::std::lock_guard<::std::mutex> lock(m_rings_mutex);
+                ::std::erase_if(m_rings, [](const ::std::shared_ptr<Ring> &ring) {
+                    return ring->closed.load(::std::memory_order_acquire) &&
+                           ring->tail.load(::std::memory_order_relaxed) == ring->head.load(::std::memory_order_acquire);
+                });
+                rings.assign(m_rings.begin(), m_rings.end());
+            }
+
+            int written = 0;
+            // 本批写到的流，批末各 flush 一次
+            ::std::ostream *streams[4] = {};
+            int stream_count = 0;
+            ::std::lock_guard<::std::mutex> lock(g_log_mutex);
+            for (const auto &ring : rings) {
+                unsigned long long tail = ring->tail.load(::std::memory_order_relaxed);
+                unsigned long long head = ring->head.load(::std::memory_order_acquire);
+                for (; tail != head; ++tail) {
+                    const Record &record = ring->records[tail % RING_SIZE];
+                    try {
+                        record.format(record, text);
+                    } catch (const ::std::exception &) {
+                        text = record.fmt;
+                    }
+                    *record.os << *record.prefix << text << '\n';
+                    if (::std::find(streams, streams + stream_count, record.os) == streams + stream_count) {
+                        if (stream_count == 4) {
+                            record.os->flush();
+                        } else {
+                            streams[stream_count++] = record.os;
+                        }
+                    }
+                    ring->tail.store(tail + 1, ::std::memory_order_release);
+                    ++written;
+                }
+            }
+            for (int i = 0; i < stream_count; ++i) {
+                streams[i]->flush();
+            }
+            return written;
+        }
+
+        // 退出前写完剩余的记录
+        void run()
+        {
+            ::std::vector<::std::shared_ptr<Ring>> rings;
+            ::std::string text;
+            while (true) {
+                bool stopping = m_stop.load(::std::memory_order_acquire);
+                if (consume(rings, text) == 0) {
+                    if (stopping) {
+                        break;
+                    }
+                    ::std::this_thread::sleep_for(::std::chrono::microseconds(IDLE_SLEEP_US));
+                }
+            }
+        }
+    };
+} // namespace my
+
+#endif // _ASYNC_LOGGER_HPP_
\ No newline at end of file
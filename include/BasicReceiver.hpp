@@ -1,8 +1,21 @@
 #ifndef _BASIC_RECEIVER_HPP_
 #define _BASIC_RECEIVER_HPP_
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
 #include "./BasicRole.h"
+#include "./CoWorker.hpp"
+#include "./Crc32c.h"
+#include "./LzCodec.h"
+#include "./MerkleTree.h"
+#include "./TransferJournal.h"
 #include "./UDPFileWriter.h"
+#include "./UDPFramePool.h"
 
 namespace my
 {
@@ -16,7 +29,10 @@ namespace my
         BasicReceiver(const BasicReceiver &) = delete;
         BasicReceiver &operator=(const BasicReceiver &) = delete;
 
-        virtual void recvfromPeer(::std::string_view file_path) = 0;
+        // 在当前线程上阻塞运行 co_recvfromPeer() 直到传输结束
+        virtual void recvfromPeer(::std::string_view file_path);
+        // 协程版本，可与其他传输一起由 CoScheduler 在同一线程上并发驱动
+        virtual CoTask co_recvfromPeer(::std::string file_path) = 0;
 
         void setSendAckLoss(float loss) noexcept { m_send_ack_loss = loss; }
         void setRecvLoss(float loss) noexcept { m_recv_loss = loss; }
@@ -26,13 +42,102 @@ namespace my
         void enableReceiverLoss() noexcept { m_enable_loss = true; }
         void disableReceiverLoss() noexcept { m_enable_loss = false; }
 
+        const UDPBatchStats &getAckBatchStats() const noexcept { return m_ack_batch.getStats(); }
+
+        // 确认策略：每收到 every_frames 个数据帧，或首个未确认的帧等待 delay_us 微秒后确认一次
+        // 出现乱序、补上空洞或收到结束帧时不再等待；默认逐帧立即确认
+        void setAckPolicy(int every_frames, int delay_us) noexcept
+        {
+            m_ack_every = ::std::max(every_frames, 1);
+            m_ack_delay_us = ::std::max(delay_us, 0);
+        }
+        int getAckEvery() const noexcept { return m_ack_every; }
+        int getAckDelay() const noexcept { return m_ack_delay_us; }
+        // 对端发送窗口，未确认的帧达到该数目时对端已无帧可发，不再等待
+        void setPeerWindow(int window) noexcept { m_peer_window = ::std::max(window, 1); }
+
+        // 最近一次接收的文件与对端结束帧中 Merkle 根的比对结果
+        enum class Verify { NONE, MATCH, MISMATCH };
+        Verify getLastVerify() const noexcept { return m_verify; }
+        // 最近一次接收的文件在本地算出的 Merkle 树，校验不通过时用于找出需要重传的块
+        const MerkleTree &getLastTree() const noexcept { return m_recv_tree; }
+        long long getCorruptedCount() const noexcept { return m_corrupted; }
+
     protected:
+        using TimePoint = ::std::chrono::steady_clock::time_point;
+
+        // 传输结束后继续为对端补发确认的静默时长范围
+        static constexpr int LINGER_MIN_MS = 200;
+        static constexpr int LINGER_MAX_MS = 2000;
+
         float m_send_ack_loss = 0.0f;
         float m_recv_loss = 0.0f;
         bool m_enable_loss = false;
 
-        void sendAckToPeer(char ack_num);
+        UDPBatchSender m_ack_batch;
+        long long m_frame_alloc_mark = 0;
+        long long m_frame_acquire_mark = 0;
+        long long m_coalesced_mark = 0;
+
+        int m_ack_every = 1;
+        int m_ack_delay_us = 500;
+        int m_peer_window = ::std::numeric_limits<int>::max();
+        int m_unacked_frames = 0;
+        bool m_ack_due = false;
+        TimePoint m_ack_deadline{};
+        long long m_ack_sent = 0;
+
+        // 数据帧的最大到达间隔，用于估计对端的重传间隔
+        TimePoint m_last_data_time{};
+        long long m_max_data_gap_us = 0;
+
+        // 校验和不符而丢弃的数据帧数
+        long long m_corrupted = 0;
+        bool m_has_peer_root = false;
+        MerkleTree::Digest m_peer_root{};
+        long long m_peer_file_size = -1;
+        MerkleTree m_recv_tree;
+        Verify m_verify = Verify::NONE;
+
+        // 压缩的块解压到这里再写入文件
+        ::std::vector<char> m_block_buffer;
+        long long m_compressed_frames = 0;
+        long long m_compressed_bytes = 0;
+        // 本次传输写入文件的字节数，用于计算 goodput
+        long long m_recv_bytes = 0;
+
+        // 断点续传：由发起方在传输前打开日志并设定只接收的块，传输结束后关闭并恢复
+        TransferJournal m_journal;
+        BlockRanges m_recv_ranges;
+
+        void sendAckToPeer(SeqNum ack_num);
+        void queueAckToPeer(SeqNum ack_num);
+        void queueSackToPeer(SeqNum cum_ack, const unsigned char *bitmap, int bitmap_size);
+        void flushAcksToPeer();
+
+        // 记录一个需要确认的数据帧，urgent 为真时在本批帧处理完后立即确认
+        void scheduleAck(bool urgent) noexcept;
+        void sendPendingAck();
+        // 按各自协议生成表示当前接收状态的确认帧
+        virtual void queueCurrentAck() = 0;
+
+        bool takeUDPDataframeFromPeer(UDPDataframe &dataframe);
+        TimePoint flushDueAcks();
         UDPDataframe recvUDPDataframeFromPeer();
+        CoTask co_lingerForPeer();
+        // 续传时只接收缺失的块，写到原位置，保留已有内容
+        UDPFileWriter openForRecv(const ::std::string &file_path, UDPFileWriter::Mode mode);
+        // 把传输序号 position 的块写入文件，并记入日志，压缩的块先解压
+        void writeBlock(UDPFileWriter &writer, int position, const UDPDataframe &dataframe);
+        // 截到对端的文件长度后关闭，删除日志，记下本次传输的字节数与用时
+        void closeForRecv(UDPFileWriter &writer);
+        // 记下结束帧携带的 Merkle 根与文件长度
+        void takeFinPayload(const UDPDataframe &fin) noexcept;
+        // 文件落盘后在后台线程计算 Merkle 树并与对端的根比对，计算期间挂起，不阻塞同一调度器上的其他会话
+        CoTask co_verifyReceivedFile(::std::string file_path);
+
+        void resetRecvStats();
+        void logRecvStats() const;
 
     private:
     };
@@ -41,32 +146,326 @@ namespace my
     BasicReceiver<receiverWindowSize, seqNumBound>::~BasicReceiver() {}
 
     template <int receiverWindowSize, int seqNumBound>
-    void BasicReceiver<receiverWindowSize, seqNumBound>::sendAckToPeer(char ack_num)
+    void BasicReceiver<receiverWindowSize, seqNumBound>::recvfromPeer(::std::string_view file_path)
+    {
+        CoScheduler::runSync(co_recvfromPeer(::std::string(file_path)));
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::sendAckToPeer(SeqNum ack_num)
     {
         if (m_enable_loss && random() < m_send_ack_loss) {
-            pretty_log_con << ::std::format("Loss event occurs, ack frame {} was not sent", (int)ack_num);
+            PRETTY_DEBUG(pretty_log_con, "Loss event occurs, ack frame {} was not sent", ack_num);
             return;
         }
         sendAckTo(ack_num, this->m_host, this->m_peer);
     }
 
+    // 确认帧先攒入批次，在接收端将要阻塞等待时一并发出
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::queueAckToPeer(SeqNum ack_num)
+    {
+        if (m_enable_loss && random() < m_send_ack_loss) {
+            PRETTY_DEBUG(pretty_log_con, "Loss event occurs, ack frame {} was not sent", ack_num);
+            this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+            return;
+        }
+        if (m_ack_batch.isFull()) {
+            flushAcksToPeer();
+        }
+        m_ack_batch.push(UDPAck(ack_num));
+        this->m_metrics.add(TransferMetrics::Counter::ACKS_SENT);
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::queueSackToPeer(SeqNum cum_ack, const unsigned char *bitmap, int bitmap_size)
+    {
+        if (m_enable_loss && random() < m_send_ack_loss) {
+            PRETTY_DEBUG(pretty_log_con, "Loss event occurs, sack frame {} was not sent", cum_ack);
+            this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+            return;
+        }
+        if (m_ack_batch.isFull()) {
+            flushAcksToPeer();
+        }
+        m_ack_batch.push(UDPSack(cum_ack, bitmap, bitmap_size));
+        this->m_metrics.add(TransferMetrics::Counter::ACKS_SENT);
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    inline void BasicReceiver<receiverWindowSize, seqNumBound>::flushAcksToPeer()
+    {
+        if (!m_ack_batch.isEmpty()) {
+            m_ack_batch.flush(this->m_host, this->m_peer);
+        }
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::scheduleAck(bool urgent) noexcept
+    {
+        if (m_unacked_frames++ == 0) {
+            m_ack_deadline = ::std::chrono::steady_clock::now() + ::std::chrono::microseconds(m_ack_delay_us);
+        }
+        if (urgent || m_unacked_frames >= ::std::min(m_ack_every, m_peer_window)) {
+            m_ack_due = true;
+        }
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::sendPendingAck()
+    {
+        if (m_unacked_frames == 0) {
+            return;
+        }
+        queueCurrentAck();
+        ++m_ack_sent;
+        m_unacked_frames = 0;
+        m_ack_due = false;
+    }
+
+    // 从接收缓冲取一个对端的数据帧，缓冲取空时返回 false，不等待
+    template <int receiverWindowSize, int seqNumBound>
+    bool BasicReceiver<receiverWindowSize, seqNumBound>::takeUDPDataframeFromPeer(UDPDataframe &dataframe)
+    {
+        while (!this->m_inbox.isEmpty()) {
+            UDPDataframe &front = this->m_inbox.front();
+            if (this->takeProbeFrame(front, this->m_inbox.frontPeer())) {
+                this->m_inbox.pop();
+                continue;
+            }
+            bool accepted = front.isData() && this->m_inbox.frontPeer() == this->m_peer;
+            if (accepted) {
+                // 交换而非移动，使缓冲槽位保持可用
+                ::std::swap(dataframe, front);
+            }
+            this->m_inbox.pop();
+            if (!accepted) {
+                continue;
+            }
+            this->m_metrics.add(TransferMetrics::Counter::FRAMES_RECEIVED);
+            if (!dataframe.verifyChecksum()) {
+                // 按丢失处理，等待对端重传
+                ++m_corrupted;
+                this->m_metrics.add(TransferMetrics::Counter::CORRUPTED_FRAMES);
+                PRETTY_DEBUG(pretty_log, "Checksum mismatch, data frame {} discarded", dataframe.getDataNum());
+                continue;
+            }
+
+            if (!m_enable_loss || random() >= m_recv_loss) {
+                auto now = ::std::chrono::steady_clock::now();
+                m_max_data_gap_us = ::std::max(m_max_data_gap_us, (long long)::std::chrono::duration_cast<::std::chrono::microseconds>(now - m_last_data_time).count());
+                m_last_data_time = now;
+                return true;
+            }
+
+            PRETTY_DEBUG(pretty_log, "Loss event occurs, data frame {} was not received (already sent by peer)", dataframe.getDataNum());
+            this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+        }
+        return false;
+    }
+
+    // 本批帧已处理完，到期的确认合并为一个发出
+    // 返回接下来最多等待到的时刻：还有延迟的确认时为其截止时刻，否则不限
+    template <int receiverWindowSize, int seqNumBound>
+    typename BasicReceiver<receiverWindowSize, seqNumBound>::TimePoint BasicReceiver<receiverWindowSize, seqNumBound>::flushDueAcks()
+    {
+        auto now = ::std::chrono::steady_clock::now();
+        if (m_unacked_frames > 0 && (m_ack_due || now >= m_ack_deadline)) {
+            sendPendingAck();
+        }
+        flushAcksToPeer();
+        return m_unacked_frames > 0 ? m_ack_deadline : TimePoint::max();
+    }
+
     template <int receiverWindowSize, int seqNumBound>
     UDPDataframe BasicReceiver<receiverWindowSize, seqNumBound>::recvUDPDataframeFromPeer()
     {
         UDPDataframe dataframe;
-        Peer peer;
+        while (!takeUDPDataframeFromPeer(dataframe)) {
+            TimePoint deadline = flushDueAcks();
+            if (deadline != TimePoint::max()) {
+                this->waitFramesUntil(deadline);
+            } else {
+                // 阻塞到至少一个帧到达，并一次取走所有已到达的帧
+                this->m_inbox.recv(this->m_host, true);
+            }
+        }
+        return dataframe;
+    }
+
+    // 最后的确认可能丢失，对端会一直重发
+    // 传输结束后继续为重发的数据帧补发确认，直到静默一段时间或对端发来命令帧
+    // 所有数据都已收到，按数据帧自身的序号确认对 GBN 与 SR 都成立
+    template <int receiverWindowSize, int seqNumBound>
+    CoTask BasicReceiver<receiverWindowSize, seqNumBound>::co_lingerForPeer()
+    {
+        sendPendingAck();
+        auto quiet = ::std::chrono::microseconds(::std::clamp(2 * m_max_data_gap_us, LINGER_MIN_MS * 1000LL, LINGER_MAX_MS * 1000LL));
+        int reacked = 0;
         while (true) {
-            do {
-                dataframe = ::std::move(recvUDPDataframeFrom(this->m_host, peer));
-            } while (!dataframe.isData() || this->m_peer != peer);
+            if (this->m_inbox.isEmpty()) {
+                flushAcksToPeer();
+                if (!co_await this->coWaitFrames(::std::chrono::steady_clock::now() + quiet)) {
+                    break;
+                }
+                continue;
+            }
 
-            if (!m_enable_loss || random() >= m_recv_loss) {
+            UDPDataframe &front = this->m_inbox.front();
+            if (front.isCmd()) {
+                // 命令帧留给命令处理
                 break;
             }
+            if (front.isData() && this->m_inbox.frontPeer() == this->m_peer && front.verifyChecksum()) {
+                queueAckToPeer(front.getDataNum());
+                ++reacked;
+            }
+            this->m_inbox.pop();
+        }
+        flushAcksToPeer();
 
-            pretty_log << ::std::format("Loss event occurs, data frame {} was not received (already sent by peer)", (int)dataframe.getDataNum());
+        if (reacked) {
+            pretty_log << ::std::format("Re-acknowledged {} data frame(s) resent by peer after transfer", reacked);
         }
-        return dataframe;
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    UDPFileWriter BasicReceiver<receiverWindowSize, seqNumBound>::openForRecv(const ::std::string &file_path, UDPFileWriter::Mode mode)
+    {
+        if (m_recv_ranges.isAll()) {
+            return UDPFileWriter(file_path, mode, this->m_block_size);
+        }
+        pretty_log << ::std::format("Resume: {} block(s) already received, receive {}", m_journal.getReceivedCount(), m_recv_ranges.toString());
+        return UDPFileWriter(file_path, UDPFileWriter::Mode::POSITIONAL, this->m_block_size, false);
+    }
+
+    // 日志攒够一批时先让数据落到内核再写回位图
+    template <int receiverWindowSize, int seqNumBound>
+    inline void BasicReceiver<receiverWindowSize, seqNumBound>::writeBlock(UDPFileWriter &writer, int position, const UDPDataframe &dataframe)
+    {
+        int block = m_recv_ranges.map(position);
+        int size;
+        const char *data = dataframe.data(size);
+        if (dataframe.isCompressed()) {
+            m_block_buffer.resize(this->m_block_size);
+            int compressed_size = size;
+            size = lzDecompress(data, compressed_size, m_block_buffer.data(), this->m_block_size);
+            if (size < 0) {
+                pretty_out << ::std::format("throw from BasicReceiver::writeBlock(): Invalid compressed block, block = {0}", block);
+                throw std::runtime_error("Invalid compressed block");
+            }
+            data = m_block_buffer.data();
+            ++m_compressed_frames;
+            m_compressed_bytes += compressed_size;
+        }
+        if (writer.isPositional()) {
+            writer.writeAt(block, data, size);
+        } else {
+            writer.append(data, size);
+        }
+        m_recv_bytes += size;
+        if (m_journal.isOpen() && m_journal.markReceived(block)) {
+            writer.flush();
+            m_journal.flush();
+        }
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    void BasicReceiver<receiverWindowSize, seqNumBound>::closeForRecv(UDPFileWriter &writer)
+    {
+        if (m_peer_file_size >= 0) {
+            writer.setFileSize(m_peer_file_size);
+        }
+        writer.close();
+        this->m_metrics.endTransfer(m_recv_bytes, ::std::chrono::steady_clock::now());
+        if (m_journal.isOpen()) {
+            m_journal.remove();
+        }
+        m_recv_ranges = BlockRanges();
+    }
+
+    // 载荷长度不符时视为对端未提供根，不做校验
+    template <int receiverWindowSize, int seqNumBound>
+    inline void BasicReceiver<receiverWindowSize, seqNumBound>::takeFinPayload(const UDPDataframe &fin) noexcept
+    {
+        int size;
+        const char *data = fin.data(size);
+        m_has_peer_root = size == UDPDataframe::FIN_PAYLOAD_SIZE;
+        m_peer_file_size = -1;
+        if (m_has_peer_root) {
+            ::std::memcpy(m_peer_root.data(), data, MerkleTree::DIGEST_SIZE);
+            m_peer_file_size = 0;
+            for (int i = 0; i < 8; ++i) {
+                m_peer_file_size = m_peer_file_size << 8 | (unsigned char)data[MerkleTree::DIGEST_SIZE + i];
+            }
+        }
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    CoTask BasicReceiver<receiverWindowSize, seqNumBound>::co_verifyReceivedFile(::std::string file_path)
+    {
+        if (!m_has_peer_root) {
+            m_verify = Verify::NONE;
+            pretty_log << "Merkle root: not provided by peer, file not verified";
+            co_return;
+        }
+        CoWorker<MerkleTree> worker([file_path, block_size = this->m_block_size] {
+            return MerkleTree::fromFile(file_path, block_size);
+        });
+        m_recv_tree = co_await worker;
+        m_verify = m_recv_tree.getRoot() == m_peer_root ? Verify::MATCH : Verify::MISMATCH;
+        if (m_verify == Verify::MATCH) {
+            pretty_log << ::std::format("Merkle root: {}, {} block(s) verified", Sha256::toHex(m_peer_root), m_recv_tree.getLeafCount());
+        } else {
+            pretty_err << ::std::format("Merkle root mismatch: expected {}, got {}", Sha256::toHex(m_peer_root), Sha256::toHex(m_recv_tree.getRoot()));
+        }
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    inline void BasicReceiver<receiverWindowSize, seqNumBound>::resetRecvStats()
+    {
+        m_unacked_frames = 0;
+        m_ack_due = false;
+        m_ack_sent = 0;
+        m_last_data_time = ::std::chrono::steady_clock::now();
+        m_max_data_gap_us = 0;
+        m_corrupted = 0;
+        m_compressed_frames = 0;
+        m_compressed_bytes = 0;
+        m_recv_bytes = 0;
+        m_has_peer_root = false;
+        m_peer_file_size = -1;
+        m_recv_tree = MerkleTree();
+        m_verify = Verify::NONE;
+
+        m_ack_batch.resetStats();
+        this->m_inbox.resetStats();
+
+        // 预先备好一个批次的缓冲，之后的收发只在池内循环
+        UDPFramePool::reserve(2 * UDPBatchSender::MAX_BATCH, UDPDataframe::HEADER_SIZE + this->m_block_size);
+        m_frame_alloc_mark = UDPFramePool::getAllocCount();
+        m_frame_acquire_mark = UDPFramePool::getAcquireCount();
+        m_coalesced_mark = this->m_inbox.getCoalescedCount();
+        this->m_metrics.beginTransfer(::std::chrono::steady_clock::now());
+    }
+
+    template <int receiverWindowSize, int seqNumBound>
+    inline void BasicReceiver<receiverWindowSize, seqNumBound>::logRecvStats() const
+    {
+        pretty_log
+            << "Batch I/O statistics:"
+            << ::std::format("recv data: {}{}", this->m_inbox.getStats().toString(),
+                             this->m_inbox.getCoalescedCount() > m_coalesced_mark ? ::std::format(", {} coalesced datagram(s)", this->m_inbox.getCoalescedCount() - m_coalesced_mark) : "")
+            << ::std::format("send ack:  {}", m_ack_batch.getStats().toString())
+            << ::std::format("ack policy: every {} frame(s) or {} us, {} ack(s) sent", m_ack_every, m_ack_delay_us, m_ack_sent)
+            << ::std::format("frame buffers: {} acquired, {} heap allocation(s)",
+                             UDPFramePool::getAcquireCount() - m_frame_acquire_mark,
+                             UDPFramePool::getAllocCount() - m_frame_alloc_mark)
+            << ::std::format("path MTU: {}", this->m_pmtu.toString())
+            << ::std::format("checksum: crc32c ({}), {} corrupted frame(s) discarded", crc32cImplementation(), m_corrupted)
+            << ::std::format("compression: {} compressed frame(s), {} byte(s) before decompression", m_compressed_frames, m_compressed_bytes)
+            << ::std::format("goodput: {} byte(s) in {:.3f} s, {:.2f} MB/s",
+                             this->m_metrics.getLastBytes(), this->m_metrics.getLastMicros() / 1e6, this->m_metrics.getLastGoodput() / 1e6);
     }
 } // namespace my
 
@@ -3,7 +3,13 @@
 
 #include <random>
 
+#include "./CoScheduler.h"
 #include "./Entity.hpp"
+#include "./PathMtuProber.h"
+#include "./Reactor.h"
+#include "./TransferMetrics.h"
+#include "./UDPBatchIO.h"
+#include "./UDPDemux.h"
 
 namespace my
 {
@@ -39,30 +45,104 @@ namespace my
         virtual void setPeer(sockaddr_in peer_address) final { m_peer.m_address = peer_address; }
         virtual void setPeer(const Peer &peer) final { m_peer = peer; }
         virtual void setTimeout(int timeout) final { m_timeout = timeout; }
+        // 每个数据帧的载荷字节数，收发双方须一致，在传输开始前设置
+        void setBlockSize(int block_size)
+        {
+            if (block_size <= 0 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+                pretty_out << ::std::format("throw from BasicRole::setBlockSize(): Invalid block_size, block_size = {0}", block_size);
+                throw std::runtime_error("Invalid block_size");
+            }
+            m_block_size = block_size;
+        }
+        int getBlockSize() const noexcept { return m_block_size; }
+        const PathMtuProber &getPathMtu() const noexcept { return m_pmtu; }
 
         virtual float random() final { return m_distribution(m_engine); }
 
+        const UDPBatchStats &getRecvBatchStats() const noexcept { return m_inbox.getStats(); }
+        // 以下计数为累计值
+        long long getWaitCount() const noexcept { return m_wait_count; }
+        long long getWaitTimeoutCount() const noexcept { return m_wait_timeout_count; }
+        // 收发两端共用，跨多次传输累计
+        const TransferMetrics &getMetrics() const noexcept { return m_metrics; }
+        void resetMetrics() noexcept { m_metrics.reset(); }
+
     protected:
         Host m_host;
         Peer m_peer;
-        int m_timeout = 2000;
+        // 初始重传超时时间，取得 RTT 样本后由发送端自适应调整
+        int m_timeout = 1000;
+        int m_block_size = UDPDataframe::DEFAULT_DATA_SIZE;
+
+        // 批量接收缓冲，发送端（确认帧）与接收端（数据帧）共用
+        UDPBatchReceiver m_inbox;
+        Reactor m_reactor;
+        // 与其他会话共用 socket 时由分发者填充 m_inbox，此时不直接读 socket
+        UDPDemux *m_demux = nullptr;
+        long long m_wait_count = 0;
+        long long m_wait_timeout_count = 0;
+        TransferMetrics m_metrics;
+
+        // 路径 MTU 探测由选择块大小的一方（客户端）启用，另一方只应答探测帧
+        PathMtuProber m_pmtu;
+        // 探测结果所对应的对端，对端改变时重新搜索
+        Peer m_pmtu_peer;
+
+        // 阻塞地完成一次路径 MTU 搜索，已有结果且未到重新探测时间时直接返回
+        // 期间收到的其他帧视为残留丢弃，只能在传输开始前且未接入分发者时调用
+        void probePathMtu();
+        // 传输循环中调用，不等待：到期时发出新一轮探测，本轮结束时更新结果
+        void pollPathMtu(PathMtuProber::TimePoint now);
+        // 应答探测帧、记录探测确认帧，返回 true 表示 frame 已处理
+        bool takeProbeFrame(const UDPDataframe &frame, const Peer &from);
+
+        // 以 m_peer 注册到分发者，之后只能使用协程版本的等待
+        void attachDemux(UDPDemux &demux);
+        void detachDemux() noexcept;
+
+        // 等到有帧到达或到达 deadline，有帧时一次取走，缓冲非空时立即返回
+        bool waitFramesUntil(Reactor::TimePoint deadline);
+
+        // waitFramesUntil() 的协程版本，挂起期间由当前线程的调度器等待 socket
+        class FramesAwaiter
+        {
+        public:
+            FramesAwaiter(BasicRole &role, CoScheduler::TimePoint deadline) noexcept : m_role(role), m_deadline(deadline) {}
+
+            bool await_ready() const noexcept { return !m_role.m_inbox.isEmpty(); }
+            void await_suspend(::std::coroutine_handle<> handle);
+            bool await_resume();
+
+        private:
+            BasicRole &m_role;
+            CoScheduler::TimePoint m_deadline;
+            bool m_readable = false;
+            bool m_suspended = false;
+        };
+        FramesAwaiter coWaitFrames(CoScheduler::TimePoint deadline) noexcept { return FramesAwaiter(*this, deadline); }
 
     private:
-        static std::random_device m_device;
-        static std::mt19937 m_engine;
-        static std::uniform_real_distribution<float> m_distribution;
+        void sendPathMtuProbes(const ::std::vector<int> &sizes);
+
+        // 服务端分片在各自线程上运行，随机数引擎每线程一个
+        static thread_local std::random_device m_device;
+        static thread_local std::mt19937 m_engine;
+        static thread_local std::uniform_real_distribution<float> m_distribution;
     };
 
-    inline int getActualForwardBlockNum(int base, char ack_num, int seqNumBound) noexcept
+    // 序号空间可达 2^32，中间结果用 long long 计算避免溢出
+    inline int getActualForwardBlockNum(int base, SeqNum ack_num, long long seqNumBound) noexcept
     {
-        int base_mod_M = base % seqNumBound;
-        return (base + ack_num - base_mod_M) + (base_mod_M <= ack_num ? 0 : seqNumBound);
+        long long distance = ((long long)ack_num - base % seqNumBound + seqNumBound) % seqNumBound;
+        return (int)(base + distance);
     }
 
-    inline int getActualBackwardBlockNum(int base, char ack_num, int seqNumBound) noexcept
+    inline int getActualBackwardBlockNum(int base, SeqNum ack_num, long long seqNumBound) noexcept
     {
-        int num = (base - 1) % seqNumBound;
-        return (base - 1 - num + ack_num) - (ack_num <= num ? 0 : seqNumBound);
+        long long distance = ((long long)base - 1 - ack_num) % seqNumBound;
+        if (distance < 0)
+            distance += seqNumBound;
+        return (int)(base - 1 - distance);
     }
 
 } // namespace my
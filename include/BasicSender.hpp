@@ -1,8 +1,22 @@
 #ifndef _BASIC_SENDER_HPP_
 #define _BASIC_SENDER_HPP_
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "./BasicRole.h"
+#include "./BlockCompressor.h"
+#include "./CoWorker.hpp"
+#include "./CongestionControl.h"
+#include "./MerkleTree.h"
+#include "./RtoEstimator.h"
 #include "./UDPFileReader.h"
+#include "./UDPFramePool.h"
 
 namespace my
 {
@@ -16,7 +30,10 @@ namespace my
         BasicSender(const BasicSender &) = delete;
         BasicSender &operator=(const BasicSender &) = delete;
 
-        virtual void sendtoPeer(::std::string_view filename) = 0;
+        // 在当前线程上阻塞运行 co_sendtoPeer() 直到传输结束
+        virtual void sendtoPeer(::std::string_view filename);
+        // 协程版本，可与其他传输一起由 CoScheduler 在同一线程上并发驱动
+        virtual CoTask co_sendtoPeer(::std::string filename) = 0;
 
         void setSendLoss(float loss) noexcept { m_send_loss = loss; }
         void setRecvAckLoss(float loss) noexcept { m_recv_ack_loss = loss; }
@@ -26,66 +43,367 @@ namespace my
         void enableSenderLoss() noexcept { m_enable_loss = true; }
         void disableSenderLoss() noexcept { m_enable_loss = false; }
 
+        const UDPBatchStats &getSendBatchStats() const noexcept { return m_batch_sender.getStats(); }
+        const RtoEstimator &getRtoEstimator() const noexcept { return m_rto; }
+        int getRto() const noexcept { return m_rto.getRto(); }
+
+        // 拥塞控制算法：none / reno / delay，名称无效时返回 false
+        bool setCongestionControl(::std::string_view name);
+        const CongestionController &getCongestionController() const noexcept { return *m_cc; }
+        // 实际生效的发送窗口，编译期的 senderWindowSize 为其上限
+        int getEffectiveWindow() const noexcept { return ::std::min(senderWindowSize, m_cc->getWindow()); }
+
+        // 收到多少个重复确认后快速重传，0 表示关闭
+        void setDupAckThreshold(int threshold) noexcept { m_dup_ack_threshold = ::std::max(threshold, 0); }
+        int getDupAckThreshold() const noexcept { return m_dup_ack_threshold; }
+
     protected:
+        using TimePoint = ::std::chrono::steady_clock::time_point;
+
         float m_send_loss = 0.0f;
         float m_recv_ack_loss = 0.0f;
         bool m_enable_loss = false;
 
+        UDPBatchSender m_batch_sender;
+        ::std::vector<int> m_ack_nums;
+        long long m_frame_alloc_mark = 0;
+        long long m_frame_acquire_mark = 0;
+        long long m_wait_mark = 0;
+        long long m_wait_timeout_mark = 0;
+
+        // RTT 取样：记录窗口内每个数据帧的发送时刻，按块号对窗口大小取模存放
+        RtoEstimator m_rto;
+        ::std::vector<TimePoint> m_send_times = ::std::vector<TimePoint>(senderWindowSize);
+        ::std::vector<bool> m_retransmitted = ::std::vector<bool>(senderWindowSize, false);
+
+        void markSent(int index, TimePoint now, bool retransmit) noexcept
+        {
+            m_send_times[index % senderWindowSize] = now;
+            m_retransmitted[index % senderWindowSize] = retransmit;
+            this->m_metrics.add(TransferMetrics::Counter::FRAMES_SENT);
+            if (retransmit) {
+                this->m_metrics.add(TransferMetrics::Counter::FRAMES_RETRANSMITTED);
+            }
+        }
+        long long sampleRtt(int index, TimePoint now) noexcept;
+
+        // 同一次丢包引起的多个超时只让拥塞窗口与 RTO 反应一次：
+        // 只有在上次反应之后发出的数据帧超时，才算新的丢包
+        ::std::unique_ptr<CongestionController> m_cc = makeCongestionController("reno");
+        TimePoint m_last_loss_time{};
+        int m_dup_ack_threshold = 3;
+        long long m_fast_retransmits = 0;
+
+        bool isSentAfterLoss(int index) const noexcept { return m_send_times[index % senderWindowSize] >= m_last_loss_time; }
+        void onTimeoutLoss(TimePoint now) noexcept
+        {
+            m_rto.backoff();
+            m_cc->onTimeout();
+            m_last_loss_time = now;
+        }
+        // 重复确认表明后续帧仍在到达，只缩小拥塞窗口，不退避 RTO
+        void onDupAckLoss(int in_flight, TimePoint now) noexcept
+        {
+            m_cc->onLoss(in_flight);
+            m_last_loss_time = now;
+            ++m_fast_retransmits;
+            this->m_metrics.add(TransferMetrics::Counter::FAST_RETRANSMITS);
+        }
+
+        // 与发送并行地在后台线程计算 Merkle 树，发结束帧时才取根
+        CoWorker<MerkleTree::Digest> m_merkle_worker;
+        MerkleTree::Digest m_merkle_root{};
+        char m_fin_payload[UDPDataframe::FIN_PAYLOAD_SIZE] = {};
+
+        void startMerkleTree(const ::std::string &filename);
+        // 首次发结束帧前调用，Merkle 树未算完时先发出已排队的帧，挂起等待，不阻塞同一调度器上的其他会话
+        CoTask co_prepareFin(const UDPFileReader &reader);
+
+        // 续传时只发送对端缺失的块，传输开始时取走，之后恢复为整个文件
+        BlockRanges m_send_ranges;
+
+        void setSendRanges(BlockRanges ranges) noexcept { m_send_ranges = ::std::move(ranges); }
+
+        // 压缩与续传一样只对下一次传输有效，由发起方在协商后设定
+        bool m_send_compression = false;
+        ::std::unique_ptr<BlockCompressor> m_compressor;
+        BlockCompressor::Stats m_compression_stats;
+
+        void setSendCompression(bool enabled) noexcept { m_send_compression = enabled; }
+        // 打开要发送的文件，按 m_send_ranges 选出要发送的块，开始计算 Merkle 树，需要时开始压缩
+        void openForSend(UDPFileReader &reader, const ::std::string &filename);
+        // 传输结束后停止压缩并释放其映射，记下本次传输的字节数与用时
+        void closeForSend(const UDPFileReader &reader);
+
+        // 命令握手时等待确认帧的时长
+        static constexpr int HANDSHAKE_WAIT_MS = 100;
+
         int recvAckFromPeer();
+        const ::std::vector<int> &takeAcksFromPeer();
+        template <typename SackHandler>
+        const ::std::vector<int> &takeAcksFromPeer(SackHandler &&on_sack);
+        void queueUDPDataframeToPeer(UDPFileReader &reader, int index);
+        void flushToPeer();
         void sendUDPDataframeToPeer(UDPFileReader &reader, int index);
+
+        void resetSendStats();
+        void logSendStats() const;
     };
 
     template <int senderWindowSize, int seqNumBound>
     BasicSender<senderWindowSize, seqNumBound>::~BasicSender() {}
 
     template <int senderWindowSize, int seqNumBound>
-    int BasicSender<senderWindowSize, seqNumBound>::recvAckFromPeer()
+    void BasicSender<senderWindowSize, seqNumBound>::sendtoPeer(::std::string_view filename)
     {
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(this->m_host.getSocket(), &readfds);
-        TIMEVAL timeout = {0, 100000}; // 0.1s
+        CoScheduler::runSync(co_sendtoPeer(::std::string(filename)));
+    }
 
-        int sum = select(0, &readfds, nullptr, nullptr, &timeout);
-        if (sum == SOCKET_ERROR) {
-            pretty_out << ::std::format("throw from BasicSender::recvAckFromPeer(): select() failed, WSAGetLastError() = {0}", WSAGetLastError());
-            throw std::runtime_error("select() failed");
-        } else if (sum == 0) {
+    // 只取一个确认帧，用于命令握手
+    // 遇到对方的数据帧时停止，留给接收端处理
+    template <int senderWindowSize, int seqNumBound>
+    int BasicSender<senderWindowSize, seqNumBound>::recvAckFromPeer()
+    {
+        if (!this->waitFramesUntil(::std::chrono::steady_clock::now() + ::std::chrono::milliseconds(HANDSHAKE_WAIT_MS))) {
             return -1;
         }
 
-        Peer peer;
-        char ack_num;
-        try {
-            ack_num = recvAckFrom(this->m_host, peer);
-        } catch (const std::runtime_error &e) {
-            pretty_out
-                << ::std::format("catch by BasicSender::recvAckFromPeer():")
-                << e.what();
-            return -1;
-        }
+        for (; !this->m_inbox.isEmpty(); this->m_inbox.pop()) {
+            UDPDataframe &dataframe = this->m_inbox.front();
+            if (this->m_inbox.frontPeer() != this->m_peer) {
+                continue;
+            }
+            // 对端已进入下一阶段，数据帧或命令帧留在缓冲中交给后续处理
+            if (dataframe.isData() || dataframe.isCmd()) {
+                return -1;
+            }
+            if (!dataframe.isAck()) {
+                continue;
+            }
 
-        if (peer == this->m_peer) {
+            SeqNum ack_num = dataframe.getAckNum();
+            this->m_inbox.pop();
             if (m_enable_loss && this->random() < this->m_recv_ack_loss) {
-                pretty_log << ::std::format("Loss event occurs, ack frame {} was not received (already sent by peer)", (int)ack_num);
+                PRETTY_DEBUG(pretty_log, "Loss event occurs, ack frame {} was not received (already sent by peer)", ack_num);
                 return -1;
             }
             return ack_num;
-        } else {
-            return -1;
         }
+        return -1;
     }
 
+    // 取出接收缓冲中的全部确认帧，不等待，忽略选择确认帧
     template <int senderWindowSize, int seqNumBound>
-    inline void BasicSender<senderWindowSize, seqNumBound>::sendUDPDataframeToPeer(UDPFileReader &reader, int index)
+    inline const ::std::vector<int> &BasicSender<senderWindowSize, seqNumBound>::takeAcksFromPeer()
+    {
+        return takeAcksFromPeer([](const UDPDataframe &) {});
+    }
+
+    // 选择确认帧在取到时立即交给 on_sack 处理，普通确认帧照常返回
+    template <int senderWindowSize, int seqNumBound>
+    template <typename SackHandler>
+    const ::std::vector<int> &BasicSender<senderWindowSize, seqNumBound>::takeAcksFromPeer(SackHandler &&on_sack)
+    {
+        m_ack_nums.clear();
+
+        for (; !this->m_inbox.isEmpty(); this->m_inbox.pop()) {
+            UDPDataframe &dataframe = this->m_inbox.front();
+            if (dataframe.isCmd()) {
+                break;
+            }
+            if (this->takeProbeFrame(dataframe, this->m_inbox.frontPeer()) || this->m_inbox.frontPeer() != this->m_peer) {
+                continue;
+            }
+            if (dataframe.isSack()) {
+                if (m_enable_loss && this->random() < this->m_recv_ack_loss) {
+                    PRETTY_DEBUG(pretty_log, "Loss event occurs, sack frame {} was not received (already sent by peer)", dataframe.getAckNum());
+                    this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+                    continue;
+                }
+                this->m_metrics.add(TransferMetrics::Counter::ACKS_RECEIVED);
+                on_sack(dataframe);
+                continue;
+            }
+            if (!dataframe.isAck()) {
+                continue;
+            }
+
+            SeqNum ack_num = dataframe.getAckNum();
+            if (m_enable_loss && this->random() < this->m_recv_ack_loss) {
+                PRETTY_DEBUG(pretty_log, "Loss event occurs, ack frame {} was not received (already sent by peer)", ack_num);
+                this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+                continue;
+            }
+            this->m_metrics.add(TransferMetrics::Counter::ACKS_RECEIVED);
+            m_ack_nums.push_back(ack_num);
+        }
+        return m_ack_nums;
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    void BasicSender<senderWindowSize, seqNumBound>::queueUDPDataframeToPeer(UDPFileReader &reader, int index)
     {
         if (m_enable_loss && this->random() < this->m_send_loss) {
-            pretty_log_con << ::std::format("Loss event occurs, data frame {} was not sent", index);
+            PRETTY_DEBUG(pretty_log_con, "Loss event occurs, data frame {} was not sent", index);
+            this->m_metrics.add(TransferMetrics::Counter::SIMULATED_LOSSES);
+            return;
+        }
+        if (m_batch_sender.isFull()) {
+            flushToPeer();
+        }
+        // 结束帧携带 Merkle 根与文件长度，载荷由 co_prepareFin() 备好，在成员中，发出前保持有效
+        if (index == reader.getBlockCount()) {
+            m_batch_sender.push(index % seqNumBound, m_fin_payload, UDPDataframe::FIN_PAYLOAD_SIZE, UDPDataframe::FLAG_FIN);
+            return;
+        }
+        const char *payload;
+        int payload_size;
+        // 压缩的块已由工作线程备好，载荷指向压缩结果
+        if (m_compressor && m_compressor->getBlock(index, payload, payload_size)) {
+            m_batch_sender.push(index % seqNumBound, payload, payload_size, UDPDataframe::FLAG_COMPRESSED);
+            return;
+        }
+        // 映射模式下载荷直接指向文件映射，只拼接帧头，不拷贝数据
+        if (reader.isMapped()) {
+            payload_size = reader.getBlock(index, payload);
+            m_batch_sender.push(index % seqNumBound, payload, payload_size);
             return;
         }
         UDPDataframe dataframe = reader.getDataframe(index);
         dataframe.setDataNum(index % seqNumBound);
-        sendUDPDataframeTo(dataframe, this->m_host, this->m_peer);
+        m_batch_sender.push(::std::move(dataframe));
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    inline void BasicSender<senderWindowSize, seqNumBound>::flushToPeer()
+    {
+        if (!m_batch_sender.isEmpty()) {
+            m_batch_sender.flush(this->m_host, this->m_peer);
+        }
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    inline void BasicSender<senderWindowSize, seqNumBound>::sendUDPDataframeToPeer(UDPFileReader &reader, int index)
+    {
+        queueUDPDataframeToPeer(reader, index);
+        flushToPeer();
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    inline void BasicSender<senderWindowSize, seqNumBound>::startMerkleTree(const ::std::string &filename)
+    {
+        m_merkle_worker = CoWorker<MerkleTree::Digest>([filename, block_size = this->m_block_size] {
+            return MerkleTree::fromFile(filename, block_size, 0).getRoot();
+        });
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    CoTask BasicSender<senderWindowSize, seqNumBound>::co_prepareFin(const UDPFileReader &reader)
+    {
+        if (!m_merkle_worker.valid()) {
+            co_return;
+        }
+        flushToPeer();
+        m_merkle_root = co_await m_merkle_worker;
+        ::std::memcpy(m_fin_payload, m_merkle_root.data(), MerkleTree::DIGEST_SIZE);
+        long long file_size = reader.getFileSize();
+        for (int i = 0; i < 8; ++i) {
+            m_fin_payload[MerkleTree::DIGEST_SIZE + i] = (char)(file_size >> (56 - 8 * i));
+        }
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    void BasicSender<senderWindowSize, seqNumBound>::openForSend(UDPFileReader &reader, const ::std::string &filename)
+    {
+        BlockRanges ranges = ::std::exchange(m_send_ranges, BlockRanges());
+        if (!ranges.isAll()) {
+            int file_block_count = reader.getBlockCount();
+            reader.selectBlocks(ranges);
+            pretty_log << ::std::format("Resume: send {} of {} block(s)", reader.getBlockCount(), file_block_count);
+        }
+        startMerkleTree(filename);
+
+        // 已发出的帧在一个窗口内可能重传，批次中的载荷在发出前也须有效
+        m_compressor.reset();
+        if (::std::exchange(m_send_compression, false)) {
+            m_compressor = ::std::make_unique<BlockCompressor>(filename, this->m_block_size, ::std::move(ranges), senderWindowSize + UDPBatchSender::MAX_BATCH);
+            if (!m_compressor->isEnabled()) {
+                m_compressor.reset();
+            }
+        }
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    void BasicSender<senderWindowSize, seqNumBound>::closeForSend(const UDPFileReader &reader)
+    {
+        this->m_metrics.endTransfer(reader.getSelectedSize(), ::std::chrono::steady_clock::now());
+        m_compression_stats = m_compressor ? m_compressor->getStats() : BlockCompressor::Stats();
+        m_compressor.reset();
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    bool BasicSender<senderWindowSize, seqNumBound>::setCongestionControl(::std::string_view name)
+    {
+        ::std::unique_ptr<CongestionController> controller = makeCongestionController(name);
+        if (!controller) {
+            return false;
+        }
+        m_cc = ::std::move(controller);
+        return true;
+    }
+
+    // Karn 算法：重传过的数据帧无法区分确认对应哪一次发送，不取样，返回 -1
+    template <int senderWindowSize, int seqNumBound>
+    inline long long BasicSender<senderWindowSize, seqNumBound>::sampleRtt(int index, TimePoint now) noexcept
+    {
+        if (m_retransmitted[index % senderWindowSize]) {
+            return -1;
+        }
+        auto rtt = ::std::chrono::duration_cast<::std::chrono::microseconds>(now - m_send_times[index % senderWindowSize]);
+        m_rto.sample(rtt.count());
+        this->m_metrics.recordRtt(rtt.count());
+        return rtt.count();
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    inline void BasicSender<senderWindowSize, seqNumBound>::resetSendStats()
+    {
+        m_rto.reset(this->m_timeout);
+        m_cc->reset();
+        m_cc->setWindowLimit(senderWindowSize);
+        m_last_loss_time = TimePoint{};
+        m_fast_retransmits = 0;
+        m_batch_sender.resetStats();
+        this->m_inbox.resetStats();
+
+        // 预先备好一个批次的缓冲，之后的收发只在池内循环
+        UDPFramePool::reserve(2 * UDPBatchSender::MAX_BATCH);
+        m_frame_alloc_mark = UDPFramePool::getAllocCount();
+        m_frame_acquire_mark = UDPFramePool::getAcquireCount();
+        m_wait_mark = this->m_wait_count;
+        m_wait_timeout_mark = this->m_wait_timeout_count;
+        this->m_metrics.beginTransfer(::std::chrono::steady_clock::now());
+    }
+
+    template <int senderWindowSize, int seqNumBound>
+    inline void BasicSender<senderWindowSize, seqNumBound>::logSendStats() const
+    {
+        pretty_log
+            << "Batch I/O statistics:"
+            << ::std::format("send data: {}, {} byte(s) per frame, segmentation offload {}",
+                             m_batch_sender.getStats().toString(), this->m_block_size, m_batch_sender.isSegmentationEnabled() ? "on" : "off")
+            << ::std::format("recv ack:  {}", this->m_inbox.getStats().toString())
+            << ::std::format("frame buffers: {} acquired, {} heap allocation(s)",
+                             UDPFramePool::getAcquireCount() - m_frame_acquire_mark,
+                             UDPFramePool::getAllocCount() - m_frame_alloc_mark)
+            << ::std::format("wakeups: {} wait(s), {} on timer", this->m_wait_count - m_wait_mark, this->m_wait_timeout_count - m_wait_timeout_mark)
+            << ::std::format("rtt: {}", m_rto.toString())
+            << ::std::format("cc:  {}, {} fast retransmit(s)", m_cc->toString(), m_fast_retransmits)
+            << ::std::format("path MTU: {}", this->m_pmtu.toString())
+            << ::std::format("Merkle root: {}", Sha256::toHex(m_merkle_root))
+            << ::std::format("compression: {}", m_compression_stats.raw_bytes > 0 ? m_compression_stats.toString() : "off")
+            << ::std::format("goodput: {} byte(s) in {:.3f} s, {:.2f} MB/s",
+                             this->m_metrics.getLastBytes(), this->m_metrics.getLastMicros() / 1e6, this->m_metrics.getLastGoodput() / 1e6);
     }
 } // namespace my
 
@@ -0,0 +1,80 @@
+#ifndef _BLOCK_COMPRESSOR_H_
+#define _BLOCK_COMPRESSOR_H_
+
+#include <future>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./BlockRanges.h"
+#include "./UDPFileReader.h"
+
+namespace my
+{
+    // 发送端的压缩阶段：按块独立压缩，每块仍对应一个数据帧，接收端、续传与 Merkle 校验都按原始块处理
+    // 连续的若干块组成一段，由工作线程在发送窗口之前并行压缩，发送时直接取用结果
+    // 每段先试压第一块，压缩率不足时整段按原样发送，不可压缩的数据几乎不消耗 CPU
+    class BlockCompressor
+    {
+    public:
+        // 一段的目标字节数
+        static constexpr int CHUNK_SIZE = 1 << 18;
+        // 压缩后不超过原长的 15/16 才值得
+        static constexpr int MIN_SAVING_SHIFT = 4;
+
+        struct Stats {
+            long long raw_bytes = 0;
+            long long wire_bytes = 0;
+            long long compressed_blocks = 0;
+            long long bypassed_blocks = 0;
+
+            ::std::string toString() const;
+        };
+
+        // 自己映射文件并选出与发送端相同的块，retain_blocks 为可能重传的最远距离，更早的段可以释放
+        BlockCompressor(::std::string_view filename, int block_size, BlockRanges ranges, int retain_blocks, int thread_count = 0);
+        ~BlockCompressor();
+        BlockCompressor(const BlockCompressor &) = delete;
+        BlockCompressor &operator=(const BlockCompressor &) = delete;
+
+        // 文件无法映射（如空文件）时不压缩
+        bool isEnabled() const noexcept { return m_reader.isMapped(); }
+        // 返回 true 时 payload 指向压缩后的块，在块号超出 retain_blocks 之前保持有效；返回 false 时按原样发送
+        bool getBlock(int block_num, const char *&payload, int &size);
+        const Stats &getStats() const noexcept { return m_stats; }
+
+    private:
+        // 一段的压缩结果，sizes[i] 为 0 表示该块按原样发送
+        struct Chunk {
+            ::std::vector<char> data;
+            ::std::vector<int> offsets;
+            ::std::vector<int> sizes;
+            long long raw_bytes = 0;
+            long long wire_bytes = 0;
+        };
+        struct Slot {
+            ::std::future<Chunk> future;
+            Chunk chunk;
+            bool ready = false;
+        };
+
+        UDPFileReader m_reader;
+        int m_block_count;
+        int m_chunk_blocks;
+        int m_chunk_count;
+        int m_retain_blocks;
+        int m_lookahead;
+        int m_max_block = -1;
+        ::std::map<int, Slot> m_slots;
+        // 已计入统计的段
+        ::std::vector<bool> m_counted;
+        Stats m_stats;
+
+        Chunk encode(int chunk);
+        void schedule(int chunk);
+        Chunk &acquire(int chunk);
+    };
+} // namespace my
+
+#endif // _BLOCK_COMPRESSOR_H_
\ No newline at end of file
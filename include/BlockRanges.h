@@ -0,0 +1,49 @@
+#ifndef _BLOCK_RANGES_H_
+#define _BLOCK_RANGES_H_
+
+#include <climits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace my
+{
+    // 升序且互不相交的若干块区间，区间内的块按顺序依次编号为传输序号
+    // 断点续传时只传输缺失的块，收发双方按同一列表把传输序号映射为文件块号
+    // 默认为 [0, END)，即整个文件，序号与块号相同
+    class BlockRanges
+    {
+    public:
+        // 区间末端为文件末尾，接收端事先不知道文件有多少块
+        static constexpr int END = INT_MAX;
+        // 文本形式的默认长度上限，连同其他参数须放进一个命令帧
+        static constexpr int MAX_TEXT_SIZE = 512;
+
+        BlockRanges() = default;
+
+        bool isAll() const noexcept;
+        // 追加区间 [begin, end)，须在已有区间之后
+        void add(int begin, int end);
+        // 截到文件的块数，返回截断后的总块数
+        int clip(int block_count);
+        // 传输序号对应的块号，超出所有区间时返回 -1
+        int map(int position) const noexcept;
+
+        // 形如 "0-9,12,20-"，闭区间，末尾的 "-" 表示到文件末尾
+        // 超出 max_size 时合并间隔最小的相邻区间，代价是重传少量已收到的块
+        ::std::string toString(int max_size = MAX_TEXT_SIZE) const;
+        static bool parse(::std::string_view text, BlockRanges &ranges);
+
+    private:
+        // 与没有缺失的块区分：一个区间都没有时不传输任何数据块
+        bool m_all = true;
+        ::std::vector<::std::pair<int, int>> m_ranges;
+        // 每个区间之前的块数
+        ::std::vector<long long> m_offsets;
+
+        static ::std::string format(const ::std::vector<::std::pair<int, int>> &ranges);
+    };
+} // namespace my
+
+#endif // _BLOCK_RANGES_H_
\ No newline at end of file
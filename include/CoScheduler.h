@@ -0,0 +1,176 @@
+#ifndef _CO_SCHEDULER_H_
+#define _CO_SCHEDULER_H_
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./wsa_wapper.h"
+
+namespace my
+{
+    // 传输协程的返回类型，惰性启动
+    // 可以被调度器作为顶层任务运行，也可以在另一个协程中 co_await，子任务结束后直接回到等待者
+    class CoTask
+    {
+    public:
+        struct promise_type {
+            ::std::coroutine_handle<> continuation;
+            ::std::exception_ptr exception;
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+                ::std::coroutine_handle<> await_suspend(::std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    ::std::coroutine_handle<> continuation = handle.promise().continuation;
+                    return continuation ? continuation : ::std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+
+            CoTask get_return_object() noexcept { return CoTask(::std::coroutine_handle<promise_type>::from_promise(*this)); }
+            ::std::suspend_always initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() noexcept { exception = ::std::current_exception(); }
+        };
+        using Handle = ::std::coroutine_handle<promise_type>;
+
+        CoTask() = default;
+        explicit CoTask(Handle handle) noexcept : m_handle(handle) {}
+        ~CoTask()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+        CoTask(CoTask &&other) noexcept : m_handle(::std::exchange(other.m_handle, {})) {}
+        CoTask &operator=(CoTask &&other) noexcept
+        {
+            if (this != &other) {
+                if (m_handle) {
+                    m_handle.destroy();
+                }
+                m_handle = ::std::exchange(other.m_handle, {});
+            }
+            return *this;
+        }
+        CoTask(const CoTask &) = delete;
+        CoTask &operator=(const CoTask &) = delete;
+
+        bool done() const noexcept { return !m_handle || m_handle.done(); }
+        Handle getHandle() const noexcept { return m_handle; }
+        ::std::exception_ptr getException() const noexcept { return m_handle ? m_handle.promise().exception : nullptr; }
+
+        bool await_ready() const noexcept { return done(); }
+        ::std::coroutine_handle<> await_suspend(::std::coroutine_handle<> awaiting) noexcept
+        {
+            m_handle.promise().continuation = awaiting;
+            return m_handle;
+        }
+        void await_resume() const
+        {
+            if (::std::exception_ptr exception = getException()) {
+                ::std::rethrow_exception(exception);
+            }
+        }
+
+    private:
+        Handle m_handle;
+    };
+
+    // 单线程协程调度器
+    // 协程在等待 socket 可读或截止时刻时挂起，调度器用一次 epoll_wait() 同时等待所有 socket 与最近的截止时刻
+    // 一个线程即可驱动大量并发传输，每个传输使用各自的 socket
+    class CoScheduler
+    {
+    public:
+        using Clock = ::std::chrono::steady_clock;
+        using TimePoint = Clock::time_point;
+
+        // 一次等待的凭据，等待结束后失效，对失效凭据的 signal() 不起作用
+        struct WaitToken {
+            int index = -1;
+            unsigned generation = 0;
+        };
+
+        CoScheduler();
+        ~CoScheduler();
+        CoScheduler(const CoScheduler &) = delete;
+        CoScheduler &operator=(const CoScheduler &) = delete;
+
+        // 接管一个顶层任务，在 run() 中开始执行
+        void spawn(CoTask task);
+        // 运行到所有任务结束，返回以异常结束的任务数，异常信息输出到日志
+        int run();
+
+        // 在当前线程上运行单个任务直到结束，任务中的异常会重新抛出
+        static void runSync(CoTask task);
+        // 当前线程上正在运行的调度器，不在调度器中时为 nullptr
+        static CoScheduler *current() noexcept;
+
+        // 挂起 handle 直到 socket 可读或到达 deadline，恢复前把是否可读写入 *readable
+        void waitReadable(SOCKET socket, TimePoint deadline, ::std::coroutine_handle<> handle, bool *readable);
+        // 挂起 handle 直到被 signal() 唤醒或到达 deadline，恢复前把是否被唤醒写入 *signaled
+        WaitToken waitSignal(TimePoint deadline, ::std::coroutine_handle<> handle, bool *signaled);
+        void signal(WaitToken token);
+        // 可在任意线程调用，唤醒调度器线程后由它 signal(token)，用于后台线程通知计算完成
+        void post(WaitToken token);
+
+        int getTaskCount() const noexcept { return (int)m_tasks.size(); }
+
+    private:
+        struct Waiter {
+            ::std::coroutine_handle<> handle;
+            SOCKET socket = INVALID_SOCKET;
+            TimePoint deadline;
+            bool *readable = nullptr;
+            unsigned generation = 0;
+            bool active = false;
+        };
+        using DeadlineEntry = ::std::pair<TimePoint, ::std::pair<int, unsigned>>;
+
+        ::std::vector<CoTask> m_tasks;
+        ::std::deque<::std::coroutine_handle<>> m_ready;
+        ::std::vector<Waiter> m_waiters;
+        ::std::vector<int> m_free_waiters;
+        int m_active_waiters = 0;
+        // 每个 socket 上等待的协程，键存在即表示该 socket 已注册
+        ::std::unordered_map<SOCKET, ::std::vector<int>> m_socket_waiters;
+        ::std::priority_queue<DeadlineEntry, ::std::vector<DeadlineEntry>, ::std::greater<>> m_deadlines;
+
+        // 其他线程 post() 的凭据
+        ::std::mutex m_posted_mutex;
+        ::std::vector<WaitToken> m_posted;
+
+#ifdef __linux__
+        int m_epoll_fd = -1;
+        int m_timer_fd = -1;
+        int m_event_fd = -1;
+        TimePoint m_timer_deadline = TimePoint::max();
+
+        void armTimer(TimePoint deadline);
+#else
+        // 没有 eventfd 时向绑定在环回地址上的 socket 发一个字节唤醒 select()
+        SOCKET m_wakeup_socket = INVALID_SOCKET;
+        sockaddr_in m_wakeup_addr{};
+#endif
+
+        int addWaiter(SOCKET socket, TimePoint deadline, ::std::coroutine_handle<> handle, bool *readable);
+        void wake(int index, bool readable);
+        void takePosted();
+        TimePoint nextDeadline();
+        void poll();
+        void drainReady();
+        void waitEvents();
+        int reapFinished();
+    };
+} // namespace my
+
+#endif // _CO_SCHEDULER_H_
\ No newline at end of file
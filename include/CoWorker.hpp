@@ -0,0 +1,120 @@
+#ifndef _CO_WORKER_HPP_
+#define _CO_WORKER_HPP_
+
+#include <coroutine>
+#include <exception>
+#include <format>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "./CoScheduler.h"
+#include "./pretty_log.hpp"
+
+namespace my
+{
+    // 在后台线程执行一段耗时的计算（整文件哈希、生成与应用差量等），协程 co_await 取结果
+    // 等待期间调度器照常运行同一线程上的其他协程，计算结束时经 CoScheduler::post() 唤醒等待者
+    template <class T>
+    class CoWorker
+    {
+    public:
+        CoWorker() = default;
+        template <class Function>
+        explicit CoWorker(Function &&function) : m_state(::std::make_shared<State>())
+        {
+            m_future = ::std::async(::std::launch::async, [state = m_state, function = ::std::forward<Function>(function)]() mutable {
+                ::std::optional<T> result;
+                ::std::exception_ptr exception;
+                try {
+                    result.emplace(function());
+                } catch (...) {
+                    exception = ::std::current_exception();
+                }
+                ::std::lock_guard<::std::mutex> lock(state->mutex);
+                state->result = ::std::move(result);
+                state->exception = exception;
+                state->done = true;
+                if (state->scheduler) {
+                    state->scheduler->post(state->token);
+                }
+            });
+        }
+        // 等到计算结束
+        ~CoWorker() { detach(); }
+        CoWorker(CoWorker &&) noexcept = default;
+        CoWorker &operator=(CoWorker &&other) noexcept
+        {
+            if (this != &other) {
+                detach();
+                m_state = ::std::move(other.m_state);
+                m_future = ::std::move(other.m_future);
+            }
+            return *this;
+        }
+        CoWorker(const CoWorker &) = delete;
+        CoWorker &operator=(const CoWorker &) = delete;
+
+        // 已启动且结果尚未取走
+        bool valid() const noexcept { return m_state != nullptr; }
+
+        bool await_ready() const
+        {
+            ::std::lock_guard<::std::mutex> lock(m_state->mutex);
+            return m_state->done;
+        }
+        bool await_suspend(::std::coroutine_handle<> handle)
+        {
+            CoScheduler *scheduler = CoScheduler::current();
+            if (scheduler == nullptr) {
+                pretty_out << ::std::format("throw from CoWorker::await_suspend(): Not running in a CoScheduler");
+                throw std::runtime_error("Not running in a CoScheduler");
+            }
+            ::std::lock_guard<::std::mutex> lock(m_state->mutex);
+            if (m_state->done) {
+                return false;
+            }
+            m_state->scheduler = scheduler;
+            m_state->token = scheduler->waitSignal(CoScheduler::TimePoint::max(), handle, &m_state->signaled);
+            return true;
+        }
+        // 取走结果，计算抛出的异常在此重新抛出
+        T await_resume()
+        {
+            m_future.wait();
+            ::std::shared_ptr<State> state = ::std::exchange(m_state, nullptr);
+            if (state->exception) {
+                ::std::rethrow_exception(state->exception);
+            }
+            return ::std::move(*state->result);
+        }
+
+    private:
+        struct State {
+            ::std::mutex mutex;
+            bool done = false;
+            ::std::optional<T> result;
+            ::std::exception_ptr exception;
+            CoScheduler *scheduler = nullptr;
+            CoScheduler::WaitToken token;
+            bool signaled = false;
+        };
+
+        ::std::shared_ptr<State> m_state;
+        ::std::future<void> m_future;
+
+        // 等待者已不在，计算结束时不再唤醒
+        void detach() noexcept
+        {
+            if (m_state) {
+                ::std::lock_guard<::std::mutex> lock(m_state->mutex);
+                m_state->scheduler = nullptr;
+            }
+        }
+    };
+} // namespace my
+
+#endif // _CO_WORKER_HPP_
\ No newline at end of file
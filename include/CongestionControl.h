@@ -0,0 +1,94 @@
+#ifndef _CONGESTION_CONTROL_H_
+#define _CONGESTION_CONTROL_H_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace my
+{
+    // 拥塞控制算法接口，窗口以数据帧为单位
+    // 发送端实际使用的窗口为 min(senderWindowSize, getWindow())
+    class CongestionController
+    {
+    public:
+        static constexpr double INITIAL_WINDOW = 4.0;
+        static constexpr double MIN_WINDOW = 1.0;
+
+        virtual ~CongestionController() = default;
+
+        virtual ::std::string_view getName() const noexcept = 0;
+        virtual void reset() noexcept;
+        // acked_count: 本次新确认的数据帧数；rtt: 本次取得的 RTT 样本（微秒），无样本时为 -1
+        virtual void onAck(int acked_count, long long rtt) noexcept = 0;
+        // 重传定时器超时
+        virtual void onTimeout() noexcept;
+        // 未等到超时就发现了丢包（如快速重传），in_flight 为当时在途的数据帧数
+        virtual void onLoss(int in_flight) noexcept;
+
+        // 窗口受发送端上限约束时不再增长，避免 cwnd 虚高
+        void setWindowLimit(double limit) noexcept
+        {
+            m_max_cwnd = limit;
+            m_cwnd = ::std::min(m_cwnd, m_max_cwnd);
+        }
+
+        int getWindow() const noexcept { return (int)m_cwnd; }
+        double getCwnd() const noexcept { return m_cwnd; }
+        double getSsthresh() const noexcept { return m_ssthresh; }
+        long long getLossCount() const noexcept { return m_loss_count; }
+        virtual ::std::string toString() const;
+
+    protected:
+        double m_cwnd = INITIAL_WINDOW;
+        double m_ssthresh = 1e9;
+        double m_max_cwnd = 1e9;
+        long long m_loss_count = 0;
+    };
+
+    // 不做拥塞控制，窗口恒为上限
+    class FixedWindowController : public CongestionController
+    {
+    public:
+        ::std::string_view getName() const noexcept override { return "none"; }
+        void reset() noexcept override;
+        void onAck(int, long long) noexcept override {}
+        void onTimeout() noexcept override { ++m_loss_count; }
+        void onLoss(int) noexcept override { ++m_loss_count; }
+        ::std::string toString() const override;
+    };
+
+    // RFC 5681: 慢启动 + 拥塞避免（AIMD）
+    class RenoController : public CongestionController
+    {
+    public:
+        ::std::string_view getName() const noexcept override { return "reno"; }
+        void onAck(int acked_count, long long rtt) noexcept override;
+    };
+
+    // 基于时延的 Vegas 式算法：比较期望吞吐与实际吞吐，
+    // 在瓶颈队列开始积压时就减小窗口，而不是等到丢包
+    class DelayController : public CongestionController
+    {
+    public:
+        // 每个 RTT 允许在瓶颈队列中积压的数据帧数
+        static constexpr double ALPHA = 2.0;
+        static constexpr double BETA = 4.0;
+
+        ::std::string_view getName() const noexcept override { return "delay"; }
+        void reset() noexcept override;
+        void onAck(int acked_count, long long rtt) noexcept override;
+        ::std::string toString() const override;
+
+    private:
+        long long m_base_rtt = -1;
+        long long m_round_min_rtt = -1;
+        double m_round_acked = 0;
+    };
+
+    // 按名称创建拥塞控制算法：none / reno / delay，名称无效时返回空指针
+    ::std::unique_ptr<CongestionController> makeCongestionController(::std::string_view name);
+} // namespace my
+
+#endif // _CONGESTION_CONTROL_H_
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace my
+{
+    // CRC32C（Castagnoli 多项式，iSCSI/ext4 所用）
+    // x86-64 上 CPU 支持 SSE4.2 时用 crc32 指令，AArch64 上用 CRC 扩展，否则按 8 字节查表
+    // 实现在首次调用前按 CPU 选定，crc 为前一段的返回值，可分段计算
+    ::std::uint32_t crc32c(const void *data, ::std::size_t size, ::std::uint32_t crc = 0) noexcept;
+
+    // 当前选用的实现，用于日志
+    const char *crc32cImplementation() noexcept;
+} // namespace my
+
+#endif // _CRC32C_H_
\ No newline at end of file
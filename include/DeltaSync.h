@@ -0,0 +1,72 @@
+#ifndef _DELTA_SYNC_H_
+#define _DELTA_SYNC_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace my
+{
+    // rsync 算法的差量传输
+    // 接收方按块给出已有文件的签名（可滚动的弱校验和 + 截短的 SHA-256），发送方在自己的文件上逐字节滚动弱校验和，
+    // 弱校验和命中后再比对强哈希，命中的块只发送块引用，其余作为字面数据发送
+    // 差量文件: "RDTD"[uint32 block_size]，之后为若干记录
+    //           'C'[uint32 block][uint32 count]: 复制已有文件从 block 起的 count 块
+    //           'L'[uint32 size][数据]: 字面数据
+    class DeltaSync
+    {
+    public:
+        static constexpr int STRONG_SIZE = 16;
+        // 单条字面记录的上限
+        static constexpr int MAX_LITERAL_SIZE = 1 << 20;
+
+        // 只为整块计算签名，末尾不足一块的部分总是作为字面数据发送
+        struct Signature {
+            ::std::uint32_t weak;
+            ::std::array<unsigned char, STRONG_SIZE> strong;
+        };
+
+        struct Stats {
+            long long file_size = 0;
+            long long literal_bytes = 0;
+            long long copied_blocks = 0;
+            long long delta_size = 0;
+
+            ::std::string toString() const;
+        };
+
+        // rsync 的弱校验和：a 为字节和，b 为按位置加权的和，各取低 16 位
+        class RollingChecksum
+        {
+        public:
+            void reset(const unsigned char *data, int size) noexcept;
+            // 窗口右移一个字节
+            void roll(unsigned char out, unsigned char in) noexcept
+            {
+                m_a += in - out;
+                m_b += m_a - (::std::uint32_t)m_size * out;
+            }
+            ::std::uint32_t value() const noexcept { return (m_a & 0xFFFF) | (m_b << 16); }
+
+        private:
+            ::std::uint32_t m_a = 0;
+            ::std::uint32_t m_b = 0;
+            int m_size = 0;
+        };
+
+        // 签名文件: "RDTS"[uint32 block_size]，之后每块 [uint32 weak][strong]
+        static void makeSignatures(::std::string_view filename, int block_size, ::std::string_view signature_path);
+        static ::std::vector<Signature> loadSignatures(::std::string_view signature_path, int &block_size);
+
+        static Stats makeDelta(::std::string_view filename, const ::std::vector<Signature> &signatures, int block_size, ::std::string_view delta_path);
+        // base 为已有文件，结果写入 output，不修改 base
+        static void applyDelta(::std::string_view base, ::std::string_view delta_path, ::std::string_view output);
+
+    private:
+        static ::std::array<unsigned char, STRONG_SIZE> strongHash(const void *data, int size) noexcept;
+    };
+} // namespace my
+
+#endif // _DELTA_SYNC_H_
\ No newline at end of file
@@ -3,7 +3,7 @@
 
 #include "./pretty_log.hpp"
 #include <format>
-#include <winsock2.h>
+#include "./wsa_wapper.h"
 
 namespace my
 {
@@ -61,7 +61,7 @@ namespace my
                 pretty_out << "throw from Host::updateAddr(): m_socket is INVALID_SOCKET";
                 throw std::runtime_error("m_socket is INVALID_SOCKET");
             }
-            int len = sizeof(m_address);
+            socklen_t len = sizeof(m_address);
             if (getsockname(m_socket, reinterpret_cast<sockaddr *>(&m_address), &len) == SOCKET_ERROR) {
                 pretty_out << ::std::format("throw from Host::updateAddr(): getsockname() failed, WSAGetLastError() = {0}", WSAGetLastError());
                 throw std::runtime_error("getsockname() failed");
@@ -19,7 +19,7 @@ namespace my
         GBN_Sender(const GBN_Sender &) = delete;
         GBN_Sender &operator=(const GBN_Sender &) = delete;
 
-        virtual void sendtoPeer(::std::string_view filename) override;
+        virtual CoTask co_sendtoPeer(::std::string filename) override;
 
     private:
         Timer m_timer;
@@ -37,7 +37,17 @@ namespace my
         GBN_Receiver(const GBN_Receiver &) = delete;
         GBN_Receiver &operator=(const GBN_Receiver &) = delete;
 
-        virtual void recvfromPeer(::std::string_view file_path) override;
+        virtual CoTask co_recvfromPeer(::std::string file_path) override;
+
+    protected:
+        // 同一确认号最多立即重复确认的次数
+        static constexpr int MAX_DUP_ACKS = 3;
+
+        virtual void queueCurrentAck() override;
+
+    private:
+        // 表示已接收到的最大数据帧序号
+        int m_base = -1;
     };
 
     template <int senderWindowSize, int seqNumBound>
@@ -46,127 +56,209 @@ namespace my
                             public GBN_Receiver<seqNumBound>
     {
     public:
-        GBN_Transceiver() = default;
-        GBN_Transceiver(SOCKET host_socket) : BasicRole(host_socket) {};
+        // 两端使用同一实例，对端的发送窗口即本端的
+        GBN_Transceiver() { this->setPeerWindow(senderWindowSize); }
+        GBN_Transceiver(SOCKET host_socket) : BasicRole(host_socket) { this->setPeerWindow(senderWindowSize); }
         virtual ~GBN_Transceiver() = default;
     };
 
     template <int senderWindowSize, int seqNumBound>
         requires(senderWindowSize <= seqNumBound - 1 && senderWindowSize > 0)
-    void my::GBN_Sender<senderWindowSize, seqNumBound>::sendtoPeer(::std::string_view filename)
+    CoTask my::GBN_Sender<senderWindowSize, seqNumBound>::co_sendtoPeer(::std::string filename)
     {
-        UDPFileReader reader(filename);
+        UDPFileReader reader(filename, UDPFileReader::Mode::MAPPED, this->m_block_size);
+        this->openForSend(reader, filename);
 
         int base = 0;
         int next_num = 0;
-        int ack_num = -1;
         const int block_count = reader.getBlockCount();
-        constexpr int N = senderWindowSize;
         constexpr int M = seqNumBound;
 
+        // 连续收到的对 base - 1 的重复确认数
+        int dup_acks = 0;
+
         m_timer.stop();
+        this->resetSendStats();
 
+        auto now = ::std::chrono::steady_clock::now();
         while (base <= block_count) {
             // 发送数据帧
-            while (next_num < base + N && next_num <= block_count) {
-                pretty_log << ::std::format("Send data frame {}({}/{})", next_num % M, next_num, block_count);
-                this->sendUDPDataframeToPeer(reader, next_num);
+            // 在途数据帧数受拥塞窗口限制
+            while (next_num < base + this->getEffectiveWindow() && next_num <= block_count) {
+                PRETTY_TRACE(pretty_log, "Send data frame {}({}/{})", next_num % M, next_num, block_count);
+                if (next_num == block_count) {
+                    co_await this->co_prepareFin(reader);
+                }
+                this->queueUDPDataframeToPeer(reader, next_num);
+                this->markSent(next_num, now, false);
 
                 // 如果是窗口第一个数据帧，启动定时器
                 if (base == next_num) {
-                    m_timer.setTimeout(this->m_timeout);
+                    m_timer.setTimeout(this->m_rto.getRto());
                 }
                 ++next_num;
             }
+            // 整个窗口一次发出
+            this->flushToPeer();
 
             // 接收确认帧
-            while ((ack_num = this->recvAckFromPeer()) != -1) {
+            bool resend_window = false;
+            // 挂起到确认帧到达或定时器到期
+            co_await this->coWaitFrames(m_timer.getDeadline());
+            const ::std::vector<int> &ack_nums = this->takeAcksFromPeer();
+            now = ::std::chrono::steady_clock::now();
+            // 长时间传输中按期重新探测路径 MTU，结果用于之后的传输
+            this->pollPathMtu(now);
+            for (int ack_num : ack_nums) {
                 int actual_ack_num = getActualForwardBlockNum(base, ack_num, M);
 
-                if (actual_ack_num >= base + N || actual_ack_num > block_count) {
-                    // 确认号超出窗口范围，丢弃
+                if (actual_ack_num >= next_num) {
+                    int actual_backward_ack_num = getActualBackwardBlockNum(base, ack_num, M);
+                    if (actual_backward_ack_num == base - 1 && base < next_num) {
+                        // 对 base - 1 的重复确认，说明 base 丢失而后续帧仍在到达
+                        PRETTY_TRACE(pretty_log, "Receive duplicate ack frame {}({}/{})", ack_num, actual_backward_ack_num, block_count);
+                        this->m_metrics.add(TransferMetrics::Counter::DUPLICATE_ACKS);
+
+                        // 同一次丢包只快速重传一次
+                        if (++dup_acks == this->m_dup_ack_threshold && this->isSentAfterLoss(base)) {
+                            PRETTY_DEBUG(pretty_log, "{} duplicate acks, fast retransmit from {}", dup_acks, base);
+                            this->onDupAckLoss(next_num - base, now);
+                            resend_window = true;
+                        }
+                        continue;
+                    }
+
+                    // 确认号超出已发送的范围，丢弃
                     // 用于处理pkt0没有收到，但是pkt1已经收到的情况
                     // 这时对方会发送一个超出窗口范围的ack
-                    pretty_log << ::std::format("Receive ack frame {}({}/{}), ignored", ack_num, getActualBackwardBlockNum(base, ack_num, M), block_count);
+                    PRETTY_TRACE(pretty_log, "Receive ack frame {}({}/{}), ignored", ack_num, actual_backward_ack_num, block_count);
                     continue;
                 }
 
-                pretty_log << ::std::format("Receive ack frame {}({}/{})", ack_num, actual_ack_num, block_count);
+                PRETTY_TRACE(pretty_log, "Receive ack frame {}({}/{})", ack_num, actual_ack_num, block_count);
 
-                // 累计确认
+                // 累计确认，以被确认的最后一个数据帧取样
+                this->m_cc->onAck(actual_ack_num - base + 1, this->sampleRtt(actual_ack_num, now));
                 base = actual_ack_num + 1;
+                dup_acks = 0;
 
                 if (base == next_num) {
                     // 如果窗口已空，停止定时器
                     m_timer.stop();
                 } else {
                     // 否则重置定时器
-                    m_timer.setTimeout(this->m_timeout);
+                    m_timer.setTimeout(this->m_rto.getRto());
                 }
             }
 
             // 超时重传
             if (m_timer.isTimeout()) {
-                pretty_log << "Timeout, resend all data frames";
+                PRETTY_DEBUG(pretty_log, "Timeout, resend all data frames");
+                this->m_metrics.add(TransferMetrics::Counter::TIMEOUTS);
+                this->onTimeoutLoss(now);
+                resend_window = true;
+            }
 
+            // 快速重传与超时重传都从 base 重发整个窗口
+            if (resend_window && base < next_num) {
                 // 重传窗口内的所有数据帧
                 for (int i = base; i < next_num; i++) {
-                    pretty_log_con << ::std::format("Resend data frame {}({}/{})", i % M, i, block_count);
+                    PRETTY_TRACE(pretty_log_con, "Resend data frame {}({}/{})", i % M, i, block_count);
 
-                    this->sendUDPDataframeToPeer(reader, i);
+                    this->queueUDPDataframeToPeer(reader, i);
+                    this->markSent(i, now, true);
                 }
-                m_timer.setTimeout(this->m_timeout);
+                this->flushToPeer();
+                m_timer.setTimeout(this->m_rto.getRto());
             }
         }
+
+        this->m_inbox.discardStale();
+        this->closeForSend(reader);
+        this->logSendStats();
     }
 
     template <int seqNumBound>
         requires(seqNumBound >= 2)
-    void my::GBN_Receiver<seqNumBound>::recvfromPeer(::std::string_view file_path)
+    CoTask my::GBN_Receiver<seqNumBound>::co_recvfromPeer(::std::string file_path)
     {
-        UDPFileWriter writer(file_path);
+        UDPFileWriter writer = this->openForRecv(file_path, UDPFileWriter::Mode::APPEND);
 
-        // 表示已接收到的最大数据帧序号
         // 设为-1以处理第0个数据帧没有收到的情况
         // 这时对方会发送一个超出窗口范围的ack
-        int base = -1;
+        m_base = -1;
         constexpr int M = seqNumBound;
 
         bool receive_end = false;
+        int dup_acks = 0;
+        this->resetRecvStats();
+
         // 阻塞接收数据帧
         while (!receive_end) {
-            UDPDataframe dataframe = this->recvUDPDataframeFromPeer();
+            UDPDataframe dataframe;
+            while (!this->takeUDPDataframeFromPeer(dataframe)) {
+                this->pollPathMtu(::std::chrono::steady_clock::now());
+                co_await this->coWaitFrames(::std::min(this->flushDueAcks(), this->m_pmtu.getRoundDeadline()));
+            }
 
             int data_num = dataframe.getDataNum();
-            int length;
-            dataframe.data(length);
-
-            int actual_forward_block_num = getActualForwardBlockNum(base, data_num, M);
+            int actual_forward_block_num = getActualForwardBlockNum(m_base, data_num, M);
 
-            if (base + 1 == actual_forward_block_num) {
+            if (m_base + 1 == actual_forward_block_num) {
                 // 期望的数据帧，顺序接收
-                pretty_log << ::std::format("Receive data frame {}({})", data_num, actual_forward_block_num);
+                PRETTY_TRACE(pretty_log, "Receive data frame {}({})", data_num, actual_forward_block_num);
 
-                if (length == 0) {
-                    // 空的结束帧
-                    pretty_log << "End frame";
+                if (dataframe.isFin()) {
+                    // 结束帧带有整个文件的 Merkle 根
+                    PRETTY_TRACE(pretty_log, "End frame");
                     receive_end = true;
+                    this->takeFinPayload(dataframe);
 
                     // 不考虑最后一个ack丢失的情况
                     this->disableReceiverLoss();
                 } else {
-                    writer.append(dataframe);
+                    this->writeBlock(writer, m_base + 1, dataframe);
                 }
-                base++;
+                m_base++;
+                dup_acks = 0;
+
+                // 按确认策略延迟确认，结束帧立即确认
+                this->scheduleAck(receive_end);
             } else {
                 // 乱序到达则丢弃
-                pretty_log << ::std::format("Receive data frame {}({}), discard", data_num, actual_forward_block_num);
-            }
+                PRETTY_TRACE(pretty_log, "Receive data frame {}({}), discard", data_num, actual_forward_block_num);
+                // 离已收到的帧比离期望的帧更近，视为重复到达
+                if (m_base - getActualBackwardBlockNum(m_base + 1, data_num, M) < actual_forward_block_num - m_base) {
+                    this->m_metrics.add(TransferMetrics::Counter::DUPLICATE_FRAMES);
+                }
 
-            // 发送确认帧
-            pretty_log_con << ::std::format("Send ack frame {}({})", (base + M) % M, base);
-            this->sendAckToPeer(base % M);
+                // 出现空洞时立即发送重复确认，超过次数后按确认策略合并
+                if (dup_acks < MAX_DUP_ACKS) {
+                    ++dup_acks;
+                    this->scheduleAck(true);
+                    this->sendPendingAck();
+                } else {
+                    this->scheduleAck(false);
+                }
+            }
         }
+
+        // 先落盘再等待对端结束
+        this->closeForRecv(writer);
+        co_await this->co_lingerForPeer();
+        co_await this->co_verifyReceivedFile(file_path);
+        this->logRecvStats();
+    }
+
+    // 累计确认，base 为 -1 时确认号回绕为 M - 1
+    template <int seqNumBound>
+        requires(seqNumBound >= 2)
+    void GBN_Receiver<seqNumBound>::queueCurrentAck()
+    {
+        constexpr int M = seqNumBound;
+        int ack_num = (m_base % M + M) % M;
+        PRETTY_TRACE(pretty_log_con, "Send ack frame {}({})", ack_num, m_base);
+        this->queueAckToPeer(ack_num);
     }
 
 } // namespace my
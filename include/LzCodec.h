@@ -0,0 +1,17 @@
+#ifndef _LZ_CODEC_H_
+#define _LZ_CODEC_H_
+
+namespace my
+{
+    // LZ77 系的快速块压缩，沿用 LZ4 块格式的序列编码：
+    // 若干序列 [token][字面长度扩展][字面数据][uint16 LE 偏移][匹配长度扩展]，token 高 4 位为字面长度，低 4 位为匹配长度 - 4
+    // 长度为 15 时后跟若干字节累加，字节为 255 时继续；最后一个序列只有字面数据
+    // 每块独立压缩，不依赖其他块，最大块长 64 KB，偏移总能用 16 位表示
+
+    // 压缩后长度超过 capacity 时放弃，返回 0，调用方按原样发送
+    int lzCompress(const char *src, int size, char *dst, int capacity) noexcept;
+    // 数据不合法或解压后超过 capacity 时返回 -1
+    int lzDecompress(const char *src, int size, char *dst, int capacity) noexcept;
+} // namespace my
+
+#endif // _LZ_CODEC_H_
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef _MERKLE_TREE_H_
+#define _MERKLE_TREE_H_
+
+#include <string_view>
+#include <vector>
+
+#include "./Sha256.h"
+
+namespace my
+{
+    // 文件按传输的块大小分块，每块的 SHA-256 为叶子，两两向上合并到根
+    // 叶子为 SHA-256(0x00 || 块)，内部结点为 SHA-256(0x01 || 左 || 右)，落单的结点原样上移
+    // 收发双方块大小一致时根相同即文件相同，根不同时逐层比较子树即可找出不一致的块
+    class MerkleTree
+    {
+    public:
+        using Digest = Sha256::Digest;
+        static constexpr int DIGEST_SIZE = Sha256::DIGEST_SIZE;
+        // 每个线程至少分到这么多块，小文件不值得开线程
+        static constexpr int MIN_BLOCKS_PER_THREAD = 64;
+
+        MerkleTree();
+        explicit MerkleTree(::std::vector<Digest> leaves);
+
+        // 映射文件后多线程并行计算叶子，thread_count 为 0 时按硬件线程数
+        static MerkleTree fromFile(::std::string_view filename, int block_size, int thread_count = 0);
+        // 叶子依次存放的文件，与 saveLeaves() 对应
+        static MerkleTree loadLeaves(::std::string_view filename);
+        void saveLeaves(::std::string_view filename) const;
+
+        const Digest &getRoot() const noexcept { return m_levels.back().front(); }
+        int getLeafCount() const noexcept { return m_leaf_count; }
+        const ::std::vector<Digest> &getLeaves() const noexcept { return m_levels.front(); }
+
+        // 与另一棵树不一致的块号，升序，叶子数不同时多出的块都算不一致
+        ::std::vector<int> diff(const MerkleTree &other) const;
+
+    private:
+        // 第 0 层为叶子，最后一层只有根，没有叶子时根为空串的哈希
+        ::std::vector<::std::vector<Digest>> m_levels;
+        int m_leaf_count = 0;
+
+        void build();
+        void diffSubtree(const MerkleTree &other, int level, int index, ::std::vector<int> &blocks) const;
+    };
+} // namespace my
+
+#endif // _MERKLE_TREE_H_
\ No newline at end of file
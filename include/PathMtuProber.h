@@ -0,0 +1,91 @@
+#ifndef _PATH_MTU_PROBER_H_
+#define _PATH_MTU_PROBER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "./UDPDataframe.h"
+
+namespace my
+{
+    // 分组层路径 MTU 探测（RFC 8899 DPLPMTUD）的搜索状态，不做收发
+    // 大小均指 UDP 载荷字节数，置 DF 位发出的探测帧被对端确认即说明路径能不分片地承载
+    // 每轮并行探测一组大小，确认的最大值成为新的下界，未确认的最小值成为新的上界
+    class PathMtuProber
+    {
+    public:
+        using Clock = ::std::chrono::steady_clock;
+        using TimePoint = Clock::time_point;
+
+        // IPv4 头与 UDP 头
+        static constexpr int IP_UDP_OVERHEAD = 28;
+        // 协议一直使用的默认帧长，无需探测即可使用
+        static constexpr int BASE_SIZE = UDPDataframe::DEFAULT_SIZE;
+        static constexpr int MAX_SIZE = UDPDataframe::MAX_SIZE;
+        static constexpr int PROBES_PER_ROUND = 8;
+        // 上下界相差不到此值时结束搜索
+        static constexpr int SEARCH_GRANULARITY = 16;
+        static constexpr int MAX_ROUNDS = 8;
+        // 一轮内一个确认都没有时的等待上限
+        static constexpr int ROUND_TIMEOUT_MS = 1000;
+        // 收到首个确认后，其余探测帧再等 2 倍 RTT，至少这么久
+        static constexpr int MIN_ROUND_WAIT_MS = 20;
+        // 搜索完成后隔多久重新探测，既尝试调大也确认当前值仍然可用
+        static constexpr int REPROBE_INTERVAL_MS = 30000;
+
+        void setEnabled(bool enabled) noexcept { m_enabled = enabled; }
+        bool isEnabled() const noexcept { return m_enabled; }
+
+        // 从 BASE_SIZE 开始重新搜索，之前的结果作废
+        void restart() noexcept;
+        bool isSearching() const noexcept { return m_searching; }
+        bool hasResult() const noexcept { return m_has_result; }
+        bool isRoundPending() const noexcept { return m_round_pending; }
+        bool isReprobeDue(TimePoint now) const noexcept { return m_enabled && !m_searching && (!m_has_result || now >= m_next_reprobe); }
+
+        // 开始新的一轮，返回本轮要探测的大小
+        // 不在搜索中时开始一次重新探测，同时确认当前值
+        const ::std::vector<int> &startRound(TimePoint now);
+        void onAck(int size, TimePoint now) noexcept;
+        // 本机发送时即因超过接口 MTU 被拒绝
+        void onTooBig(int size) noexcept;
+        bool isRoundDone(TimePoint now) const noexcept;
+        void finishRound(TimePoint now) noexcept;
+        // 本轮的截止时刻，没有进行中的轮次时为 TimePoint::max()
+        TimePoint getRoundDeadline() const noexcept { return m_round_pending ? m_round_deadline : TimePoint::max(); }
+
+        int getPayloadSize() const noexcept { return m_confirmed; }
+        int getPlpmtu() const noexcept { return m_confirmed + IP_UDP_OVERHEAD; }
+        int getBlockSize() const noexcept { return m_confirmed - UDPDataframe::HEADER_SIZE; }
+        ::std::string toString() const;
+
+    private:
+        bool m_enabled = false;
+        bool m_searching = false;
+        bool m_has_result = false;
+        bool m_round_pending = false;
+        // 重新探测的轮次须确认当前值，否则视为黑洞退回 BASE_SIZE
+        bool m_verifying = false;
+        int m_verify_size = BASE_SIZE;
+        // 本次搜索中是否收到过确认，首轮全无确认说明对端不应答探测
+        bool m_any_acked = false;
+
+        int m_confirmed = BASE_SIZE;
+        int m_upper = MAX_SIZE;
+        int m_round = 0;
+        TimePoint m_round_start;
+        TimePoint m_round_deadline;
+        TimePoint m_next_reprobe;
+
+        ::std::vector<int> m_candidates;
+        ::std::vector<bool> m_acked;
+
+        long long m_search_count = 0;
+        long long m_probe_count = 0;
+        long long m_ack_count = 0;
+        long long m_black_hole_count = 0;
+    };
+} // namespace my
+
+#endif // _PATH_MTU_PROBER_H_
\ No newline at end of file
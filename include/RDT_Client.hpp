@@ -2,10 +2,12 @@
 #define _RDT_CLIENT_HPP_
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <sstream>
 #include <vector>
 
+#include "./DeltaSync.h"
 #include "./GBN_Protocol.hpp"
 #include "./SR_Protocol.hpp"
 #include "./StopWait_Protocol.hpp"
@@ -26,20 +28,35 @@ namespace my
 
     protected:
         void sendCmdToPeer(::std::string_view cmd);
+        ::std::string blockSizeOption() const;
+        void applyAutoBlockSize();
+        bool takeCmdReply(::std::string &reply);
+        bool takeResumeReply();
         void disableLoss();
         void enableLoss();
 
     private:
         ::std::string m_prompt = ">>> ";
         ::std::filesystem::path m_repo = "../client_repo/";
+        // 块大小取自路径 MTU 探测结果
+        bool m_auto_block_size = false;
+        // 列出不一致的块时最多显示的块号数
+        static constexpr int MAX_SHOWN_BLOCKS = 16;
+        // 差量发完后等待服务端合成结果的时长，其中包括对端接收结束后的静默期与整个文件的哈希
+        static constexpr int PATCH_REPLY_WAIT_MS = 60000;
 
         int handle_user_input();
         int exec_cmd(::std::string_view cmd);
         void help();
         bool handle_ls(::std::vector<::std::string> &file_list, ::std::vector<::std::string> &file_size_list);
         bool handle_lss(::std::vector<::std::string> &file_list, ::std::vector<::std::string> &file_size_list);
-        void handle_upload();
-        void handle_download();
+        void handle_upload(bool delta, bool compress);
+        bool uploadDelta(::std::string_view filename, bool compress);
+        void handle_download(bool compress);
+        void handle_hashes();
+        bool fetchPeerTree(::std::string_view filename, MerkleTree &tree);
+        void showBlockDiff(const MerkleTree &local, const MerkleTree &remote);
+        void handle_stats();
 
         int get_num_input();
         void show_file_list(const ::std::vector<::std::string> &file_list, const ::std::vector<::std::string> &file_size_list);
@@ -61,32 +78,12 @@ namespace my
             init_wsa();
         }
 
-        SOCKET host_socket = socket(AF_INET, SOCK_DGRAM, 0);
-        if (host_socket == INVALID_SOCKET) {
-            ::my::pretty_err << ::std::format("Create socket failed. Error code: {}", WSAGetLastError());
-            throw ::std::runtime_error("Create socket failed");
-        }
-
-        SOCKADDR_IN host_addr;
-        host_addr.sin_family = AF_INET;
-        host_addr.sin_port = htons(0); // 0代表系统自动分配端口
-        host_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-
-        if (bind(host_socket, reinterpret_cast<SOCKADDR *>(&host_addr), sizeof(host_addr)) == SOCKET_ERROR) {
-            ::my::pretty_err << ::std::format("Bind socket failed. Error code: {}", WSAGetLastError());
-            throw ::std::runtime_error("Bind socket failed");
-        }
-
-        this->m_host.setSocket(host_socket);
+        // 0代表系统自动分配端口
+        this->m_host.setSocket(create_udp_socket(0));
         this->m_host.updateAddr();
 
         this->setPeer("127.0.0.1", 12345);
 
-        // https://stackoverflow.com/questions/34242622/windows-udp-sockets-recvfrom-fails-with-error-10054
-        BOOL bNewBehavior = FALSE;
-        DWORD dwBytesReturned = 0;
-        WSAIoctl(host_socket, _WSAIOW(IOC_VENDOR, 12), &bNewBehavior, sizeof bNewBehavior, nullptr, 0, &dwBytesReturned, nullptr, nullptr);
-
         if (!::std::filesystem::exists(m_repo)) {
             ::std::filesystem::create_directory(m_repo);
         }
@@ -129,6 +126,57 @@ namespace my
         sendCmdTo(cmd, this->m_host, this->m_peer);
     }
 
+    // 非默认块大小随请求告知服务端，默认时保持原有的命令格式
+    template <class Transceiver>
+    inline ::std::string RDT_Client<Transceiver>::blockSizeOption() const
+    {
+        if (this->getBlockSize() == UDPDataframe::DEFAULT_DATA_SIZE) {
+            return "";
+        }
+        return ::std::format("-bs {} ", this->getBlockSize());
+    }
+
+    // 取出服务端代替确认回复的命令帧，recvAckFromPeer() 遇到命令帧时留在缓冲中
+    template <class Transceiver>
+    bool RDT_Client<Transceiver>::takeCmdReply(::std::string &reply)
+    {
+        if (this->m_inbox.isEmpty() || !this->m_inbox.front().isCmd() || this->m_inbox.frontPeer() != this->m_peer) {
+            return false;
+        }
+        reply = this->m_inbox.front().cmd();
+        this->m_inbox.pop();
+        return true;
+    }
+
+    // 服务端以 "resume <ranges>" 命令帧代替确认时，之后只发送其中的块
+    template <class Transceiver>
+    bool RDT_Client<Transceiver>::takeResumeReply()
+    {
+        ::std::string reply;
+        if (!takeCmdReply(reply)) {
+            return false;
+        }
+        BlockRanges ranges;
+        if (!reply.starts_with("resume ") || !BlockRanges::parse(::std::string_view(reply).substr(7), ranges)) {
+            pretty_err << ::std::format("Unexpected reply from server: \"{}\"", reply);
+            return false;
+        }
+        pretty_log << ::std::format("Server has part of the file, resume with blocks {}", reply.substr(7));
+        this->setSendRanges(::std::move(ranges));
+        return true;
+    }
+
+    // 每次请求前确认路径 MTU，探测结果在重新探测间隔内复用
+    template <class Transceiver>
+    void RDT_Client<Transceiver>::applyAutoBlockSize()
+    {
+        if (!m_auto_block_size) {
+            return;
+        }
+        this->probePathMtu();
+        this->setBlockSize(this->getPathMtu().getBlockSize());
+    }
+
     template <class Transceiver>
     void RDT_Client<Transceiver>::disableLoss()
     {
@@ -162,9 +210,17 @@ namespace my
         // 这里忽略了路径中有空格的情况
         // 处理起来比较麻烦，暂时不考虑 (正确方式为在输入路径时加引号)
 
-        if (token == "upload" || token == "download" || token == "lss") {
+        if (token == "upload" || token == "download" || token == "lss" || token == "hashes") {
+            // 选项会覆盖 token，先记下命令名
+            ::std::string command = token;
+            bool delta = false;
+            bool compress = false;
             while (iss >> token) {
-                if (token == "-ip") {
+                if (token == "-delta" && command == "upload") {
+                    delta = true;
+                } else if (token == "-z" && (command == "upload" || command == "download")) {
+                    compress = true;
+                } else if (token == "-ip") {
                     iss >> token;
                     try {
                         this->setPeerIp(token);
@@ -181,11 +237,13 @@ namespace my
                 }
             }
 
-            if (token == "upload") {
-                this->handle_upload();
-            } else if (token == "download") {
-                this->handle_download();
-            } else if (token == "lss") {
+            if (command == "upload") {
+                this->handle_upload(delta, compress);
+            } else if (command == "download") {
+                this->handle_download(compress);
+            } else if (command == "hashes") {
+                this->handle_hashes();
+            } else if (command == "lss") {
                 ::std::vector<::std::string> file_list;
                 ::std::vector<::std::string> file_size_list;
                 this->handle_lss(file_list, file_size_list);
@@ -218,6 +276,22 @@ namespace my
             handle_ls(file_list, file_size_list);
         } else if (token == "help") {
             help();
+        } else if (token == "stats") {
+            bool reset = false;
+            while (iss >> token) {
+                if (token == "-reset") {
+                    reset = true;
+                } else {
+                    pretty_err << ::std::format("Unknown option \"{}\". Use \"help\" to get help", token);
+                    return 0;
+                }
+            }
+
+            handle_stats();
+            if (reset) {
+                this->resetMetrics();
+                pretty_log << "Transfer statistics reset";
+            }
         } else if (token == "loss") {
             bool is_set = false;
 
@@ -276,6 +350,99 @@ namespace my
                        << ::std::format("(ra) client_recv_ack_loss    {:.2f}", this->getRecvAckLoss())
                        << ::std::format("(rd) client_recv_data_loss   {:.2f}", this->getRecvLoss());
 
+        } else if (token == "cc") {
+            bool is_set = false;
+            while (iss >> token) {
+                if (token == "-set") {
+                    iss >> token;
+                    if (!this->setCongestionControl(token)) {
+                        pretty_err << ::std::format("Unknown congestion control \"{}\"", token);
+                        return 0;
+                    }
+                    is_set = true;
+                } else {
+                    pretty_err << ::std::format("Unknown option \"{}\". Use \"help\" to get help", token);
+                    return 0;
+                }
+            }
+
+            pretty_log << ::std::format("{}{}", is_set ? "Congestion control set to: " : "Congestion control: ", this->getCongestionController().getName());
+        } else if (token == "dupack") {
+            bool is_set = false;
+            while (iss >> token) {
+                if (token == "-set") {
+                    int threshold = -1;
+                    iss >> threshold;
+                    if (threshold < 0) {
+                        pretty_err << "Invalid duplicate ack threshold, should be >= 0";
+                        return 0;
+                    }
+                    this->setDupAckThreshold(threshold);
+                    is_set = true;
+                } else {
+                    pretty_err << ::std::format("Unknown option \"{}\". Use \"help\" to get help", token);
+                    return 0;
+                }
+            }
+
+            int threshold = this->getDupAckThreshold();
+            pretty_log << ::std::format("{}{}", is_set ? "Fast retransmit set to: " : "Fast retransmit: ",
+                                        threshold ? ::std::format("after {} duplicate ack(s)", threshold) : ::std::string("disabled"));
+        } else if (token == "ack") {
+            bool is_set = false;
+            while (iss >> token) {
+                if (token == "-set") {
+                    int every_frames = -1;
+                    int delay_us = -1;
+                    iss >> every_frames >> delay_us;
+                    if (every_frames < 1 || delay_us < 0) {
+                        pretty_err << "Invalid ack policy, should be <every_frames >= 1> <delay_us >= 0>";
+                        return 0;
+                    }
+                    this->setAckPolicy(every_frames, delay_us);
+                    is_set = true;
+                } else {
+                    pretty_err << ::std::format("Unknown option \"{}\". Use \"help\" to get help", token);
+                    return 0;
+                }
+            }
+
+            pretty_log << ::std::format("{}every {} frame(s) or {} us", is_set ? "Ack policy set to: " : "Ack policy: ", this->getAckEvery(), this->getAckDelay());
+        } else if (token == "bs") {
+            bool is_set = false;
+            while (iss >> token) {
+                if (token == "-set") {
+                    iss >> token;
+                    if (token == "auto") {
+                        m_auto_block_size = true;
+                        is_set = true;
+                        continue;
+                    }
+                    int block_size = -1;
+                    try {
+                        block_size = ::std::stoi(token);
+                    } catch (const ::std::exception &) {
+                    }
+                    if (block_size < 1 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+                        pretty_err << ::std::format("Invalid block size, should be \"auto\" or in [1, {}]", UDPDataframe::MAX_DATA_SIZE);
+                        return 0;
+                    }
+                    this->setBlockSize(block_size);
+                    m_auto_block_size = false;
+                    this->m_pmtu.setEnabled(false);
+                    is_set = true;
+                } else {
+                    pretty_err << ::std::format("Unknown option \"{}\". Use \"help\" to get help", token);
+                    return 0;
+                }
+            }
+
+            if (m_auto_block_size) {
+                pretty_log << ::std::format("{}auto, from path MTU probed before each request, currently {} byte(s) per data frame",
+                                            is_set ? "Block size set to: " : "Block size: ", this->getBlockSize());
+            } else {
+                pretty_log << ::std::format("{}{} byte(s) per data frame", is_set ? "Block size set to: " : "Block size: ", this->getBlockSize());
+            }
         } else if (token == "exit" || token == "quit") {
             return -1;
         } else {
@@ -290,12 +457,21 @@ namespace my
     {
         pretty_log
             << "Commands:\n"
-            << "  upload [-ip <ip>] [-port <port>] - Upload file to server, create or overwrite"
-            << "    Default ip:port is 127.0.0.1:12345\n"
-            << "  download [-ip <ip>] [-port <port>] - Download file from server"
-            << "    Default ip:port is 127.0.0.1:12345\n"
+            << "  upload [-delta] [-z] [-ip <ip>] [-port <port>] - Upload file to server, create or overwrite"
+            << "    Default ip:port is 127.0.0.1:12345"
+            << "    An interrupted upload of the same unchanged file resumes with the missing blocks"
+            << "    -delta sends only the changes against the server's copy (rsync-style), or the whole file when it has none"
+            << "    -z compresses each block, blocks that do not shrink are sent as is\n"
+            << "  download [-z] [-ip <ip>] [-port <port>] - Download file from server"
+            << "    Default ip:port is 127.0.0.1:12345"
+            << "    An interrupted download resumes into the partial file when the server's file is unchanged"
+            << "    -z asks the server to compress each block\n"
             << "  lss [-ip <ip>] [-port <port>] - List files in server repository"
             << "    Default ip:port is 127.0.0.1:12345\n"
+            << "  hashes [-ip <ip>] [-port <port>] - Compare a local file with the server's copy block by block"
+            << "    Lists the blocks that differ, using the current block size\n"
+            << "  stats [-reset] - Show transfer statistics of this client since start or the last reset"
+            << "    Frame counters, retransmit ratio, RTT histogram and goodput of uploads and downloads\n"
             << "  ls - List files in client repository\n"
             << "  repo [-set <dir_path>] - Show or set client repository\n"
             << "  loss [-set < <loss_name> <loss_rate> ...>] - Show or set loss rate"
@@ -303,6 +479,16 @@ namespace my
             << "    <loss_rate>: float, in [0, 1]"
             << "    e.g. loss -set sa 0.1 rd 0.2"
             << "         will set client_send_ack_loss to 0.1, client_recv_data_loss to 0.2\n"
+            << "  cc [-set <name>] - Show or set congestion control used for uploads"
+            << "    <name>: none - fixed window, reno - slow start and AIMD, delay - delay-based (Vegas-like)\n"
+            << "  dupack [-set <threshold>] - Show or set duplicate acks needed for GBN fast retransmit on uploads"
+            << "    0 disables fast retransmit\n"
+            << "  ack [-set <every_frames> <delay_us>] - Show or set ack policy used for downloads, ack every frame by default, e.g. -set 2 500 to delay and coalesce acks"
+            << "    Ack once every <every_frames> data frames, or <delay_us> microseconds after the first unacked one"
+            << "    Gaps and the end of stream are acked immediately\n"
+            << "  bs [-set <bytes>|auto] - Show or set payload bytes per data frame for uploads and downloads"
+            << ::std::format("    Default {}, up to {}; the server follows the value sent with each request", UDPDataframe::DEFAULT_DATA_SIZE, UDPDataframe::MAX_DATA_SIZE)
+            << "    auto: probe the path MTU to the server and use the largest frame that is not fragmented\n"
             << "  help - Show help message\n"
             << "  exit/quit - Exit client";
     }
@@ -311,7 +497,7 @@ namespace my
     inline bool RDT_Client<Transceiver>::handle_ls(::std::vector<::std::string> &file_list, ::std::vector<::std::string> &file_size_list)
     {
         for (const auto &entry : ::std::filesystem::directory_iterator(m_repo)) {
-            if (entry.is_regular_file()) {
+            if (entry.is_regular_file() && !TransferJournal::isJournal(entry.path().string())) {
                 file_list.push_back(entry.path().filename().string());
                 file_size_list.push_back(::std::to_string(entry.file_size()));
             }
@@ -367,7 +553,7 @@ namespace my
     }
 
     template <class Transceiver>
-    void RDT_Client<Transceiver>::handle_upload()
+    void RDT_Client<Transceiver>::handle_upload(bool delta, bool compress)
     {
         // 从本地获取文件列表
         // 选择要上传的文件
@@ -394,10 +580,20 @@ namespace my
         }
         pretty_log << ::std::format("The file will be uploaded to server {}, create or overwrite", this->m_peer.toString());
 
-        // 发送上传请求
-        this->sendCmdToPeer(::std::format("upload {}", file_list[file_num]));
+        if (delta) {
+            this->applyAutoBlockSize();
+            if (uploadDelta(file_list[file_num], compress)) {
+                return;
+            }
+            pretty_log << "Upload the whole file instead";
+        }
+
+        // 发送上传请求，附带本地文件的版本，服务端有中断时的日志则回复缺失的块
+        this->applyAutoBlockSize();
+        ::std::string local_path = m_repo.string() + file_list[file_num];
+        this->sendCmdToPeer(::std::format("upload {}-tag {} {}", blockSizeOption(), TransferJournal::fileTag(local_path), file_list[file_num]));
         int cnt = 0;
-        while (this->recvAckFromPeer() == -1) {
+        while (this->recvAckFromPeer() == -1 && !takeResumeReply()) {
             if (++cnt > 20) {
                 pretty_err << "Failed to upload file, timeout";
                 return;
@@ -405,15 +601,99 @@ namespace my
         }
 
         // 上传文件
+        this->setSendCompression(compress);
         enableLoss();
-        this->sendtoPeer(m_repo.string() + ::std::string(file_list[file_num]));
+        this->sendtoPeer(local_path);
         disableLoss();
 
         pretty_log << ::std::format("Upload file \"{}\" successfully to {}", file_list[file_num], this->m_peer.toString());
     }
 
+    // 服务端已有同名文件时，取回其签名生成差量，只上传差量，由服务端合成新文件并按 Merkle 根校验
+    // 服务端没有该文件（回复 "nofile"）或差量不比文件小时返回 false，由调用方上传整个文件
     template <class Transceiver>
-    void RDT_Client<Transceiver>::handle_download()
+    bool RDT_Client<Transceiver>::uploadDelta(::std::string_view filename, bool compress)
+    {
+        ::std::string local_path = m_repo.string() + ::std::string(filename);
+        pretty_log << ::std::format("Fetching signatures of \"{}\" from server {}...", filename, this->m_peer.toString());
+        this->sendCmdToPeer(::std::format("signatures {}{}", blockSizeOption(), filename));
+        int cnt = 0;
+        ::std::string reply;
+        while (this->recvAckFromPeer() == -1) {
+            if (takeCmdReply(reply)) {
+                if (reply == "nofile") {
+                    pretty_log << ::std::format("Server has no copy of \"{}\"", filename);
+                } else {
+                    pretty_err << ::std::format("Unexpected reply from server: \"{}\"", reply);
+                }
+                return false;
+            }
+            if (++cnt > 20) {
+                pretty_err << "Failed to fetch signatures, timeout";
+                return false;
+            }
+        }
+
+        ::std::filesystem::path signature_path = ::std::filesystem::temp_directory_path() / "rdt_client_signatures.bin";
+        this->recvfromPeer(signature_path.string());
+        if (this->getLastVerify() == Transceiver::Verify::MISMATCH) {
+            pretty_err << "Signatures from server are corrupted";
+            ::std::filesystem::remove(signature_path);
+            return false;
+        }
+        int block_size;
+        ::std::vector<DeltaSync::Signature> signatures = DeltaSync::loadSignatures(signature_path.string(), block_size);
+        ::std::filesystem::remove(signature_path);
+
+        ::std::filesystem::path delta_path = ::std::filesystem::temp_directory_path() / "rdt_client_delta.bin";
+        DeltaSync::Stats stats = DeltaSync::makeDelta(local_path, signatures, block_size, delta_path.string());
+        pretty_log << ::std::format("Delta of \"{}\": {}", filename, stats.toString());
+        if (stats.delta_size >= stats.file_size) {
+            ::std::filesystem::remove(delta_path);
+            return false;
+        }
+
+        ::std::string root = Sha256::toHex(MerkleTree::fromFile(local_path, this->getBlockSize()).getRoot());
+        this->sendCmdToPeer(::std::format("patch {}-root {} {}", blockSizeOption(), root, filename));
+        cnt = 0;
+        while (this->recvAckFromPeer() == -1) {
+            if (takeCmdReply(reply)) {
+                pretty_err << ::std::format("Server refused the delta: \"{}\"", reply);
+                ::std::filesystem::remove(delta_path);
+                return false;
+            }
+            if (++cnt > 20) {
+                pretty_err << "Failed to upload delta, timeout";
+                ::std::filesystem::remove(delta_path);
+                return false;
+            }
+        }
+
+        this->setSendCompression(compress);
+        enableLoss();
+        this->sendtoPeer(delta_path.string());
+        disableLoss();
+        ::std::filesystem::remove(delta_path);
+
+        // 服务端合成并校验后回复结果，其间到达的确认帧都是过期的
+        auto deadline = ::std::chrono::steady_clock::now() + ::std::chrono::milliseconds(PATCH_REPLY_WAIT_MS);
+        while (!takeCmdReply(reply)) {
+            if (::std::chrono::steady_clock::now() >= deadline) {
+                pretty_err << ::std::format("Failed to upload delta of \"{}\", no reply from server", filename);
+                return false;
+            }
+            this->recvAckFromPeer();
+        }
+        if (reply != "patched") {
+            pretty_err << ::std::format("Failed to upload delta of \"{}\", server replied \"{}\"", filename, reply);
+            return false;
+        }
+        pretty_log << ::std::format("Upload delta of \"{}\" successfully to {}, the server patched its copy", filename, this->m_peer.toString());
+        return true;
+    }
+
+    template <class Transceiver>
+    void RDT_Client<Transceiver>::handle_download(bool compress)
     {
         // 先从服务器获取文件信息列表
         // 然后选择要下载的文件
@@ -445,35 +725,185 @@ namespace my
         ::std::string file_ext = file_fullname.substr(dot_pos);
         ::std::string file_name = file_fullname.substr(0, dot_pos);
 
+        // 留有日志的同名文件是上次中断的下载，在其上续传
         ::std::filesystem::path file_path;
+        bool resume = false;
         for (int i = 0;; ++i) {
             file_path = m_repo / (i == 0 ? file_fullname : ::std::format("{}({}){}", file_fullname, i, file_ext));
             if (!::std::filesystem::exists(file_path)) {
                 break;
             }
+            if (this->m_journal.load(file_path.string())) {
+                resume = true;
+                break;
+            }
         }
         pretty_log << ::std::format("The file will be saved to: \"{}\"", file_path.string());
 
-        // 发送下载请求
-        this->sendCmdToPeer(::std::format("download {}", file_fullname));
+        // 发送下载请求，续传时带上次记下的文件版本与缺失的块，块大小沿用中断时的
+        ::std::string resume_option;
+        ::std::string missing;
+        if (resume) {
+            this->setBlockSize(this->m_journal.getBlockSize());
+            missing = this->m_journal.getMissing().toString();
+            resume_option = ::std::format("-resume {}:{} ", this->m_journal.getTag(), missing);
+            pretty_log << ::std::format("Found an interrupted download, {} block(s) already received", this->m_journal.getReceivedCount());
+        } else {
+            this->applyAutoBlockSize();
+        }
+        this->sendCmdToPeer(::std::format("download {}{}{}{}", blockSizeOption(), compress ? "-z " : "", resume_option, file_fullname));
         int cnt = 0;
-        while (this->recvAckFromPeer() == -1) {
+        int tag;
+        while ((tag = this->recvAckFromPeer()) == -1) {
             if (++cnt > 20) {
                 pretty_err << "Failed to download file, timeout";
                 return;
             }
         }
 
+        // 确认号为服务端文件的版本，与日志一致才续传，否则从头下载
+        if (resume && (::std::uint32_t)tag == this->m_journal.getTag()) {
+            BlockRanges::parse(missing, this->m_recv_ranges);
+        } else {
+            if (resume) {
+                pretty_log << "The file on server has changed, download from the beginning";
+                ::std::filesystem::remove(file_path);
+            }
+            this->m_journal.create(file_path.string(), (::std::uint32_t)tag, this->getBlockSize());
+        }
+
         // 接收文件
         enableLoss();
         this->recvfromPeer(file_path.string());
         disableLoss();
 
+        // 整个文件校验不通过时向服务端取每块的哈希，找出需要重新获取的块
+        if (this->getLastVerify() == Transceiver::Verify::MISMATCH) {
+            pretty_err << ::std::format("Downloaded file \"{}\" does not match the server's copy", file_fullname);
+            MerkleTree local = this->getLastTree();
+            MerkleTree remote;
+            if (fetchPeerTree(file_fullname, remote)) {
+                showBlockDiff(local, remote);
+            }
+            return;
+        }
+
         pretty_log
             << ::std::format("Download file \"{}\" successfully from {}", file_fullname, this->m_peer.toString())
             << ::std::format("Saved to: \"{}\"", file_path.string());
     }
 
+    template <class Transceiver>
+    void RDT_Client<Transceiver>::handle_hashes()
+    {
+        pretty_log << "Fetching local file list...";
+        ::std::vector<::std::string> file_list;
+        ::std::vector<::std::string> file_size_list;
+        if (!handle_ls(file_list, file_size_list)) {
+            return;
+        }
+
+        pretty_log << "Choose a file to compare with the server's copy (input the number):";
+        int file_num;
+        while (true) {
+            file_num = get_num_input();
+            if (file_num >= 0 && file_num < file_list.size()) {
+                break;
+            } else {
+                pretty_err << "File number out of range, please input again";
+            }
+        }
+
+        this->applyAutoBlockSize();
+        MerkleTree local = MerkleTree::fromFile(m_repo.string() + file_list[file_num], this->getBlockSize());
+        MerkleTree remote;
+        if (fetchPeerTree(file_list[file_num], remote)) {
+            showBlockDiff(local, remote);
+        }
+    }
+
+    // 服务端把叶子作为文件发来，先存入临时文件再读出
+    template <class Transceiver>
+    bool RDT_Client<Transceiver>::fetchPeerTree(::std::string_view filename, MerkleTree &tree)
+    {
+        pretty_log << ::std::format("Fetching block hashes of \"{}\" from server {}...", filename, this->m_peer.toString());
+        this->sendCmdToPeer(::std::format("hashes {}{}", blockSizeOption(), filename));
+        int cnt = 0;
+        while (this->recvAckFromPeer() == -1) {
+            if (++cnt > 20) {
+                pretty_err << "Failed to fetch block hashes, timeout or file not found on server";
+                return false;
+            }
+        }
+
+        ::std::filesystem::path leaves_path = ::std::filesystem::temp_directory_path() / "rdt_client_hashes.bin";
+        this->recvfromPeer(leaves_path.string());
+        bool ok = this->getLastVerify() != Transceiver::Verify::MISMATCH;
+        if (ok) {
+            tree = MerkleTree::loadLeaves(leaves_path.string());
+        } else {
+            pretty_err << "Block hashes from server are corrupted";
+        }
+        ::std::filesystem::remove(leaves_path);
+        return ok;
+    }
+
+    template <class Transceiver>
+    void RDT_Client<Transceiver>::showBlockDiff(const MerkleTree &local, const MerkleTree &remote)
+    {
+        ::std::vector<int> blocks = local.diff(remote);
+        if (blocks.empty()) {
+            pretty_log << ::std::format("All {} block(s) match, root {}", local.getLeafCount(), Sha256::toHex(local.getRoot()));
+            return;
+        }
+
+        ::std::string shown;
+        for (int i = 0; i < (int)blocks.size() && i < MAX_SHOWN_BLOCKS; ++i) {
+            shown += (i ? ", " : "") + ::std::to_string(blocks[i]);
+        }
+        if ((int)blocks.size() > MAX_SHOWN_BLOCKS) {
+            shown += ", ...";
+        }
+        pretty_log
+            << ::std::format("{} block(s) differ (local {} block(s), server {} block(s), {} bytes each) and need to be re-fetched:",
+                             blocks.size(), local.getLeafCount(), remote.getLeafCount(), this->getBlockSize())
+            << shown;
+    }
+
+    // 计数跨多次传输累计，goodput 另给出最近一次传输的
+    template <class Transceiver>
+    void RDT_Client<Transceiver>::handle_stats()
+    {
+        using Counter = TransferMetrics::Counter;
+        const TransferMetrics &metrics = this->getMetrics();
+        auto bound = [](long long us) { return us < 0 ? ::std::string("> max") : ::std::format("<= {} us", us); };
+
+        pretty_wapper log = pretty_log << "Transfer statistics:";
+        log << ::std::format("transfers: {}", metrics.toString())
+            << ::std::format("last transfer: {} byte(s) in {:.3f} s, goodput {:.2f} MB/s",
+                             metrics.getLastBytes(), metrics.getLastMicros() / 1e6, metrics.getLastGoodput() / 1e6)
+            << ::std::format("send: {} data frame(s), {} retransmitted ({:.2f}%), {} ack(s) received, {} duplicate, {} timeout(s), {} fast retransmit(s)",
+                             metrics.get(Counter::FRAMES_SENT), metrics.get(Counter::FRAMES_RETRANSMITTED), metrics.getRetransmitRatio() * 100,
+                             metrics.get(Counter::ACKS_RECEIVED), metrics.get(Counter::DUPLICATE_ACKS), metrics.get(Counter::TIMEOUTS),
+                             metrics.get(Counter::FAST_RETRANSMITS))
+            << ::std::format("recv: {} data frame(s), {} duplicate, {} corrupted, {} ack(s) sent",
+                             metrics.get(Counter::FRAMES_RECEIVED), metrics.get(Counter::DUPLICATE_FRAMES),
+                             metrics.get(Counter::CORRUPTED_FRAMES), metrics.get(Counter::ACKS_SENT))
+            << ::std::format("simulated loss: {} frame(s)", metrics.get(Counter::SIMULATED_LOSSES));
+        if (metrics.getRttCount() == 0) {
+            log << "rtt: no sample";
+            return;
+        }
+        log << ::std::format("rtt: {} sample(s), mean {:.3f} ms, p50 {}, p90 {}, p99 {}",
+                             metrics.getRttCount(), (double)metrics.getRttSum() / metrics.getRttCount() / 1000,
+                             bound(metrics.getRttQuantile(0.5)), bound(metrics.getRttQuantile(0.9)), bound(metrics.getRttQuantile(0.99)));
+        for (int bucket = 0; bucket < TransferMetrics::RTT_BUCKET_COUNT; ++bucket) {
+            if (metrics.getRttBucket(bucket) > 0) {
+                log << ::std::format("  {:<12}{}", bound(TransferMetrics::getRttBound(bucket)), metrics.getRttBucket(bucket));
+            }
+        }
+    }
+
     template <class Transceiver>
     inline int RDT_Client<Transceiver>::get_num_input()
     {
@@ -1,143 +1,274 @@
 #ifndef _RDT_SERVER_HPP_
 #define _RDT_SERVER_HPP_
 
+#include <atomic>
+#include <charconv>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "./CoWorker.hpp"
+#include "./DeltaSync.h"
 #include "./GBN_Protocol.hpp"
 #include "./SR_Protocol.hpp"
 #include "./StopWait_Protocol.hpp"
+#include "./UDPDemux.h"
 #include "./wsa_wapper.h"
 
 namespace my
 {
-    // 要求：Transceiver有sendUDPDataframeToPeer、recvUDPDataframeFromPeer、sendAckToPeer、recvAckFromPeer
-    // 并且多继承自BasicRole
+    // 一个客户端对应的会话，拥有独立的协议状态，与其他会话共用服务端的 socket
+    // 要求：Transceiver有co_sendtoPeer、co_recvfromPeer、sendAckToPeer，并且多继承自BasicRole
     template <class Transceiver>
-    class RDT_Server : protected Transceiver
+    class RDT_Session : protected Transceiver
     {
     public:
-        RDT_Server();
-        virtual ~RDT_Server();
+        // 空闲超过该时长的会话被回收，客户端之后的命令会开启新会话
+        static constexpr int IDLE_TIMEOUT_MS = 30000;
 
-        void run();
+        using MetricsReporter = ::std::function<void(const TransferMetrics &)>;
+
+        RDT_Session(const Host &host, const Peer &peer, UDPDemux &demux, const ::std::filesystem::path &repo, MetricsReporter report_metrics);
+        virtual ~RDT_Session() = default;
+
+        // 逐条执行命令，空闲超时后结束，每条命令结束后上报并清空本会话的传输指标
+        CoTask co_serve();
 
     protected:
-        ::std::string recvCmdFromPeer();
+        bool takeCmdFromPeer(::std::string &cmd);
+        bool takeBlockSizeOption(::std::string &args);
+        // 取走 " -<name> <value>" 形式的选项，没有时返回 false
+        bool takeOption(::std::string &args, ::std::string_view name, ::std::string &value);
+        // 取走 " -<name>" 形式的开关，没有时返回 false
+        bool takeFlag(::std::string &args, ::std::string_view name);
         void disableLoss();
         void enableLoss();
 
     private:
         ::std::string m_prompt = ">>> ";
-        ::std::filesystem::path m_repo = "../server_repo/";
+        ::std::filesystem::path m_repo;
+        MetricsReporter m_report_metrics;
 
-        int exec_cmd(::std::string_view cmd);
+        CoTask co_exec_cmd(::std::string cmd);
         void handle_ls();
-        void handle_download(::std::string_view filename);
-        void handle_upload(::std::string_view filename);
+        CoTask co_handle_download(::std::string filename, ::std::string resume);
+        CoTask co_handle_upload(::std::string filename, ::std::string tag);
+        CoTask co_handle_hashes(::std::string filename);
+        CoTask co_handle_signatures(::std::string filename);
+        CoTask co_handle_patch(::std::string filename, ::std::string root);
     };
 
-    template <int seqNumBound>
-    using StopWait_Server = RDT_Server<StopWait_Transceiver<seqNumBound>>;
+    // 服务端的一个分片：独立的 socket、分发协程、调度器与会话表，由一个线程驱动
+    // 分发协程按来源地址把帧投递给各会话，分片内的所有会话在同一线程上交替运行
+    template <class Transceiver>
+    class RDT_ServerShard
+    {
+    public:
+        using MetricsReporter = typename RDT_Session<Transceiver>::MetricsReporter;
 
-    template <int senderWindowSize, int seqNumBound>
-    using GBN_Server = RDT_Server<GBN_Transceiver<senderWindowSize, seqNumBound>>;
+        RDT_ServerShard(int index, SOCKET host_socket, const ::std::filesystem::path &repo, ::std::function<void()> on_session_closed, MetricsReporter report_metrics);
+        virtual ~RDT_ServerShard();
 
-    template <int windowSize, int seqNumBound>
-    using SR_Server = RDT_Server<SR_Transceiver<windowSize, seqNumBound>>;
+        void run();
+
+        int getIndex() const noexcept { return m_index; }
+        const Host &getHost() const noexcept { return m_host; }
+        // 以下统计在会话开启与关闭时更新，可在其他线程读取
+        long long getSessionsOpened() const noexcept { return m_sessions_opened; }
+        int getSessionsActive() const noexcept { return m_sessions_active; }
+        long long getFramesReceived() const noexcept { return m_frames_received; }
+        long long getFramesDropped() const noexcept { return m_frames_dropped; }
+
+    private:
+        using Session = RDT_Session<Transceiver>;
+
+        int m_index;
+        Host m_host;
+        UDPDemux m_demux;
+        CoScheduler m_scheduler;
+        ::std::unordered_map<unsigned long long, ::std::unique_ptr<Session>> m_sessions;
+        ::std::filesystem::path m_repo;
+        ::std::function<void()> m_on_session_closed;
+        MetricsReporter m_report_metrics;
+
+        ::std::atomic<long long> m_sessions_opened = 0;
+        ::std::atomic<int> m_sessions_active = 0;
+        ::std::atomic<long long> m_frames_received = 0;
+        ::std::atomic<long long> m_frames_dropped = 0;
+
+        bool acceptPeer(const Peer &peer);
+        CoTask co_runSession(unsigned long long key, Peer peer);
+        void updateStats();
+    };
 
+    // 在同一端口上并发服务多个客户端
+    // 分片数大于 1 时每个分片各开一个 SO_REUSEPORT socket，内核按四元组哈希把客户端固定分到某个分片
+    // 各分片的线程绑定到不同的核，协议状态互不共享
+    // 各会话的传输指标在每条命令结束后合并，连同分片统计以 Prometheus 文本格式写到 metrics_path
     template <class Transceiver>
-    RDT_Server<Transceiver>::RDT_Server()
+    class RDT_Server
     {
-        if (!wsa_initialized) {
-            init_wsa();
-        }
+    public:
+        // shard_count 不大于 0 时取硬件线程数
+        explicit RDT_Server(int shard_count = 1, ::std::filesystem::path metrics_path = "./server_metrics.prom");
+        virtual ~RDT_Server();
 
-        SOCKET host_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (host_socket == INVALID_SOCKET) {
-            ::my::pretty_err << ::std::format("Create socket failed. Error code: {}", WSAGetLastError());
-            throw ::std::runtime_error("Create socket failed");
-        }
+        void run();
+        void logShardStats() const;
+        // 先写到临时文件再改名，读取方不会看到写了一半的文件
+        void writeMetrics() const;
 
-        SOCKADDR_IN host_addr;
-        host_addr.sin_family = AF_INET;
-        host_addr.sin_port = htons(12345);
-        host_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    private:
+        using Shard = RDT_ServerShard<Transceiver>;
 
-        if (bind(host_socket, reinterpret_cast<SOCKADDR *>(&host_addr), sizeof(host_addr)) == SOCKET_ERROR) {
-            ::my::pretty_err << ::std::format("Bind socket failed. Error code: {}", WSAGetLastError());
-            throw ::std::runtime_error("Bind socket failed");
-        }
+        ::std::vector<::std::unique_ptr<Shard>> m_shards;
+        ::std::filesystem::path m_repo = "../server_repo/";
 
-        this->m_host.setSocket(host_socket);
-        this->m_host.updateAddr();
+        // 由各分片线程合并，写出时也持有锁，避免同时写临时文件
+        mutable ::std::mutex m_metrics_mutex;
+        TransferMetrics m_metrics;
+        ::std::filesystem::path m_metrics_path;
 
-        // https://stackoverflow.com/questions/34242622/windows-udp-sockets-recvfrom-fails-with-error-10054
-        BOOL bNewBehavior = FALSE;
-        DWORD dwBytesReturned = 0;
-        WSAIoctl(host_socket, _WSAIOW(IOC_VENDOR, 12), &bNewBehavior, sizeof bNewBehavior, nullptr, 0, &dwBytesReturned, nullptr, nullptr);
+        void mergeMetrics(const TransferMetrics &metrics);
+    };
 
-        if (!::std::filesystem::exists(m_repo)) {
-            ::std::filesystem::create_directory(m_repo);
-        }
+    template <int seqNumBound>
+    using StopWait_Server = RDT_Server<StopWait_Transceiver<seqNumBound>>;
 
-        pretty_log << "Server initialized" << ::std::format("Running on {}", this->m_host.toString());
+    template <int senderWindowSize, int seqNumBound>
+    using GBN_Server = RDT_Server<GBN_Transceiver<senderWindowSize, seqNumBound>>;
+
+    template <int windowSize, int seqNumBound>
+    using SR_Server = RDT_Server<SR_Transceiver<windowSize, seqNumBound>>;
+
+    template <class Transceiver>
+    RDT_Session<Transceiver>::RDT_Session(const Host &host, const Peer &peer, UDPDemux &demux, const ::std::filesystem::path &repo, MetricsReporter report_metrics)
+        : m_repo(repo), m_report_metrics(::std::move(report_metrics))
+    {
+        this->m_host = host;
+        this->setPeer(peer);
+        this->attachDemux(demux);
     }
 
     template <class Transceiver>
-    RDT_Server<Transceiver>::~RDT_Server()
+    CoTask RDT_Session<Transceiver>::co_serve()
     {
-        if (closesocket(this->m_host.getSocket()) == SOCKET_ERROR) {
-            ::my::pretty_err << ::std::format("Close socket failed. Error code: {}", WSAGetLastError());
-            return;
+        while (true) {
+            this->disableLoss();
+            ::std::string cmd;
+            while (!takeCmdFromPeer(cmd)) {
+                if (!co_await this->coWaitFrames(::std::chrono::steady_clock::now() + ::std::chrono::milliseconds(IDLE_TIMEOUT_MS))) {
+                    co_return;
+                }
+            }
+            pretty_out << ::std::format("[{}] {}{}", this->m_peer.toString(), m_prompt, cmd);
+            try {
+                co_await co_exec_cmd(::std::move(cmd));
+            } catch (const ::std::runtime_error &e) {
+                pretty_out << ::std::format("catch by RDT_Session::co_serve():") << e.what();
+            }
+            if (m_report_metrics) {
+                m_report_metrics(this->getMetrics());
+            }
+            this->resetMetrics();
         }
-        pretty_log << "Server closed";
+    }
 
-        if (wsa_initialized) {
-            cleanup_wsa();
+    // 上一次传输结束时可能已把命令帧收进了接收缓冲，其余残留帧丢弃
+    template <class Transceiver>
+    inline bool RDT_Session<Transceiver>::takeCmdFromPeer(::std::string &cmd)
+    {
+        while (!this->m_inbox.isEmpty()) {
+            UDPDataframe &frame = this->m_inbox.front();
+            if (frame.isCmd()) {
+                cmd = frame.cmd();
+                this->m_inbox.pop();
+                return true;
+            }
+            this->m_inbox.pop();
         }
+        return false;
     }
 
+    // 传输请求可带 " -bs <bytes>" 指定块大小，没有时用默认值，取走选项后 args 只剩 " <filename>"
+    // 块大小无效时不确认请求，客户端会超时放弃
     template <class Transceiver>
-    void RDT_Server<Transceiver>::run()
+    bool RDT_Session<Transceiver>::takeBlockSizeOption(::std::string &args)
     {
-        while (true) {
-            this->disableLoss();
+        int block_size = UDPDataframe::DEFAULT_DATA_SIZE;
+        if (args.starts_with(" -bs ")) {
+            ::std::size_t end = args.find(' ', 5);
             try {
-                ::std::string cmd = recvCmdFromPeer();
-                pretty_out << ::std::format("[{}] {}{}", this->m_peer.toString(), m_prompt, cmd);
-                exec_cmd(cmd);
-            } catch (const ::std::runtime_error &e) {
-                pretty_out << ::std::format("catch by RDT_Server::run():") << e.what();
+                block_size = ::std::stoi(args.substr(5, end - 5));
+            } catch (const ::std::exception &) {
+                block_size = -1;
+            }
+            if (end == ::std::string::npos || block_size < 1 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+                pretty_err << ::std::format("Invalid block size in request: \"{}\"", args);
+                return false;
             }
+            args.erase(0, end);
+        }
+        this->setBlockSize(block_size);
+        return true;
+    }
+
+    template <class Transceiver>
+    bool RDT_Session<Transceiver>::takeOption(::std::string &args, ::std::string_view name, ::std::string &value)
+    {
+        ::std::string prefix = ::std::format(" -{} ", name);
+        if (!args.starts_with(prefix)) {
+            return false;
+        }
+        ::std::size_t end = args.find(' ', prefix.size());
+        if (end == ::std::string::npos) {
+            return false;
         }
+        value = args.substr(prefix.size(), end - prefix.size());
+        args.erase(0, end);
+        return true;
     }
 
     template <class Transceiver>
-    inline ::std::string RDT_Server<Transceiver>::recvCmdFromPeer()
+    bool RDT_Session<Transceiver>::takeFlag(::std::string &args, ::std::string_view name)
     {
-        // 在接收命令时确定客户端地址
-        return recvCmdFrom(this->m_host, this->m_peer);
+        ::std::string prefix = ::std::format(" -{} ", name);
+        if (!args.starts_with(prefix)) {
+            return false;
+        }
+        args.erase(0, prefix.size() - 1);
+        return true;
     }
 
     template <class Transceiver>
-    inline void RDT_Server<Transceiver>::disableLoss()
+    inline void RDT_Session<Transceiver>::disableLoss()
     {
         this->disableReceiverLoss();
         this->disableSenderLoss();
     }
 
     template <class Transceiver>
-    inline void RDT_Server<Transceiver>::enableLoss()
+    inline void RDT_Session<Transceiver>::enableLoss()
     {
         this->enableReceiverLoss();
         this->enableSenderLoss();
     }
 
     template <class Transceiver>
-    inline int RDT_Server<Transceiver>::exec_cmd(::std::string_view cmd)
+    CoTask RDT_Session<Transceiver>::co_exec_cmd(::std::string cmd)
     {
-        ::std::istringstream iss(cmd.data());
+        ::std::istringstream iss(cmd);
         ::std::string token;
         iss >> token;
 
@@ -146,24 +277,51 @@ namespace my
             handle_ls();
         } else if (token == "download") {
             ::std::getline(iss, token);
-            this->sendAckToPeer(0);
-            handle_download(token.substr(1));
+            if (!takeBlockSizeOption(token)) {
+                co_return;
+            }
+            // 客户端要求压缩时由发送端逐块压缩，接收端总能解压，上传时无需协商
+            this->setSendCompression(takeFlag(token, "z"));
+            ::std::string resume;
+            takeOption(token, "resume", resume);
+            co_await co_handle_download(token.substr(1), resume);
         } else if (token == "upload") {
             ::std::getline(iss, token);
-            this->sendAckToPeer(0);
-            handle_upload(token.substr(1));
+            if (!takeBlockSizeOption(token)) {
+                co_return;
+            }
+            ::std::string tag;
+            takeOption(token, "tag", tag);
+            co_await co_handle_upload(token.substr(1), tag);
+        } else if (token == "hashes") {
+            ::std::getline(iss, token);
+            if (!takeBlockSizeOption(token)) {
+                co_return;
+            }
+            co_await co_handle_hashes(token.substr(1));
+        } else if (token == "signatures") {
+            ::std::getline(iss, token);
+            if (!takeBlockSizeOption(token)) {
+                co_return;
+            }
+            co_await co_handle_signatures(token.substr(1));
+        } else if (token == "patch") {
+            ::std::getline(iss, token);
+            ::std::string root;
+            if (!takeBlockSizeOption(token) || !takeOption(token, "root", root)) {
+                co_return;
+            }
+            co_await co_handle_patch(token.substr(1), root);
         } else {
             pretty_err << ::std::format("Unknown command: \"{}\"", token);
         }
-
-        return 0;
     }
 
     template <class Transceiver>
-    inline void RDT_Server<Transceiver>::handle_ls()
+    inline void RDT_Session<Transceiver>::handle_ls()
     {
         for (const auto &entry : ::std::filesystem::directory_iterator(m_repo)) {
-            if (entry.is_regular_file()) {
+            if (entry.is_regular_file() && !TransferJournal::isJournal(entry.path().string())) {
                 ::std::string str =
                     entry.path().filename().string() +
                     " " +
@@ -175,28 +333,354 @@ namespace my
         sendUDPDataframeTo(UDPData(0, buffer, 0), this->m_host, this->m_peer);
     }
 
+    // 续传请求带有 "<tag>:<ranges>"，即客户端记下的文件版本与缺失的块，版本与当前文件一致时只发送这些块
+    // 确认号为当前文件的版本，客户端据此判断是否续传
     template <class Transceiver>
-    inline void RDT_Server<Transceiver>::handle_download(::std::string_view filename)
+    CoTask RDT_Session<Transceiver>::co_handle_download(::std::string filename, ::std::string resume)
     {
+        ::std::string file_path = m_repo.string() + filename;
+        ::std::uint32_t tag = TransferJournal::fileTag(file_path);
+        if (!resume.empty()) {
+            ::std::uint32_t resume_tag = 0;
+            ::std::size_t colon = resume.find(':');
+            BlockRanges ranges;
+            auto [ptr, ec] = ::std::from_chars(resume.data(), resume.data() + ::std::min(colon, resume.size()), resume_tag);
+            if (colon != ::std::string::npos && ec == ::std::errc() && resume_tag == tag && BlockRanges::parse(::std::string_view(resume).substr(colon + 1), ranges)) {
+                this->setSendRanges(::std::move(ranges));
+            } else {
+                pretty_log << ::std::format("File \"{}\" changed since the interrupted transfer, send the whole file", filename);
+            }
+        }
+        this->sendAckToPeer(tag);
+
         enableLoss();
-        this->sendtoPeer(m_repo.string() + ::std::string(filename));
+        co_await this->co_sendtoPeer(file_path);
         disableLoss();
     }
 
+    // 上传请求带有客户端文件的版本，与中断时的日志一致时回复 "resume <ranges>" 命令帧代替确认，客户端只发送缺失的块
     template <class Transceiver>
-    inline void RDT_Server<Transceiver>::handle_upload(::std::string_view filename)
+    CoTask RDT_Session<Transceiver>::co_handle_upload(::std::string filename, ::std::string tag)
     {
         // 不考虑文件与文件夹同名的情况
-        ::std::filesystem::path file_path = m_repo / ::std::string(filename);
-        if (::std::filesystem::exists(file_path)) {
-            pretty_log << ::std::format("File \"{}\" already exists, overwrite", file_path.string());
-            ::std::filesystem::remove(file_path);
+        ::std::filesystem::path file_path = m_repo / filename;
+        ::std::uint32_t peer_tag = 0;
+        ::std::from_chars(tag.data(), tag.data() + tag.size(), peer_tag);
+
+        bool resumed = peer_tag != 0 && ::std::filesystem::exists(file_path) && this->m_journal.load(file_path.string()) &&
+                       this->m_journal.getTag() == peer_tag && this->m_journal.getBlockSize() == this->getBlockSize();
+        if (resumed) {
+            ::std::string ranges = this->m_journal.getMissing().toString();
+            BlockRanges::parse(ranges, this->m_recv_ranges);
+            sendUDPDataframeTo(UDPCmd("resume " + ranges), this->m_host, this->m_peer);
+        } else {
+            if (::std::filesystem::exists(file_path)) {
+                pretty_log << ::std::format("File \"{}\" already exists, overwrite", file_path.string());
+                ::std::filesystem::remove(file_path);
+            }
+            this->m_journal.create(file_path.string(), peer_tag, this->getBlockSize());
+            this->sendAckToPeer(0);
         }
         enableLoss();
-        this->recvfromPeer(file_path.string());
+        co_await this->co_recvfromPeer(file_path.string());
         disableLoss();
     }
 
+    // 按请求的块大小计算文件的 Merkle 树，把全部叶子作为一个文件发给客户端，用于找出不一致的块
+    // 文件不存在时不确认请求
+    template <class Transceiver>
+    CoTask RDT_Session<Transceiver>::co_handle_hashes(::std::string filename)
+    {
+        static ::std::atomic<int> counter = 0;
+
+        ::std::filesystem::path file_path = m_repo / filename;
+        if (!::std::filesystem::is_regular_file(file_path)) {
+            pretty_err << ::std::format("File \"{}\" not found, hashes request ignored", file_path.string());
+            co_return;
+        }
+        ::std::filesystem::path leaves_path = ::std::filesystem::temp_directory_path() / ::std::format("rdt_hashes_{}.bin", counter++);
+        // 整个文件的哈希在后台线程计算，不阻塞同一分片上的其他会话
+        CoWorker<MerkleTree> worker([path = file_path.string(), block_size = this->getBlockSize()] {
+            return MerkleTree::fromFile(path, block_size);
+        });
+        MerkleTree tree = co_await worker;
+        tree.saveLeaves(leaves_path.string());
+        pretty_log << ::std::format("Merkle tree of \"{}\": {} block(s), root {}", filename, tree.getLeafCount(), Sha256::toHex(tree.getRoot()));
+
+        this->sendAckToPeer(0);
+        co_await this->co_sendtoPeer(leaves_path.string());
+        ::std::filesystem::remove(leaves_path);
+    }
+
+    // 按请求的块大小计算已有文件的 rsync 签名并发给客户端，客户端据此生成差量
+    // 文件不存在时回复 "nofile" 命令帧代替确认，客户端随即改为上传整个文件
+    template <class Transceiver>
+    CoTask RDT_Session<Transceiver>::co_handle_signatures(::std::string filename)
+    {
+        static ::std::atomic<int> counter = 0;
+
+        ::std::filesystem::path file_path = m_repo / filename;
+        if (!::std::filesystem::is_regular_file(file_path)) {
+            pretty_log << ::std::format("File \"{}\" not found, no signatures", file_path.string());
+            sendUDPDataframeTo(UDPCmd("nofile"), this->m_host, this->m_peer);
+            co_return;
+        }
+        ::std::filesystem::path signature_path = ::std::filesystem::temp_directory_path() / ::std::format("rdt_signatures_{}.bin", counter++);
+        CoWorker<bool> worker([path = file_path.string(), block_size = this->getBlockSize(), output = signature_path.string()] {
+            DeltaSync::makeSignatures(path, block_size, output);
+            return true;
+        });
+        co_await worker;
+
+        this->sendAckToPeer(0);
+        co_await this->co_sendtoPeer(signature_path.string());
+        ::std::filesystem::remove(signature_path);
+    }
+
+    // 接收客户端的差量，与已有文件合成新文件，Merkle 根与客户端给出的一致才替换已有文件
+    // 结束后回复 "patched" 或 "unpatched <原因>" 命令帧，失败时客户端改为上传整个文件
+    template <class Transceiver>
+    CoTask RDT_Session<Transceiver>::co_handle_patch(::std::string filename, ::std::string root)
+    {
+        static ::std::atomic<int> counter = 0;
+
+        ::std::filesystem::path file_path = m_repo / filename;
+        if (!::std::filesystem::is_regular_file(file_path)) {
+            pretty_log << ::std::format("File \"{}\" not found, nothing to patch", file_path.string());
+            sendUDPDataframeTo(UDPCmd("nofile"), this->m_host, this->m_peer);
+            co_return;
+        }
+        ::std::filesystem::path delta_path = ::std::filesystem::temp_directory_path() / ::std::format("rdt_delta_{}.bin", counter++);
+        this->sendAckToPeer(0);
+        enableLoss();
+        co_await this->co_recvfromPeer(delta_path.string());
+        disableLoss();
+        if (this->getLastVerify() == Transceiver::Verify::MISMATCH) {
+            pretty_err << ::std::format("Delta of \"{}\" is corrupted, file unchanged", filename);
+            ::std::filesystem::remove(delta_path);
+            sendUDPDataframeTo(UDPCmd("unpatched delta corrupted"), this->m_host, this->m_peer);
+            co_return;
+        }
+
+        ::std::filesystem::path patched_path = file_path;
+        patched_path += ".patching";
+        ::std::string reply = "patched";
+        try {
+            // 合成与哈希在后台线程进行，异常在 co_await 处重新抛出
+            CoWorker<::std::string> worker([base = file_path.string(), delta = delta_path.string(), output = patched_path.string(), block_size = this->getBlockSize()] {
+                DeltaSync::applyDelta(base, delta, output);
+                return Sha256::toHex(MerkleTree::fromFile(output, block_size).getRoot());
+            });
+            ::std::string patched_root = co_await worker;
+            if (patched_root == root) {
+                ::std::filesystem::rename(patched_path, file_path);
+                ::std::filesystem::remove(TransferJournal::pathFor(file_path.string()));
+                pretty_log << ::std::format("File \"{}\" patched, Merkle root {}", filename, patched_root);
+            } else {
+                pretty_err << ::std::format("Patched \"{}\" does not match, Merkle root {} expected {}, file unchanged", filename, patched_root, root);
+                ::std::filesystem::remove(patched_path);
+                reply = "unpatched Merkle root mismatch";
+            }
+        } catch (const ::std::exception &e) {
+            pretty_err << ::std::format("Failed to patch \"{}\": {}", filename, e.what());
+            ::std::filesystem::remove(patched_path);
+            reply = ::std::format("unpatched {}", e.what());
+        }
+        ::std::filesystem::remove(delta_path);
+        sendUDPDataframeTo(UDPCmd(reply), this->m_host, this->m_peer);
+    }
+
+    template <class Transceiver>
+    RDT_ServerShard<Transceiver>::RDT_ServerShard(int index, SOCKET host_socket, const ::std::filesystem::path &repo, ::std::function<void()> on_session_closed, MetricsReporter report_metrics)
+        : m_index(index), m_host(host_socket), m_demux(m_host), m_repo(repo), m_on_session_closed(::std::move(on_session_closed)), m_report_metrics(::std::move(report_metrics))
+    {
+    }
+
+    template <class Transceiver>
+    RDT_ServerShard<Transceiver>::~RDT_ServerShard()
+    {
+        // 会话先于 socket 销毁
+        m_sessions.clear();
+        if (closesocket(m_host.getSocket()) == SOCKET_ERROR) {
+            ::my::pretty_err << ::std::format("Close socket failed. Error code: {}", WSAGetLastError());
+        }
+    }
+
+    template <class Transceiver>
+    void RDT_ServerShard<Transceiver>::run()
+    {
+        m_scheduler.spawn(m_demux.co_run([this](const UDPDataframe &, const Peer &peer) { return acceptPeer(peer); }));
+        m_scheduler.run();
+    }
+
+    // 新客户端的第一个命令帧到达时建立会话
+    template <class Transceiver>
+    bool RDT_ServerShard<Transceiver>::acceptPeer(const Peer &peer)
+    {
+        unsigned long long key = UDPDemux::keyOf(peer);
+        // 上报前刷新分片统计，写出的文件中两者一致
+        m_sessions[key] = ::std::make_unique<Session>(m_host, peer, m_demux, m_repo, [this](const TransferMetrics &metrics) {
+            updateStats();
+            if (m_report_metrics) {
+                m_report_metrics(metrics);
+            }
+        });
+        m_scheduler.spawn(co_runSession(key, peer));
+        ++m_sessions_opened;
+        updateStats();
+        pretty_log << ::std::format("[shard {}] Session {} opened, {} active", m_index, peer.toString(), m_sessions.size());
+        return true;
+    }
+
+    template <class Transceiver>
+    CoTask RDT_ServerShard<Transceiver>::co_runSession(unsigned long long key, Peer peer)
+    {
+        try {
+            co_await m_sessions.at(key)->co_serve();
+        } catch (const ::std::exception &e) {
+            pretty_out << ::std::format("catch by RDT_ServerShard::co_runSession():") << e.what();
+        }
+        m_sessions.erase(key);
+        updateStats();
+        pretty_log << ::std::format("[shard {}] Session {} closed, {} active", m_index, peer.toString(), m_sessions.size());
+        if (m_on_session_closed) {
+            m_on_session_closed();
+        }
+    }
+
+    template <class Transceiver>
+    inline void RDT_ServerShard<Transceiver>::updateStats()
+    {
+        m_sessions_active = (int)m_sessions.size();
+        m_frames_received = m_demux.getStats().getFrames();
+        m_frames_dropped = m_demux.getDroppedCount();
+    }
+
+    template <class Transceiver>
+    RDT_Server<Transceiver>::RDT_Server(int shard_count, ::std::filesystem::path metrics_path)
+        : m_metrics_path(::std::move(metrics_path))
+    {
+        if (!wsa_initialized) {
+            init_wsa();
+        }
+        if (shard_count <= 0) {
+            shard_count = ::std::max(1, (int)::std::thread::hardware_concurrency());
+        }
+
+        if (!::std::filesystem::exists(m_repo)) {
+            ::std::filesystem::create_directory(m_repo);
+        }
+
+        for (int i = 0; i < shard_count; ++i) {
+            m_shards.push_back(::std::make_unique<Shard>(
+                i, create_udp_socket(12345, shard_count > 1), m_repo,
+                [this] {
+                    logShardStats();
+                    writeMetrics();
+                },
+                [this](const TransferMetrics &metrics) { mergeMetrics(metrics); }));
+        }
+        writeMetrics();
+
+        pretty_log << "Server initialized"
+                   << ::std::format("Running on {} with {} shard(s)", m_shards.front()->getHost().toString(), shard_count)
+                   << ::std::format("Metrics written to \"{}\"", m_metrics_path.string());
+    }
+
+    template <class Transceiver>
+    RDT_Server<Transceiver>::~RDT_Server()
+    {
+        m_shards.clear();
+        pretty_log << "Server closed";
+
+        if (wsa_initialized) {
+            cleanup_wsa();
+        }
+    }
+
+    // 只有一个分片时直接在当前线程运行
+    template <class Transceiver>
+    void RDT_Server<Transceiver>::run()
+    {
+        if (m_shards.size() == 1) {
+            m_shards.front()->run();
+            return;
+        }
+
+        ::std::vector<::std::thread> workers;
+        unsigned core_count = ::std::max(1u, ::std::thread::hardware_concurrency());
+        for (auto &shard : m_shards) {
+            workers.emplace_back([&shard] { shard->run(); });
+#ifdef __linux__
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(shard->getIndex() % core_count, &cpus);
+            if (pthread_setaffinity_np(workers.back().native_handle(), sizeof(cpus), &cpus) != 0) {
+                pretty_err << ::std::format("Pin shard {} to core {} failed", shard->getIndex(), shard->getIndex() % core_count);
+            }
+#endif
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    template <class Transceiver>
+    void RDT_Server<Transceiver>::logShardStats() const
+    {
+        pretty_wapper log = pretty_log << "Shard statistics:";
+        for (const auto &shard : m_shards) {
+            log << ::std::format("shard {}: {} session(s) opened, {} active, {} frame(s) received, {} dropped",
+                                 shard->getIndex(), shard->getSessionsOpened(), shard->getSessionsActive(),
+                                 shard->getFramesReceived(), shard->getFramesDropped());
+        }
+    }
+
+    template <class Transceiver>
+    void RDT_Server<Transceiver>::mergeMetrics(const TransferMetrics &metrics)
+    {
+        {
+            ::std::lock_guard<::std::mutex> lock(m_metrics_mutex);
+            m_metrics.merge(metrics);
+        }
+        writeMetrics();
+    }
+
+    template <class Transceiver>
+    void RDT_Server<Transceiver>::writeMetrics() const
+    {
+        ::std::lock_guard<::std::mutex> lock(m_metrics_mutex);
+        ::std::string text = m_metrics.toPrometheus("rdt_server");
+
+        // 分片统计带 shard 标签
+        auto write_shard_metric = [&](::std::string_view name, ::std::string_view type, ::std::string_view help, auto get_value) {
+            text += ::std::format("# HELP rdt_server_{0} {1}\n# TYPE rdt_server_{0} {2}\n", name, help, type);
+            for (const auto &shard : m_shards) {
+                text += ::std::format("rdt_server_{}{{shard=\"{}\"}} {}\n", name, shard->getIndex(), get_value(*shard));
+            }
+        };
+        write_shard_metric("sessions_opened_total", "counter", "Sessions opened", [](const Shard &shard) { return shard.getSessionsOpened(); });
+        write_shard_metric("sessions_active", "gauge", "Sessions currently open", [](const Shard &shard) { return (long long)shard.getSessionsActive(); });
+        write_shard_metric("demux_frames_received_total", "counter", "Frames received on the shard socket", [](const Shard &shard) { return shard.getFramesReceived(); });
+        write_shard_metric("demux_frames_dropped_total", "counter", "Frames dropped by the demultiplexer", [](const Shard &shard) { return shard.getFramesDropped(); });
+
+        ::std::filesystem::path temp_path = m_metrics_path;
+        temp_path += ".tmp";
+        {
+            ::std::ofstream ofs(temp_path, ::std::ios::binary | ::std::ios::trunc);
+            ofs << text;
+            if (!ofs) {
+                pretty_err << ::std::format("Write metrics to \"{}\" failed", temp_path.string());
+                return;
+            }
+        }
+        ::std::error_code ec;
+        ::std::filesystem::rename(temp_path, m_metrics_path, ec);
+        if (ec) {
+            pretty_err << ::std::format("Write metrics to \"{}\" failed: {}", m_metrics_path.string(), ec.message());
+        }
+    }
+
 } // namespace my
 
 #endif // _RDT_SERVER_HPP_
\ No newline at end of file
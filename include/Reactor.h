@@ -0,0 +1,45 @@
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include <chrono>
+
+#include "./wsa_wapper.h"
+
+namespace my
+{
+    // 同时等待 socket 可读与下一个截止时刻，两者谁先到就在谁到时返回
+    // Linux 上用 epoll 监听 socket 与 timerfd，截止时刻精确到微秒，不再轮询
+    // 其他平台退化为带超时的 select()
+    class Reactor
+    {
+    public:
+        using Clock = ::std::chrono::steady_clock;
+        using TimePoint = Clock::time_point;
+
+        enum class Event {
+            READABLE,
+            TIMEOUT,
+        };
+
+        Reactor() = default;
+        ~Reactor();
+        Reactor(const Reactor &) = delete;
+        Reactor &operator=(const Reactor &) = delete;
+
+        // deadline 为 TimePoint::max() 时只等待 socket
+        Event wait(SOCKET socket, TimePoint deadline);
+
+    private:
+#ifdef __linux__
+        int m_epoll_fd = -1;
+        int m_timer_fd = -1;
+        SOCKET m_socket = INVALID_SOCKET;
+        bool m_timer_armed = false;
+
+        void init(SOCKET socket);
+        void armTimer(TimePoint deadline);
+#endif
+    };
+} // namespace my
+
+#endif // _REACTOR_H_
\ No newline at end of file
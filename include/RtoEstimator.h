@@ -0,0 +1,49 @@
+#ifndef _RTO_ESTIMATOR_H_
+#define _RTO_ESTIMATOR_H_
+
+#include <string>
+#include <vector>
+
+namespace my
+{
+    // 按 RFC 6298 估计重传超时时间，时间单位均为微秒
+    // 只应对未重传过的数据帧取样（Karn 算法），超时后调用 backoff() 指数退避
+    class RtoEstimator
+    {
+    public:
+        // 环回链路上 RFC 建议的 1s 下限过于保守，这里取 20ms
+        static constexpr long long MIN_RTO = 20000;
+        static constexpr long long MAX_RTO = 60000000;
+        static constexpr long long CLOCK_GRANULARITY = 1000;
+        static constexpr int MAX_SAMPLES = 4096;
+
+        RtoEstimator(int initial_rto_ms = 1000) noexcept;
+
+        void reset(int initial_rto_ms) noexcept;
+        void sample(long long rtt) noexcept;
+        void backoff() noexcept;
+
+        // 供定时器使用，单位为毫秒，向上取整
+        int getRto() const noexcept { return (int)((m_rto + 999) / 1000); }
+        long long getRtoUs() const noexcept { return m_rto; }
+        long long getSrtt() const noexcept { return m_srtt; }
+        long long getRttVar() const noexcept { return m_rttvar; }
+        bool hasSample() const noexcept { return m_sample_count > 0; }
+        long long getSampleCount() const noexcept { return m_sample_count; }
+        long long getBackoffCount() const noexcept { return m_backoff_count; }
+
+        // 最近的 RTT 样本，按时间顺序，至多 MAX_SAMPLES 个
+        const ::std::vector<long long> &getSamples() const noexcept { return m_samples; }
+        ::std::string toString() const;
+
+    private:
+        long long m_rto;
+        long long m_srtt = 0;
+        long long m_rttvar = 0;
+        long long m_sample_count = 0;
+        long long m_backoff_count = 0;
+        ::std::vector<long long> m_samples;
+    };
+} // namespace my
+
+#endif // _RTO_ESTIMATOR_H_
\ No newline at end of file
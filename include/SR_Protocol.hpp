@@ -19,10 +19,16 @@ namespace my
         SR_Sender(const SR_Sender &) = delete;
         SR_Sender &operator=(const SR_Sender &) = delete;
 
-        virtual void sendtoPeer(::std::string_view file_path) override;
+        virtual CoTask co_sendtoPeer(::std::string file_path) override;
 
     private:
         SpinWindowWithTimer<senderWindowSize, seqNumBound> m_spin_timer;
+
+        // 选择确认表明其后已有足够多的块到达时，空洞只快速重传一次，再丢失时交给超时重传
+        ::std::vector<bool> m_hole_resent = ::std::vector<bool>(senderWindowSize, false);
+
+        // 块已确认过时返回 false
+        bool onAckBlock(int block_num, ::std::chrono::steady_clock::time_point now);
     };
 
     template <int receiverWindowSize, int seqNumBound>
@@ -37,10 +43,15 @@ namespace my
         SR_Receiver(const SR_Receiver &) = delete;
         SR_Receiver &operator=(const SR_Receiver &) = delete;
 
-        virtual void recvfromPeer(::std::string_view file_path) override;
+        virtual CoTask co_recvfromPeer(::std::string file_path) override;
+
+    protected:
+        virtual void queueCurrentAck() override;
 
     private:
-        SpinWindowWithCache<receiverWindowSize, seqNumBound, UDPDataframe> m_spin_cache;
+        // 数据块一到达就写到文件中的最终位置，窗口只需记录哪些块已收到
+        SpinWindow<receiverWindowSize, seqNumBound> m_spin_window;
+        unsigned char m_sack_bitmap[UDPDataframe::DEFAULT_DATA_SIZE];
     };
 
     template <int windowSize, int seqNumBound>
@@ -49,70 +60,167 @@ namespace my
                            public SR_Receiver<windowSize, seqNumBound>
     {
     public:
-        SR_Transceiver() = default;
-        SR_Transceiver(SOCKET host_socket) : BasicRole(host_socket) {};
+        // 两端使用同一实例，对端的发送窗口即本端的
+        SR_Transceiver() { this->setPeerWindow(windowSize); }
+        SR_Transceiver(SOCKET host_socket) : BasicRole(host_socket) { this->setPeerWindow(windowSize); }
         virtual ~SR_Transceiver() = default;
     };
 
+    // 首次确认某个块时取样并通知拥塞控制
+    template <int senderWindowSize, int seqNumBound>
+        requires(senderWindowSize <= seqNumBound / 2 && senderWindowSize > 0)
+    inline bool SR_Sender<senderWindowSize, seqNumBound>::onAckBlock(int block_num, ::std::chrono::steady_clock::time_point now)
+    {
+        if (!m_spin_timer.submit(block_num % seqNumBound)) {
+            return false;
+        }
+        this->m_cc->onAck(1, this->sampleRtt(block_num, now));
+        return true;
+    }
+
     template <int senderWindowSize, int seqNumBound>
         requires(senderWindowSize <= seqNumBound / 2 && senderWindowSize > 0)
-    void my::SR_Sender<senderWindowSize, seqNumBound>::sendtoPeer(::std::string_view file_path)
+    CoTask my::SR_Sender<senderWindowSize, seqNumBound>::co_sendtoPeer(::std::string file_path)
     {
-        UDPFileReader reader(file_path);
+        UDPFileReader reader(file_path, UDPFileReader::Mode::MAPPED, this->m_block_size);
+        this->openForSend(reader, file_path);
         m_spin_timer.clear();
 
         int base = 0;
         int next_seq_num = 0;
-        int ack_num = -1;
-        int timeout_num = -1;
         const int block_count = reader.getBlockCount();
         constexpr int N = senderWindowSize;
         constexpr int M = seqNumBound;
 
+        this->resetSendStats();
+
+        // 每轮循环只读一次时钟，发送、重传与超时检查共用
+        auto now = ::std::chrono::steady_clock::now();
         while (base <= block_count) {
             // 发送数据帧
-            while (next_seq_num < base + N && next_seq_num <= block_count) {
-                pretty_log << ::std::format("Send data frame {}({}/{})", next_seq_num % M, next_seq_num, block_count);
+            // 在途数据帧数受拥塞窗口限制
+            while (next_seq_num < base + this->getEffectiveWindow() && next_seq_num <= block_count) {
+                PRETTY_TRACE(pretty_log, "Send data frame {}({}/{})", next_seq_num % M, next_seq_num, block_count);
 
-                this->sendUDPDataframeToPeer(reader, next_seq_num);
-                m_spin_timer.timerSetTimeout(next_seq_num % M, this->m_timeout);
+                if (next_seq_num == block_count) {
+                    co_await this->co_prepareFin(reader);
+                }
+                this->queueUDPDataframeToPeer(reader, next_seq_num);
+                this->markSent(next_seq_num, now, false);
+                m_spin_timer.timerSetTimeout(next_seq_num % M, this->m_rto.getRto(), now);
+                m_hole_resent[next_seq_num % N] = false;
                 ++next_seq_num;
             }
+            this->flushToPeer();
 
             // 接收确认帧
-            while ((ack_num = this->recvAckFromPeer()) != -1) {
+            // 选择确认帧一次确认累计确认号之前的全部块以及位图中的块
+            // 挂起到确认帧到达或最近的定时器到期
+            co_await this->coWaitFrames(m_spin_timer.timerNextDeadline());
+            const ::std::vector<int> &ack_nums = this->takeAcksFromPeer([&](const UDPDataframe &sack) {
+                now = ::std::chrono::steady_clock::now();
+                int bitmap_size;
+                const unsigned char *bitmap = sack.sackBitmap(bitmap_size);
+                int cum_ack = (int)sack.getAckNum();
+                int actual_cum_ack = getActualForwardBlockNum(base, cum_ack, M);
+
+                PRETTY_TRACE(pretty_log, "Receive sack frame {}({}/{}), {} byte(s) bitmap", cum_ack, actual_cum_ack, block_count, bitmap_size);
+
+                if (actual_cum_ack > next_seq_num) {
+                    // 不可能确认尚未发出的块，视为过期帧
+                    return;
+                }
+                for (int block_num = base; block_num < actual_cum_ack; ++block_num) {
+                    onAckBlock(block_num, now);
+                }
+                int highest_sacked = -1;
+                for (int i = 0; i < bitmap_size; ++i) {
+                    if (bitmap[i] == 0) {
+                        continue;
+                    }
+                    for (int bit = 0; bit < 8; ++bit) {
+                        int block_num = actual_cum_ack + 1 + i * 8 + bit;
+                        if ((bitmap[i] >> bit & 1) && block_num < next_seq_num && block_num < base + N) {
+                            onAckBlock(block_num, now);
+                            highest_sacked = block_num;
+                        }
+                    }
+                }
+
+                // 与重复确认同理：某个未确认的块之后已有 threshold 个块到达，视为丢失，立即重传
+                const int threshold = this->m_dup_ack_threshold;
+                int acked_above = 0;
+                for (int block_num = highest_sacked; threshold > 0 && block_num >= ::std::max(base, actual_cum_ack); --block_num) {
+                    if (m_spin_timer.isSubmitted(block_num % M)) {
+                        ++acked_above;
+                        continue;
+                    }
+                    if (acked_above < threshold || m_hole_resent[block_num % N]) {
+                        continue;
+                    }
+                    PRETTY_DEBUG(pretty_log, "{} block(s) sacked above {}, fast retransmit", acked_above, block_num);
+                    // 同一次丢包只让拥塞窗口反应一次
+                    if (this->isSentAfterLoss(block_num)) {
+                        this->onDupAckLoss(next_seq_num - base, now);
+                    }
+                    m_hole_resent[block_num % N] = true;
+                    this->queueUDPDataframeToPeer(reader, block_num);
+                    this->markSent(block_num, now, true);
+                    m_spin_timer.timerSetTimeout(block_num % M, this->m_rto.getRto(), now);
+                }
+            });
+            now = ::std::chrono::steady_clock::now();
+            // 长时间传输中按期重新探测路径 MTU，结果用于之后的传输
+            this->pollPathMtu(now);
+            for (int ack_num : ack_nums) {
                 int actual_forward_block_num = getActualForwardBlockNum(base, ack_num, M);
 
-                pretty_log << ::std::format("Receive ack frame {}({}/{})", ack_num, actual_forward_block_num, block_count);
+                PRETTY_TRACE(pretty_log, "Receive ack frame {}({}/{})", ack_num, actual_forward_block_num, block_count);
 
-                // 如果确认号在当前窗口内
-                if (actual_forward_block_num <= base + N) {
-                    m_spin_timer.submit(ack_num);
+                // 如果确认号在当前窗口内，首次确认时取样，否则是已滑出窗口的块的重复确认
+                if (actual_forward_block_num >= base + N || !onAckBlock(actual_forward_block_num, now)) {
+                    this->m_metrics.add(TransferMetrics::Counter::DUPLICATE_ACKS);
                 }
             }
             // 尝试滑动窗口
             base += m_spin_timer.spin();
 
-            // 发送超时的数据帧
-            while ((timeout_num = m_spin_timer.whichTimerIsTimeout()) != -1) {
+            // 发送超时的数据帧，属于新的丢包时退避 RTO 并缩小拥塞窗口
+            const ::std::vector<int> &timeout_nums = m_spin_timer.collectTimeout(now);
+            bool new_loss = false;
+            for (int timeout_num : timeout_nums) {
+                new_loss = new_loss || this->isSentAfterLoss(getActualForwardBlockNum(base, timeout_num, M));
+            }
+            if (new_loss) {
+                this->onTimeoutLoss(now);
+            }
+            this->m_metrics.add(TransferMetrics::Counter::TIMEOUTS, (long long)timeout_nums.size());
+            if (!timeout_nums.empty()) {
+                PRETTY_DEBUG(pretty_log, "Timeout, resend {} data frame(s)", timeout_nums.size());
+            }
+            for (int timeout_num : timeout_nums) {
                 int actual_timeout_num = getActualForwardBlockNum(base, timeout_num, M);
 
-                pretty_log
-                    << ::std::format("Timeout for ack frame {}({}/{})", timeout_num, actual_timeout_num, block_count)
-                    << ::std::format("Resend data frame {}({}/{})", timeout_num, actual_timeout_num, block_count);
+                PRETTY_TRACE(pretty_log_con, "Resend data frame {}({}/{})", timeout_num, actual_timeout_num, block_count);
 
-                this->sendUDPDataframeToPeer(reader, actual_timeout_num);
-                m_spin_timer.timerSetTimeout(timeout_num, this->m_timeout);
+                this->queueUDPDataframeToPeer(reader, actual_timeout_num);
+                this->markSent(actual_timeout_num, now, true);
+                m_spin_timer.timerSetTimeout(timeout_num, this->m_rto.getRto(), now);
             }
+            this->flushToPeer();
         }
+
+        this->m_inbox.discardStale();
+        this->closeForSend(reader);
+        this->logSendStats();
     }
 
     template <int receiverWindowSize, int seqNumBound>
         requires(receiverWindowSize <= seqNumBound / 2 && receiverWindowSize > 0)
-    void SR_Receiver<receiverWindowSize, seqNumBound>::recvfromPeer(::std::string_view file_path)
+    CoTask SR_Receiver<receiverWindowSize, seqNumBound>::co_recvfromPeer(::std::string file_path)
     {
-        UDPFileWriter writer(file_path);
-        m_spin_cache.clear();
+        UDPFileWriter writer = this->openForRecv(file_path, UDPFileWriter::Mode::POSITIONAL);
+        m_spin_window.clear();
 
         int base = 0;
         constexpr int N = receiverWindowSize;
@@ -120,14 +228,17 @@ namespace my
 
         bool receive_end = false;
         int target_block_cnt = 0;
+        this->resetRecvStats();
 
         // 阻塞接收数据帧
         while (!receive_end || base < target_block_cnt) {
-            UDPDataframe dataframe = this->recvUDPDataframeFromPeer();
+            UDPDataframe dataframe;
+            while (!this->takeUDPDataframeFromPeer(dataframe)) {
+                this->pollPathMtu(::std::chrono::steady_clock::now());
+                co_await this->coWaitFrames(::std::min(this->flushDueAcks(), this->m_pmtu.getRoundDeadline()));
+            }
 
             int seq_num = dataframe.getDataNum();
-            int length;
-            dataframe.data(length);
             int actual_forward_block_num = getActualForwardBlockNum(base, seq_num, M);
             int actual_backward_block_num = getActualBackwardBlockNum(base, seq_num, M);
 
@@ -142,45 +253,70 @@ namespace my
             if (in_current_window || in_last_window) {
                 if (in_current_window) {
                     // 期望的数据帧，接收或缓存
-                    pretty_log << ::std::format("Receive data frame {}({})", seq_num, actual_forward_block_num);
+                    PRETTY_TRACE(pretty_log, "Receive data frame {}({})", seq_num, actual_forward_block_num);
 
-                    if (length == 0) {
-                        // 空的结束帧，置标记位，等待接收结束
+                    if (dataframe.isFin()) {
+                        // 结束帧带有整个文件的 Merkle 根，置标记位，等待接收结束
                         receive_end = true;
+                        this->takeFinPayload(dataframe);
                         target_block_cnt = actual_forward_block_num;
-                        pretty_log_con << "End frame";
+                        PRETTY_TRACE(pretty_log_con, "End frame");
 
                         // 不考虑最后一个ack丢失的情况
                         this->disableReceiverLoss();
+
+                        // 结束帧不进入窗口，单独用普通确认帧立即回复
+                        PRETTY_TRACE(pretty_log_con, "Send ack frame {}({})", seq_num, actual_forward_block_num);
+                        this->queueAckToPeer(seq_num);
+                        this->scheduleAck(true);
                     } else {
-                        if (m_spin_cache.submit(seq_num, ::std::move(dataframe))) {
-                            int cnt = m_spin_cache.spin(writer);
+                        // 只有按序到达且恰好推进一格的帧允许延迟确认
+                        // 乱序、补上空洞或重复时立即告知发送端
+                        bool urgent = true;
+                        if (m_spin_window.submit(seq_num)) {
+                            this->writeBlock(writer, actual_forward_block_num, dataframe);
+                            int cnt = m_spin_window.spin();
                             base += cnt;
+                            urgent = cnt != 1;
                             if (cnt) {
-                                pretty_log_con << ::std::format("Submit {} data frame(s) to writer", cnt);
+                                PRETTY_TRACE(pretty_log_con, "Window advanced by {} data frame(s)", cnt);
                             } else {
-                                pretty_log_con << "Cached";
+                                PRETTY_TRACE(pretty_log_con, "Written out of order");
                             }
                         } else {
                             // 当前窗口的重复的数据帧，不进行处理
-                            pretty_log_con << "Duplicate data frame, ignored";
+                            PRETTY_TRACE(pretty_log_con, "Duplicate data frame, ignored");
+                            this->m_metrics.add(TransferMetrics::Counter::DUPLICATE_FRAMES);
                         }
+                        this->scheduleAck(urgent);
                     }
-
-                    pretty_log_con << ::std::format("Send ack frame {}({})", seq_num, actual_forward_block_num);
                 } else {
-                    // 非当前窗口的重复的数据帧，不进行处理
-                    pretty_log
-                        << ::std::format("Receive duplicate data frame {}({})", seq_num, actual_backward_block_num)
-                        << ::std::format("Send ack frame {}({})", seq_num, actual_backward_block_num);
+                    // 非当前窗口的重复的数据帧，不进行处理，累计确认号已经覆盖它
+                    PRETTY_TRACE(pretty_log, "Receive duplicate data frame {}({})", seq_num, actual_backward_block_num);
+                    this->m_metrics.add(TransferMetrics::Counter::DUPLICATE_FRAMES);
+                    this->scheduleAck(true);
                 }
-
-                // 发送/重发确认帧
-                this->sendAckToPeer(seq_num);
             }
 
             // 对于既不在当前窗口也不在上一个窗口的数据帧，丢弃
         }
+
+        // 先落盘再等待对端结束
+        this->closeForRecv(writer);
+        co_await this->co_lingerForPeer();
+        co_await this->co_verifyReceivedFile(file_path);
+        this->logRecvStats();
+    }
+
+    // 把窗口状态作为一个选择确认帧发出
+    template <int receiverWindowSize, int seqNumBound>
+        requires(receiverWindowSize <= seqNumBound / 2 && receiverWindowSize > 0)
+    void SR_Receiver<receiverWindowSize, seqNumBound>::queueCurrentAck()
+    {
+        int cum_ack = m_spin_window.getBegin();
+        int bitmap_size = m_spin_window.getBitmap(m_sack_bitmap, UDPDataframe::DEFAULT_DATA_SIZE);
+        PRETTY_TRACE(pretty_log, "Send sack frame {}, {} byte(s) bitmap", cum_ack, bitmap_size);
+        this->queueSackToPeer(cum_ack, m_sack_bitmap, bitmap_size);
     }
 } // namespace my
 
@@ -0,0 +1,35 @@
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace my
+{
+    // FIPS 180-4 SHA-256，可分段 update()，finish() 之后不能再使用
+    // x86-64 上 CPU 有 SHA 扩展时用 sha256rnds2 等指令压缩，否则用可移植实现
+    class Sha256
+    {
+    public:
+        static constexpr int DIGEST_SIZE = 32;
+        using Digest = ::std::array<unsigned char, DIGEST_SIZE>;
+
+        Sha256() noexcept;
+
+        void update(const void *data, ::std::size_t size) noexcept;
+        Digest finish() noexcept;
+
+        static Digest hash(const void *data, ::std::size_t size) noexcept;
+        static ::std::string toHex(const Digest &digest);
+
+    private:
+        ::std::uint32_t m_state[8];
+        unsigned char m_buffer[64];
+        ::std::size_t m_buffered = 0;
+        ::std::uint64_t m_length = 0;
+    };
+} // namespace my
+
+#endif // _SHA256_H_
\ No newline at end of file
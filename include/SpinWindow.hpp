@@ -2,47 +2,60 @@
 #define _SPIN_WINDOW_HPP_
 
 #include <algorithm>
+#include <stdexcept>
 #include <type_traits>
+#include <vector>
 
 #include "./Timer.hpp"
+#include "./TimerWheel.hpp"
 #include "./UDPFileWriter.h"
 
 namespace my
 {
+    // 窗口状态存放在长度为 windowSize 的环形缓冲中，head 为 begin 对应的槽位
+    // 存储与 seqNumBound 无关，序号空间可以远大于窗口
     template <int windowSize, int seqNumBound>
         requires(windowSize <= seqNumBound - 1 && windowSize > 0)
     class SpinWindow
     {
     public:
-        SpinWindow() noexcept
-            : begin(0) {}
-        SpinWindow(int begin) noexcept
-            : begin(begin) {}
+        SpinWindow()
+            : arr(windowSize, false), begin(0), head(0) {}
+        SpinWindow(int begin)
+            : arr(windowSize, false), begin(begin), head(0) {}
         virtual ~SpinWindow() = default;
 
         int getBegin() const noexcept { return begin; }
         void clear() noexcept
         {
-            ::std::fill(arr, arr + seqNumBound, false);
+            ::std::fill(arr.begin(), arr.end(), false);
             begin = 0;
+            head = 0;
         }
 
         bool canSubmit(int seq_num) const noexcept
         {
-            if (seq_num < 0 || seq_num >= seqNumBound || arr[seq_num])
+            if (seq_num < 0 || seq_num >= seqNumBound)
+                return false;
+
+            int offset = offsetOf(seq_num);
+            return offset < windowSize && !arr[slotOf(offset)];
+        }
+
+        // 序号在窗口内且已提交
+        bool isSubmitted(int seq_num) const noexcept
+        {
+            if (seq_num < 0 || seq_num >= seqNumBound)
                 return false;
 
-            int end = (begin + windowSize) % seqNumBound;
-            if (begin < end)
-                return seq_num >= begin && seq_num < end;
-            else
-                return seq_num >= begin || seq_num < end;
+            int offset = offsetOf(seq_num);
+            return offset < windowSize && arr[slotOf(offset)];
         }
 
         bool submit(int seq_num) noexcept
         {
             if (canSubmit(seq_num)) {
-                arr[seq_num] = true;
+                arr[slotOf(offsetOf(seq_num))] = true;
                 return true;
             }
             return false;
@@ -51,8 +64,7 @@ namespace my
         int howMuchCanSpin() const noexcept
         {
             int ret = 0;
-            int end = (begin + windowSize) % seqNumBound;
-            for (int i = begin; i != end && arr[i]; i = (i + 1) % seqNumBound)
+            while (ret < windowSize && arr[slotOf(ret)])
                 ++ret;
             return ret;
         }
@@ -61,27 +73,70 @@ namespace my
         {
             if (spin_cnt < 0 || spin_cnt > howMuchCanSpin())
                 return false;
-            while (spin_cnt--) {
-                arr[begin] = false;
-                begin = (begin + 1) % seqNumBound;
-            }
+            while (spin_cnt--)
+                advance();
             return true;
         }
 
         int spin() noexcept
         {
             int ret = 0;
-            while (arr[begin]) {
-                arr[begin] = false;
-                begin = (begin + 1) % seqNumBound;
+            while (arr[head]) {
+                advance();
                 ++ret;
             }
             return ret;
         }
 
+        // 导出 begin 之后已提交槽位的位图，第 i 位对应 begin + 1 + i
+        // 返回去掉末尾全零字节后的长度
+        int getBitmap(unsigned char *out, int max_bytes) const noexcept
+        {
+            int bits = ::std::min(windowSize - 1, max_bytes * 8);
+            int size = 0;
+            ::std::fill(out, out + (bits + 7) / 8, 0);
+            for (int i = 0; i < bits; ++i) {
+                if (arr[slotOf(i + 1)]) {
+                    out[i / 8] |= (unsigned char)(1u << (i % 8));
+                    size = i / 8 + 1;
+                }
+            }
+            return size;
+        }
+
     protected:
-        bool arr[seqNumBound] = {false};
+        // 序号相对 begin 的距离，按 seqNumBound 回绕
+        int offsetOf(int seq_num) const noexcept
+        {
+            return (int)(((long long)seq_num - begin + seqNumBound) % seqNumBound);
+        }
+
+        int slotOf(int offset) const noexcept { return (head + offset) % windowSize; }
+
+        // 窗口内序号对应的槽位，不在窗口内时抛出异常
+        int slotOfSeq(int seq_num) const
+        {
+            if (seq_num < 0 || seq_num >= seqNumBound || offsetOf(seq_num) >= windowSize)
+                throw ::std::out_of_range("seq_num out of range");
+            return slotOf(offsetOf(seq_num));
+        }
+
+        int seqOfSlot(int slot) const noexcept
+        {
+            int offset = (slot - head + windowSize) % windowSize;
+            return (int)(((long long)begin + offset) % seqNumBound);
+        }
+
+        void advance() noexcept
+        {
+            arr[head] = false;
+            head = (head + 1) % windowSize;
+            begin = (int)(((long long)begin + 1) % seqNumBound);
+        }
+
+        ::std::vector<bool> arr;
         int begin;
+        int head;
     };
 
     template <int windowSize, int seqNumBound, class DataType>
@@ -92,17 +147,19 @@ namespace my
     class SpinWindowWithCache : public SpinWindow<windowSize, seqNumBound>
     {
     public:
-        SpinWindowWithCache() noexcept = default;
-        SpinWindowWithCache(int begin) noexcept
-            : SpinWindow<windowSize, seqNumBound>(begin) {}
+        SpinWindowWithCache()
+            : cacheArr(windowSize) {}
+        SpinWindowWithCache(int begin)
+            : SpinWindow<windowSize, seqNumBound>(begin), cacheArr(windowSize) {}
         virtual ~SpinWindowWithCache() = default;
 
         bool submit(int seq_num, const DataType &data) noexcept
             requires(::std::is_copy_constructible_v<DataType>)
         {
             if (this->canSubmit(seq_num)) {
-                cacheArr[seq_num] = data;
-                this->arr[seq_num] = true;
+                int slot = this->slotOf(this->offsetOf(seq_num));
+                cacheArr[slot] = data;
+                this->arr[slot] = true;
                 return true;
             }
             return false;
@@ -112,8 +169,9 @@ namespace my
             requires(::std::is_move_constructible_v<DataType>)
         {
             if (this->canSubmit(seq_num)) {
-                cacheArr[seq_num] = ::std::move(data);
-                this->arr[seq_num] = true;
+                int slot = this->slotOf(this->offsetOf(seq_num));
+                cacheArr[slot] = ::std::move(data);
+                this->arr[slot] = true;
                 return true;
             }
             return false;
@@ -122,28 +180,22 @@ namespace my
         int spin(UDPFileWriter &writer)
         {
             int ret = 0;
-            while (this->arr[this->begin]) {
-                writer.append(cacheArr[this->begin]);
-                this->arr[this->begin] = false;
-                this->begin = (this->begin + 1) % seqNumBound;
+            while (this->arr[this->head]) {
+                writer.append(cacheArr[this->head]);
+                this->advance();
                 ++ret;
             }
             return ret;
         }
 
-        DataType &operator[](int seq_num) noexcept { return cacheArr[seq_num]; }
-        DataType &at(int seq_num) noexcept
-        {
-            if (seq_num < 0 || seq_num >= seqNumBound)
-                throw ::std::out_of_range("seq_num out of range");
-            return cacheArr[seq_num];
-        }
+        DataType &operator[](int seq_num) noexcept { return cacheArr[this->slotOf(this->offsetOf(seq_num))]; }
+        DataType &at(int seq_num) { return cacheArr[this->slotOfSeq(seq_num)]; }
 
     protected:
         using SpinWindow<windowSize, seqNumBound>::submit;
         using SpinWindow<windowSize, seqNumBound>::spin;
 
-        DataType cacheArr[seqNumBound];
+        ::std::vector<DataType> cacheArr;
     };
 
     template <int windowSize, int seqNumBound>
@@ -151,23 +203,18 @@ namespace my
     class SpinWindowWithTimer : public SpinWindow<windowSize, seqNumBound>
     {
     public:
-        SpinWindowWithTimer() noexcept = default;
-        SpinWindowWithTimer(int begin) noexcept
+        using Clock = typename TimerWheel<windowSize>::Clock;
+        using TimePoint = typename TimerWheel<windowSize>::TimePoint;
+
+        SpinWindowWithTimer() = default;
+        SpinWindowWithTimer(int begin)
             : SpinWindow<windowSize, seqNumBound>(begin) {}
         virtual ~SpinWindowWithTimer() = default;
 
-        void timerStop(int seq_num)
-        {
-            if (seq_num < 0 || seq_num >= seqNumBound)
-                throw ::std::out_of_range("seq_num out of range");
-            timerArr[seq_num].stop();
-        }
+        // 定时器按槽位编号，序号必须在当前窗口内
+        void timerStop(int seq_num) { wheel.stop(this->slotOfSeq(seq_num)); }
 
-        void timerStopAll()
-        {
-            for (int i = 0; i < seqNumBound; ++i)
-                timerArr[i].stop();
-        }
+        void timerStopAll() noexcept { wheel.clear(Clock::now()); }
 
         void clear() noexcept
         {
@@ -175,33 +222,33 @@ namespace my
             timerStopAll();
         }
 
-        void timerSetTimeout(int seq_num, int milliseconds)
+        void timerSetTimeout(int seq_num, int milliseconds, TimePoint now)
         {
-            if (seq_num < 0 || seq_num >= seqNumBound)
-                throw ::std::out_of_range("seq_num out of range");
-            timerArr[seq_num].setTimeout(milliseconds);
+            wheel.set(this->slotOfSeq(seq_num), milliseconds, now);
         }
 
-        bool timerIsTimeout(int seq_num)
-        {
-            if (seq_num < 0 || seq_num >= seqNumBound)
-                throw ::std::out_of_range("seq_num out of range");
-            return timerArr[seq_num].isTimeout();
-        }
+        void timerSetTimeout(int seq_num, int milliseconds) { timerSetTimeout(seq_num, milliseconds, Clock::now()); }
+
+        bool timerIsRunning(int seq_num) const { return wheel.isRunning(this->slotOfSeq(seq_num)); }
+
+        // 最早到期的定时器的截止时刻，没有定时器时为 TimePoint::max()
+        TimePoint timerNextDeadline() const noexcept { return wheel.nextDeadline(); }
 
-        int whichTimerIsTimeout()
+        // 返回截至 now 到期的全部序号，这些定时器随之停止
+        const ::std::vector<int> &collectTimeout(TimePoint now)
         {
-            for (int i = 0; i < seqNumBound; ++i)
-                if (timerArr[i].isTimeout())
-                    return i;
-            return -1;
+            timeoutSeqs.clear();
+            for (int slot : wheel.expire(now))
+                timeoutSeqs.push_back(this->seqOfSlot(slot));
+            return timeoutSeqs;
         }
 
         bool submit(int seq_num)
         {
             if (this->canSubmit(seq_num)) {
-                timerArr[seq_num].stop();
-                this->arr[seq_num] = true;
+                int slot = this->slotOf(this->offsetOf(seq_num));
+                wheel.stop(slot);
+                this->arr[slot] = true;
                 return true;
             }
             return false;
@@ -210,10 +257,9 @@ namespace my
         int spin()
         {
             int ret = 0;
-            while (this->arr[this->begin]) {
-                timerArr[this->begin].stop();
-                this->arr[this->begin] = false;
-                this->begin = (this->begin + 1) % seqNumBound;
+            while (this->arr[this->head]) {
+                wheel.stop(this->head);
+                this->advance();
                 ++ret;
             }
             return ret;
@@ -222,7 +268,8 @@ namespace my
     protected:
         using SpinWindow<windowSize, seqNumBound>::submit;
         using SpinWindow<windowSize, seqNumBound>::spin;
-        Timer timerArr[seqNumBound];
+        TimerWheel<windowSize> wheel;
+        ::std::vector<int> timeoutSeqs;
     };
 } // namespace my
 
@@ -14,15 +14,21 @@ namespace my
         void setTimeout(int milliseconds)
         {
             m_is_running = true;
-            m_bound = std::chrono::system_clock::now() + std::chrono::milliseconds(milliseconds);
+            m_bound = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
         }
 
-        bool isTimeout() { return m_is_running && (std::chrono::system_clock::now() >= m_bound); }
+        bool isTimeout() { return m_is_running && (std::chrono::steady_clock::now() >= m_bound); }
 
         void stop() { m_is_running = false; }
 
+        // 未运行时返回 time_point::max()
+        std::chrono::time_point<std::chrono::steady_clock> getDeadline() const
+        {
+            return m_is_running ? m_bound : std::chrono::time_point<std::chrono::steady_clock>::max();
+        }
+
     private:
-        std::chrono::time_point<std::chrono::system_clock> m_bound;
+        std::chrono::time_point<std::chrono::steady_clock> m_bound;
         bool m_is_running;
     };
 }
@@ -0,0 +1,163 @@
+#ifndef _TIMER_WHEEL_HPP_
+#define _TIMER_WHEEL_HPP_
+
+#include <chrono>
+#include <vector>
+
+namespace my
+{
+    // 基于单调时钟的哈希时间轮，每格 1ms
+    // 定时器以侵入式双向链表挂在对应的格子上，设置与停止均为 O(1)
+    // expire() 只访问自上次调用以来走过的格子，返回全部到期的定时器编号
+    // nextDeadline() 给出最早的截止时刻，供事件循环睡到恰好有定时器到期
+    // 最早的截止时刻随 set() 增量维护，它被停止或到期后从原位置起向后逐格查找，代价只与走过的格数有关
+    template <int capacity>
+        requires(capacity > 0)
+    class TimerWheel
+    {
+    public:
+        using Clock = ::std::chrono::steady_clock;
+        using TimePoint = Clock::time_point;
+        static constexpr int SLOT_COUNT = 1024;
+
+        TimerWheel() : m_nodes(capacity) { clear(Clock::now()); }
+
+        void clear(TimePoint now) noexcept
+        {
+            for (int i = 0; i < SLOT_COUNT; ++i)
+                m_slots[i] = -1;
+            for (int i = 0; i < capacity; ++i)
+                m_nodes[i].running = false;
+            m_origin = now;
+            m_current_tick = 0;
+            m_running = 0;
+            m_earliest_valid = false;
+        }
+
+        bool isRunning(int id) const noexcept { return m_nodes[id].running; }
+
+        void set(int id, int milliseconds, TimePoint now) noexcept
+        {
+            stop(id);
+            // 已走过的格子不会再被访问，过去的截止时间挂到下一个待处理的格子上
+            long long deadline = toTick(now) + milliseconds;
+            if (deadline < m_current_tick)
+                deadline = m_current_tick;
+
+            Node &node = m_nodes[id];
+            node.deadline = deadline;
+            node.running = true;
+            // 失效的 m_earliest 仍是下界，比它更早的新定时器就是最早的
+            if (++m_running == 1 || deadline < m_earliest) {
+                m_earliest = deadline;
+                m_earliest_valid = true;
+            }
+            int &head = m_slots[deadline & (SLOT_COUNT - 1)];
+            node.prev = -1;
+            node.next = head;
+            if (head != -1)
+                m_nodes[head].prev = id;
+            head = id;
+        }
+
+        void stop(int id) noexcept
+        {
+            Node &node = m_nodes[id];
+            if (!node.running)
+                return;
+            if (node.prev != -1)
+                m_nodes[node.prev].next = node.next;
+            else
+                m_slots[node.deadline & (SLOT_COUNT - 1)] = node.next;
+            if (node.next != -1)
+                m_nodes[node.next].prev = node.prev;
+            node.running = false;
+            --m_running;
+            if (node.deadline == m_earliest)
+                m_earliest_valid = false;
+        }
+
+        // 没有定时器在运行时返回 TimePoint::max()
+        TimePoint nextDeadline() const noexcept
+        {
+            if (m_running == 0)
+                return TimePoint::max();
+
+            // 缓存的最早定时器已被停止或到期，从下界起逐格向后找第一个恰在本格到期的定时器
+            // 运行中的定时器都不早于 m_current_tick；走满一圈时每个定时器都已看过一次，取其中最早的
+            if (!m_earliest_valid) {
+                long long first = m_earliest > m_current_tick ? m_earliest : m_current_tick;
+                long long earliest = -1;
+                for (long long tick = first; tick < first + SLOT_COUNT; ++tick) {
+                    for (int id = m_slots[tick & (SLOT_COUNT - 1)]; id != -1; id = m_nodes[id].next) {
+                        if (earliest == -1 || m_nodes[id].deadline < earliest)
+                            earliest = m_nodes[id].deadline;
+                    }
+                    if (earliest == tick)
+                        break;
+                }
+                m_earliest = earliest;
+                m_earliest_valid = true;
+            }
+            return toTimePoint(m_earliest);
+        }
+
+        // 到期的定时器被停止并返回，返回的引用在下次调用前有效
+        const ::std::vector<int> &expire(TimePoint now)
+        {
+            m_expired.clear();
+            long long target = toTick(now);
+            if (target < m_current_tick)
+                return m_expired;
+
+            // 走过整整一圈后每个格子都已访问过，不必重复
+            long long first = m_current_tick;
+            if (target - first >= SLOT_COUNT)
+                first = target - SLOT_COUNT + 1;
+            for (long long tick = first; tick <= target; ++tick) {
+                int id = m_slots[tick & (SLOT_COUNT - 1)];
+                while (id != -1) {
+                    int next = m_nodes[id].next;
+                    // 同一格上可能挂着更晚几圈的定时器
+                    if (m_nodes[id].deadline <= target) {
+                        stop(id);
+                        m_expired.push_back(id);
+                    }
+                    id = next;
+                }
+            }
+            m_current_tick = target + 1;
+            return m_expired;
+        }
+
+    private:
+        struct Node {
+            long long deadline = 0;
+            int prev = -1;
+            int next = -1;
+            bool running = false;
+        };
+
+        long long toTick(TimePoint time_point) const noexcept
+        {
+            return ::std::chrono::duration_cast<::std::chrono::milliseconds>(time_point - m_origin).count();
+        }
+
+        TimePoint toTimePoint(long long tick) const noexcept
+        {
+            return m_origin + ::std::chrono::milliseconds(tick);
+        }
+
+        ::std::vector<Node> m_nodes;
+        int m_slots[SLOT_COUNT];
+        TimePoint m_origin;
+        long long m_current_tick;
+        int m_running;
+        // 运行中定时器的最早截止格，m_earliest_valid 为假时只是下界，需重新查找
+        mutable long long m_earliest = 0;
+        mutable bool m_earliest_valid = false;
+        ::std::vector<int> m_expired;
+    };
+} // namespace my
+
+#endif // _TIMER_WHEEL_HPP_
\ No newline at end of file
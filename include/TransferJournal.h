@@ -0,0 +1,71 @@
+#ifndef _TRANSFER_JOURNAL_H_
+#define _TRANSFER_JOURNAL_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./BlockRanges.h"
+
+namespace my
+{
+    // 接收端的断点续传日志，与目标文件同目录，文件名后加 SUFFIX
+    // 格式: "RDTJ"[uint32 tag][uint32 block_size][位图]，位图第 i 位表示块 i 已写入目标文件
+    // tag 标识发送端的文件版本，续传时与对端当前的文件比对，不一致则从头传输
+    // 位图只增量写回变化的字节，目标文件的数据先于位图落盘，进程中断时已标记的块一定完整
+    class TransferJournal
+    {
+    public:
+        static constexpr ::std::string_view SUFFIX = ".journal";
+        // 每收到这么多块写回一次位图
+        static constexpr int FLUSH_BLOCKS = 256;
+
+        TransferJournal() = default;
+        ~TransferJournal();
+        TransferJournal(const TransferJournal &) = delete;
+        TransferJournal &operator=(const TransferJournal &) = delete;
+
+        static ::std::string pathFor(::std::string_view file_path);
+        static bool isJournal(::std::string_view file_path) noexcept;
+        // 由文件长度与修改时间得到的版本标识，取 31 位，可放进确认号
+        static ::std::uint32_t fileTag(::std::string_view file_path);
+
+        // 打开目标文件已有的日志，不存在或格式不符时返回 false
+        bool load(::std::string_view file_path);
+        // 新建日志，覆盖已有的
+        void create(::std::string_view file_path, ::std::uint32_t tag, int block_size);
+
+        bool isOpen() const noexcept { return m_fs.is_open(); }
+        ::std::uint32_t getTag() const noexcept { return m_tag; }
+        int getBlockSize() const noexcept { return m_block_size; }
+        long long getReceivedCount() const noexcept { return m_received; }
+        // 尚未收到的块，最后一个区间到文件末尾
+        BlockRanges getMissing() const;
+
+        // 返回 true 表示攒够了 FLUSH_BLOCKS 个块，调用方应先让目标文件落盘再 flush()
+        bool markReceived(int block);
+        void flush();
+        void close();
+        // 传输完成后删除日志
+        void remove();
+
+    private:
+        static constexpr char MAGIC[4] = {'R', 'D', 'T', 'J'};
+        static constexpr int HEADER_SIZE = 12;
+
+        ::std::string m_path;
+        ::std::fstream m_fs;
+        ::std::uint32_t m_tag = 0;
+        int m_block_size = 0;
+        ::std::vector<unsigned char> m_bitmap;
+        long long m_received = 0;
+        // 位图中尚未写回的字节范围 [m_dirty_begin, m_dirty_end)
+        ::std::size_t m_dirty_begin = 0;
+        ::std::size_t m_dirty_end = 0;
+        int m_unflushed = 0;
+    };
+} // namespace my
+
+#endif // _TRANSFER_JOURNAL_H_
\ No newline at end of file
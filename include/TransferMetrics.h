@@ -0,0 +1,89 @@
+#ifndef _TRANSFER_METRICS_H_
+#define _TRANSFER_METRICS_H_
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace my
+{
+    // 一个会话的传输指标，收发两端在各自的热路径上只做整数累加，由会话所在线程独占
+    // 计数为累计值，跨多次传输；每次传输另记字节数与用时，用于计算 goodput
+    // 服务端把各会话的指标合并后以 Prometheus 文本格式写出
+    class TransferMetrics
+    {
+    public:
+        using TimePoint = ::std::chrono::steady_clock::time_point;
+
+        enum class Counter {
+            // 发送端：数据帧（含重传与结束帧）、重传、收到的确认帧（含选择确认）、重复确认、超时与快速重传
+            FRAMES_SENT,
+            FRAMES_RETRANSMITTED,
+            ACKS_RECEIVED,
+            DUPLICATE_ACKS,
+            TIMEOUTS,
+            FAST_RETRANSMITS,
+            // 接收端：到达的数据帧、重复的数据帧、校验失败的数据帧、发出的确认帧
+            FRAMES_RECEIVED,
+            DUPLICATE_FRAMES,
+            CORRUPTED_FRAMES,
+            ACKS_SENT,
+            // 两端按设定丢包率模拟丢弃的帧
+            SIMULATED_LOSSES,
+            COUNT,
+        };
+        static constexpr int COUNTER_COUNT = (int)Counter::COUNT;
+
+        // RTT 直方图按 2 的幂分桶，第 i 桶的上界为 RTT_FIRST_BOUND << i 微秒，最后一桶不设上界
+        static constexpr int RTT_BUCKET_COUNT = 16;
+        static constexpr long long RTT_FIRST_BOUND = 64;
+
+        void add(Counter counter, long long count = 1) noexcept { m_counters[(int)counter] += count; }
+        long long get(Counter counter) const noexcept { return m_counters[(int)counter]; }
+        void recordRtt(long long rtt) noexcept;
+
+        void beginTransfer(TimePoint now) noexcept { m_transfer_start = now; }
+        void endTransfer(long long bytes, TimePoint now) noexcept;
+
+        long long getRttBucket(int bucket) const noexcept { return m_rtt_buckets[bucket]; }
+        long long getRttCount() const noexcept { return m_rtt_count; }
+        long long getRttSum() const noexcept { return m_rtt_sum; }
+        // 按直方图估计的分位数，取所在桶的上界，没有样本时为 0，落在最后一桶时为 -1
+        long long getRttQuantile(double q) const noexcept;
+        static long long getRttBound(int bucket) noexcept { return bucket + 1 < RTT_BUCKET_COUNT ? RTT_FIRST_BOUND << bucket : -1; }
+
+        long long getTransfers() const noexcept { return m_transfers; }
+        long long getTransferBytes() const noexcept { return m_transfer_bytes; }
+        long long getTransferMicros() const noexcept { return m_transfer_us; }
+        long long getLastBytes() const noexcept { return m_last_bytes; }
+        long long getLastMicros() const noexcept { return m_last_us; }
+        // 字节每秒，用时为 0 时为 0
+        double getGoodput() const noexcept;
+        double getLastGoodput() const noexcept;
+        // 重传帧占发出数据帧的比例
+        double getRetransmitRatio() const noexcept;
+
+        void merge(const TransferMetrics &other) noexcept;
+        void reset() noexcept { *this = TransferMetrics(); }
+
+        ::std::string toString() const;
+        // 每个计数一个 counter，RTT 为 histogram，名称以 prefix 开头
+        ::std::string toPrometheus(::std::string_view prefix) const;
+
+    private:
+        ::std::array<long long, COUNTER_COUNT> m_counters{};
+        ::std::array<long long, RTT_BUCKET_COUNT> m_rtt_buckets{};
+        long long m_rtt_count = 0;
+        long long m_rtt_sum = 0;
+
+        TimePoint m_transfer_start{};
+        long long m_transfers = 0;
+        long long m_transfer_bytes = 0;
+        long long m_transfer_us = 0;
+        long long m_last_bytes = 0;
+        long long m_last_us = 0;
+    };
+} // namespace my
+
+#endif // _TRANSFER_METRICS_H_
\ No newline at end of file
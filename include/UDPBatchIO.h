@@ -0,0 +1,143 @@
+#ifndef _UDP_BATCH_IO_H_
+#define _UDP_BATCH_IO_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./UDPDataframe.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+namespace my
+{
+    // 批量收发的统计信息，calls 为实际的系统调用次数
+    class UDPBatchStats
+    {
+    public:
+        void record(int batch_size) noexcept;
+        void reset() noexcept;
+
+        long long getCalls() const noexcept { return m_calls; }
+        long long getFrames() const noexcept { return m_frames; }
+        int getMaxBatch() const noexcept { return m_max_batch; }
+        double getAverageBatch() const noexcept;
+        ::std::string toString() const;
+
+    private:
+        long long m_calls = 0;
+        long long m_frames = 0;
+        int m_max_batch = 0;
+    };
+
+    // 将多个数据帧攒成一批，Linux 下用一次 sendmmsg 发出
+    // 数据帧既可以整帧压入，也可以只给出载荷指针，由发送端拼上帧头后分散/聚集发送
+    // Linux 下连续的等长帧再用 UDP_SEGMENT 合成一个数据报交给内核分段，内核不支持时自动退回逐帧发送
+    class UDPBatchSender
+    {
+    public:
+        static constexpr int MAX_BATCH = 64;
+        // 一个 UDP_SEGMENT 数据报最多包含的分段数，与内核的 UDP_MAX_SEGMENTS 一致
+        static constexpr int MAX_SEGMENTS = 64;
+
+        UDPBatchSender();
+        UDPBatchSender(const UDPBatchSender &) = delete;
+        UDPBatchSender &operator=(const UDPBatchSender &) = delete;
+
+        bool isFull() const noexcept { return m_count >= MAX_BATCH; }
+        bool isEmpty() const noexcept { return m_count == 0; }
+        void push(UDPDataframe &&dataframe);
+        void push(SeqNum data_num, const char *payload, int payload_size, char flags = 0);
+        void flush(const Host &host, const Peer &peer_to);
+        void clear() noexcept;
+
+        bool isSegmentationEnabled() const noexcept { return m_segmentation; }
+        void setSegmentationEnabled(bool enabled) noexcept;
+
+        const UDPBatchStats &getStats() const noexcept { return m_stats; }
+        void resetStats() noexcept { m_stats.reset(); }
+
+    private:
+        // frame >= 0 时为 m_frames 中的整帧，否则为 m_headers[i] + payload 两段
+        struct Entry {
+            int frame;
+            const char *payload;
+            int payload_size;
+        };
+
+        ::std::vector<UDPDataframe> m_frames;
+        Entry m_entries[MAX_BATCH];
+        char m_headers[MAX_BATCH][UDPDataframe::HEADER_SIZE];
+        int m_count = 0;
+        bool m_segmentation = false;
+        UDPBatchStats m_stats;
+
+        int entrySize(int index) const noexcept;
+
+#ifdef __linux__
+        mmsghdr m_msgs[MAX_BATCH];
+        // 每条消息的分段数，分段的 iovec 连续存放
+        int m_msg_entries[MAX_BATCH];
+        iovec m_iovs[MAX_BATCH * 2];
+        alignas(cmsghdr) char m_controls[MAX_BATCH][CMSG_SPACE(sizeof(::std::uint16_t))];
+
+        int buildMessages(int first);
+#endif
+    };
+
+    // 接收缓冲，Linux 下用一次 recvmmsg 取走所有已到达的数据报
+    // 开启 UDP_GRO 后一个数据报可能是内核合并的多个等长分段，按分段拆成数据帧
+    // 每个帧拷贝到与其大小相称的缓冲中，缓冲中的帧按到达顺序通过 front()/pop() 逐个取出
+    class UDPBatchReceiver
+    {
+    public:
+        static constexpr int MAX_BATCH = 64;
+        // push() 投递时最多积压的帧数
+        static constexpr int MAX_QUEUED = 16 * MAX_BATCH;
+
+        UDPBatchReceiver() = default;
+        UDPBatchReceiver(const UDPBatchReceiver &) = delete;
+        UDPBatchReceiver &operator=(const UDPBatchReceiver &) = delete;
+
+        int recv(const Host &host, bool wait);
+        // 由分发者投递别处收到的帧，帧缓冲被交换进来，缓冲满时返回 false
+        bool push(UDPDataframe &dataframe, const Peer &peer) noexcept;
+        void recordDelivery(int count) noexcept { m_stats.record(count); }
+
+        bool isEmpty() const noexcept { return m_pos >= m_count; }
+        UDPDataframe &front() noexcept { return m_frames[m_pos]; }
+        const Peer &frontPeer() const noexcept { return m_peers[m_pos]; }
+        void pop() noexcept { ++m_pos; }
+        void clear() noexcept { m_pos = m_count = 0; }
+        void discardStale() noexcept;
+
+        const UDPBatchStats &getStats() const noexcept { return m_stats; }
+        void resetStats() noexcept { m_stats.reset(); }
+        // 内核合并过的数据报数，以及被截断丢弃的数据报数
+        long long getCoalescedCount() const noexcept { return m_coalesced; }
+        long long getTruncatedCount() const noexcept { return m_truncated; }
+
+    private:
+        static constexpr int RAW_SIZE = 1 << 16;
+
+        ::std::vector<UDPDataframe> m_frames;
+        ::std::vector<Peer> m_peers;
+        int m_pos = 0;
+        int m_count = 0;
+        UDPBatchStats m_stats;
+        long long m_coalesced = 0;
+        long long m_truncated = 0;
+
+        // 数据报先收进这里再拆分，首次接收时才分配
+        ::std::unique_ptr<char[]> m_raw;
+        SOCKET m_gro_socket = INVALID_SOCKET;
+
+        void store(const char *data, int size, const sockaddr_in &address);
+        void enableGro(SOCKET socket) noexcept;
+    };
+} // namespace my
+
+#endif // _UDP_BATCH_IO_H_
\ No newline at end of file
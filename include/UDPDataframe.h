@@ -3,10 +3,15 @@
 
 #include "./Entity.hpp"
 
+#include <cstdint>
+
 namespace my
 {
     class UDPFileReader;
 
+    // 线路上的序号为 32 位无符号数，按网络字节序存放
+    using SeqNum = ::std::uint32_t;
+
     class UDPDataframe
     {
     public:
@@ -15,11 +20,32 @@ namespace my
             CMD = 1,
             DATA = 4,
             ACK = 20,
+            SACK = 21,
+            PROBE = 30,
+            PROBE_ACK = 31,
         };
-        static constexpr int MAX_DATA_SIZE = 1024;
-        static constexpr int MAX_SIZE = MAX_DATA_SIZE + 4;
+        // 除 CMD 帧外帧头均为 12 字节，末 4 字节只在 DATA 帧中使用，其余帧置零
+        // DATA 帧:  [type][flags][uint16 data_size][uint32 data_num][uint32 crc32c][data]
+        //           crc32c 覆盖帧头前 8 字节与载荷，flags 带 FIN 的是结束帧，带 COMPRESSED 的载荷为 LZ 压缩后的块
+        // 结束帧载荷: [32 字节整个文件的 Merkle 根][uint64 文件长度]
+        // ACK 帧:   [type][flags][uint16 0][uint32 ack_num][uint32 0]
+        // SACK 帧:  [type][flags][uint16 bitmap_size][uint32 cum_ack][uint32 0][bitmap]
+        //           cum_ack 之前的块均已收到，bitmap 第 i 位表示 cum_ack + 1 + i 是否收到
+        // PROBE 帧: [type][flags][uint16 0][uint32 size][uint32 0][填充]，整帧 size 字节，用于路径 MTU 探测
+        // PROBE_ACK 帧: [type][flags][uint16 0][uint32 size][uint32 0]，size 为收到的探测帧长度
+        static constexpr int HEADER_SIZE = 12;
+        static constexpr char FLAG_FIN = 0x01;
+        static constexpr char FLAG_COMPRESSED = 0x02;
+        static constexpr int FIN_PAYLOAD_SIZE = 40;
+        // 每帧载荷默认 1024 字节，可按传输调大到一个 IPv4 UDP 数据报的上限
+        static constexpr int DEFAULT_DATA_SIZE = 1024;
+        static constexpr int DEFAULT_SIZE = DEFAULT_DATA_SIZE + HEADER_SIZE;
+        static constexpr int MAX_SIZE = 65507;
+        static constexpr int MAX_DATA_SIZE = MAX_SIZE - HEADER_SIZE;
 
         UDPDataframe();
+        // 缓冲至少能容纳 capacity 字节
+        explicit UDPDataframe(int capacity);
         UDPDataframe(const char *buffer, int recv_size);
         UDPDataframe(const UDPDataframe &);
         UDPDataframe(UDPDataframe &&) noexcept;
@@ -27,43 +53,72 @@ namespace my
         UDPDataframe &operator=(UDPDataframe &&) noexcept;
         ~UDPDataframe();
 
+        int getCapacity() const noexcept { return m_capacity; }
+        // 拷贝整个帧，缓冲按 size 重新选取大小
+        void assign(const char *buffer, int size);
+
         void setType(Type type);
         bool isValid() const noexcept;
         bool isAck() const noexcept;
-        bool isAck(char ack_num) const noexcept;
+        bool isAck(SeqNum ack_num) const noexcept;
         bool isData() const noexcept;
         bool isCmd() const noexcept;
+        bool isSack() const noexcept;
+        bool isProbe() const noexcept;
+        bool isProbeAck() const noexcept;
+        bool isFin() const noexcept;
+        bool isCompressed() const noexcept;
+        // 非 DATA 帧总是返回 true
+        bool verifyChecksum() const noexcept;
 
         const char *data(int &data_size) const;
         const char *cmd() const;
-        char getDataNum() const;
-        void setDataNum(char data_num);
-        char getAckNum() const;
-        void setAckNum(char ack_num);
+        SeqNum getDataNum() const;
+        void setDataNum(SeqNum data_num);
+        SeqNum getAckNum() const;
+        void setAckNum(SeqNum ack_num);
+        const unsigned char *sackBitmap(int &bitmap_size) const;
+        // PROBE 帧返回实际收到的长度，PROBE_ACK 帧返回被确认的长度
+        int getProbeSize() const;
+
+        // payload 用于计算校验和，须已是最终内容
+        static void makeDataHeader(char *header, SeqNum data_num, const char *payload, int data_size, char flags = 0) noexcept;
 
-        friend UDPDataframe UDPAck(char ack_num);
-        friend UDPDataframe UDPData(char data_num, const char *data, int data_size);
+        friend UDPDataframe UDPAck(SeqNum ack_num);
+        friend UDPDataframe UDPData(SeqNum data_num, const char *data, int data_size, char flags);
         friend UDPDataframe UDPCmd(::std::string_view cmd);
+        friend UDPDataframe UDPSack(SeqNum cum_ack, const unsigned char *bitmap, int bitmap_size);
+        friend UDPDataframe UDPProbe(int size);
+        friend UDPDataframe UDPProbeAck(int size);
         friend UDPDataframe recvUDPDataframeFrom(const Host &host, Peer &peer_from);
         friend void sendUDPDataframeTo(const UDPDataframe &dataframe, const Host &host, const Peer &peer_to);
+        friend bool sendProbeTo(int size, const Host &host, const Peer &peer_to);
         // friend class UDPFileReaderIterator;
         friend class UDPFileReader;
+        friend class UDPBatchSender;
+        friend class UDPBatchReceiver;
 
     private:
         char *m_data;
         int m_size;
+        int m_capacity;
     };
 
-    UDPDataframe UDPAck(char ack_num);
-    UDPDataframe UDPData(char data_num, const char *data, int data_size);
+    UDPDataframe UDPAck(SeqNum ack_num);
+    UDPDataframe UDPData(SeqNum data_num, const char *data, int data_size, char flags = 0);
     UDPDataframe UDPCmd(::std::string_view cmd);
+    UDPDataframe UDPSack(SeqNum cum_ack, const unsigned char *bitmap, int bitmap_size);
+    UDPDataframe UDPProbe(int size);
+    UDPDataframe UDPProbeAck(int size);
 
     UDPDataframe recvUDPDataframeFrom(const Host &host, Peer &peer_from);
     void sendUDPDataframeTo(const UDPDataframe &dataframe, const Host &host, const Peer &peer_to);
-    char recvAckFrom(const Host &host, Peer &peer_from);
-    void sendAckTo(char ack_num, const Host &host, const Peer &peer_to);
+    SeqNum recvAckFrom(const Host &host, Peer &peer_from);
+    void sendAckTo(SeqNum ack_num, const Host &host, const Peer &peer_to);
     ::std::string recvCmdFrom(const Host &host, Peer &peer_from);
     void sendCmdTo(::std::string_view cmd, const Host &host, const Peer &peer_to);
+    // 探测帧超过接口 MTU 而被拒绝属于预期情况，失败时不抛出异常，返回 false，错误码留给 WSAGetLastError()
+    bool sendProbeTo(int size, const Host &host, const Peer &peer_to);
 } // namespace my
 
 #endif // _UDP_DATAFRAME_H_
\ No newline at end of file
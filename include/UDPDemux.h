@@ -0,0 +1,77 @@
+#ifndef _UDP_DEMUX_H_
+#define _UDP_DEMUX_H_
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "./CoScheduler.h"
+#include "./UDPBatchIO.h"
+
+namespace my
+{
+    // 单个 socket 上的按对端分发
+    // 分发协程是 socket 唯一的读者，收到的帧按来源地址投递到各会话自己的接收缓冲
+    // 会话不直接读 socket，而是通过 waitFrames() 等待分发协程投递
+    class UDPDemux
+    {
+    public:
+        using TimePoint = CoScheduler::TimePoint;
+        // 未注册的对端发来命令帧时调用，返回 true 表示已为其注册接收缓冲
+        using AcceptHandler = ::std::function<bool(const UDPDataframe &, const Peer &)>;
+
+        explicit UDPDemux(const Host &host) : m_host(host) {}
+        UDPDemux(const UDPDemux &) = delete;
+        UDPDemux &operator=(const UDPDemux &) = delete;
+
+        static unsigned long long keyOf(const Peer &peer) noexcept;
+
+        void attach(const Peer &peer, UDPBatchReceiver &inbox);
+        void detach(const Peer &peer) noexcept;
+        int getRouteCount() const noexcept { return (int)m_routes.size(); }
+
+        // 挂起 handle 直到有帧投递给 peer 或到达 deadline，恢复前把是否有投递写入 *delivered
+        void waitFrames(const Peer &peer, TimePoint deadline, ::std::coroutine_handle<> handle, bool *delivered);
+
+        // 持续接收并分发，须在调度器中运行
+        CoTask co_run(AcceptHandler on_new_peer);
+
+        const UDPBatchStats &getStats() const noexcept { return m_inbox.getStats(); }
+        long long getDroppedCount() const noexcept { return m_dropped; }
+        long long getProbesAnsweredCount() const noexcept { return m_probes_answered; }
+
+    private:
+        struct Route {
+            UDPBatchReceiver *inbox;
+            CoScheduler::WaitToken waiter{};
+            bool waiting = false;
+            int delivered = 0;
+        };
+
+        class ReadableAwaiter
+        {
+        public:
+            explicit ReadableAwaiter(SOCKET socket) noexcept : m_socket(socket) {}
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(::std::coroutine_handle<> handle);
+            bool await_resume() const noexcept { return m_readable; }
+
+        private:
+            SOCKET m_socket;
+            bool m_readable = false;
+        };
+
+        Host m_host;
+        UDPBatchReceiver m_inbox;
+        ::std::unordered_map<unsigned long long, Route> m_routes;
+        // 本批中收到帧的对端，批次处理完后统一唤醒
+        ::std::vector<unsigned long long> m_touched;
+        long long m_dropped = 0;
+        long long m_probes_answered = 0;
+
+        void dispatch(const AcceptHandler &on_new_peer);
+    };
+} // namespace my
+
+#endif // _UDP_DEMUX_H_
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <string_view>
 
+#include "./BlockRanges.h"
 #include "./UDPDataframe.h"
 
 namespace my
@@ -16,20 +17,54 @@ namespace my
         // friend class UDPFileReaderIterator;
         // using iterator = UDPFileReaderIterator;
 
-        UDPFileReader(::std::string_view filename);
+        // MAPPED: 将整个文件映射到内存，数据块即映射中的一段，不再拷贝
+        // STREAM: 每次以 ifstream 读出数据块
+        enum class Mode {
+            STREAM,
+            MAPPED,
+        };
+
+        UDPFileReader(::std::string_view filename, Mode mode = Mode::MAPPED, int block_size = UDPDataframe::DEFAULT_DATA_SIZE);
         ~UDPFileReader();
+        UDPFileReader(const UDPFileReader &) = delete;
+        UDPFileReader &operator=(const UDPFileReader &) = delete;
 
         void close();
         int getBlockCount();
+        int getBlockSize() const noexcept { return m_block_size; }
+        long long getFileSize() const noexcept { return m_file_size; }
+        // 只读出给定区间内的块，此后的块号均为区间内的序号，getBlockCount() 随之变化
+        void selectBlocks(BlockRanges ranges);
+        // 选出的块的总字节数，未选择时即文件长度
+        long long getSelectedSize() const noexcept;
+        bool isMapped() const noexcept { return m_mode == Mode::MAPPED; }
+        int getBlock(int block_num, const char *&data);
         UDPDataframe getDataframe(int block_num);
 
         // iterator begin();
         // iterator end();
 
     private:
+        Mode m_mode;
         ::std::ifstream m_ifs;
-        int m_file_size;
+        long long m_file_size;
+        int m_block_size;
         int m_block_count;
+        BlockRanges m_ranges;
+        int m_file_block_count;
+
+        const char *m_map = nullptr;
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+
+        bool map(::std::string_view filename);
+        void unmap() noexcept;
+        int toFileBlock(int block_num) const noexcept;
+        int getBlockSize(int file_block) const noexcept;
     };
 
     // class UDPFileReaderIterator
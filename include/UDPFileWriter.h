@@ -11,14 +11,48 @@ namespace my
     class UDPFileWriter
     {
     public:
-        UDPFileWriter(::std::string_view filename);
+        // APPEND: 按顺序追加写入，数据帧须按块号顺序到达
+        // POSITIONAL: 每个数据块直接写到其最终偏移处，可乱序写入
+        //             文件按块预先分配空间，关闭时截断到实际长度
+        enum class Mode {
+            APPEND,
+            POSITIONAL,
+        };
+        static constexpr long long PREALLOCATE_SIZE = 1 << 24;
+
+        // block_size 为除最后一块外每块的字节数，POSITIONAL 模式据此计算偏移
+        // truncate 为 false 时保留已有内容，用于断点续传，仅 POSITIONAL 模式支持
+        UDPFileWriter(::std::string_view filename, Mode mode = Mode::APPEND, int block_size = UDPDataframe::DEFAULT_DATA_SIZE, bool truncate = true);
         ~UDPFileWriter();
+        UDPFileWriter(const UDPFileWriter &) = delete;
+        UDPFileWriter &operator=(const UDPFileWriter &) = delete;
 
         void append(const UDPDataframe &dataframe);
+        void append(const char *data, int data_size);
+        void writeAt(int block_num, const UDPDataframe &dataframe);
+        void writeAt(int block_num, const char *data, int data_size);
+        bool isPositional() const noexcept { return m_mode == Mode::POSITIONAL; }
+        // 已写入的数据交给内核，之后进程中断也不会丢失
+        void flush();
+        // 关闭时截断到的长度，续传时本次写入的块不一定包含文件末尾
+        void setFileSize(long long size) noexcept;
         void close();
 
     private:
+        Mode m_mode;
+        int m_block_size;
         ::std::ofstream m_ofs;
+
+        // 以下仅用于 POSITIONAL 模式
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+#endif
+        long long m_file_size = 0;
+        long long m_allocated_size = 0;
+
+        void preallocate(long long size);
     };
 } // namespace my
 
@@ -0,0 +1,34 @@
+#ifndef _UDP_FRAME_POOL_H_
+#define _UDP_FRAME_POOL_H_
+
+#include "./UDPDataframe.h"
+
+namespace my
+{
+    // 每线程一个的数据帧缓冲池
+    // 释放的缓冲以侵入式链表挂在空闲链上，再次申请时直接复用，不再访问堆
+    // 缓冲按大小分级，默认大小的帧独占一级，更大的帧按 2 的幂取整，最大一级可容纳 64 KB 的 UDP 数据报
+    class UDPFramePool
+    {
+    public:
+        static constexpr int CLASS_COUNT = 7;
+        static constexpr int MAX_FREE_COUNT = 4096;
+
+        UDPFramePool() = delete;
+
+        // 返回至少可容纳 size 字节（另留 1 字节结尾）的缓冲
+        static char *acquire(int size = UDPDataframe::DEFAULT_SIZE);
+        // capacity 须为 capacityOf() 的返回值
+        static void release(char *buffer, int capacity) noexcept;
+        static void reserve(int count, int size = UDPDataframe::DEFAULT_SIZE);
+        // 为 size 字节分配的缓冲的实际容量
+        static int capacityOf(int size) noexcept;
+
+        // 以下计数均为本线程的累计值
+        static long long getAllocCount() noexcept;
+        static long long getAcquireCount() noexcept;
+        static int getFreeCount() noexcept;
+    };
+} // namespace my
+
+#endif // _UDP_FRAME_POOL_H_
\ No newline at end of file
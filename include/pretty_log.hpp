@@ -5,10 +5,10 @@
 #include <mutex>
 #include <string>
 
+#include "./AsyncLogger.hpp"
+
 namespace my
 {
-    inline std::mutex g_log_mutex;
-
     class pretty_wapper
     {
     public:
@@ -16,6 +16,8 @@ namespace my
         {
             valid = true;
             m_is_first = true;
+            // 先写出此前延迟的日志，保持先后顺序
+            AsyncLogger::drain();
             g_log_mutex.lock();
         }
 
@@ -82,6 +84,13 @@ namespace my
             return ::std::move(pretty_wapper(m_os, m_prefix) << t);
         }
 
+        // 交给后台线程格式化并写出，热路径上不加锁、不 flush，一般经由 PRETTY_TRACE / PRETTY_DEBUG 调用
+        template <typename... Args>
+        void defer(const char *fmt, const Args &...args)
+        {
+            AsyncLogger::push(m_os, m_prefix, fmt, args...);
+        }
+
     private:
         ::std::ostream &m_os;
         ::std::string m_prefix;
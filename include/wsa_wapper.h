@@ -1,13 +1,49 @@
 #ifndef _WSA_WRAPPER_H_INCLUDED_
 #define _WSA_WRAPPER_H_INCLUDED_
 
+#ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 在非 Windows 平台上以 BSD socket 模拟所用到的 Winsock 接口
+using SOCKET = int;
+using SOCKADDR = sockaddr;
+using SOCKADDR_IN = sockaddr_in;
+using TIMEVAL = timeval;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define WSAEMSGSIZE EMSGSIZE
+
+inline int closesocket(SOCKET s) { return close(s); }
+inline int WSAGetLastError() { return errno; }
+#endif
 
 namespace my
 {
     extern bool wsa_initialized;
     bool init_wsa();
     bool cleanup_wsa();
+
+    // 大块数据帧一个窗口就有数 MB，默认的 socket 缓冲放不下，按 bytes 扩大收发缓冲
+    // 实际大小受系统上限约束，设置失败不影响正确性
+    constexpr int SOCKET_BUFFER_SIZE = 1 << 22;
+    bool set_socket_buffers(SOCKET s, int bytes = SOCKET_BUFFER_SIZE);
+
+    // 创建绑定到 127.0.0.1:port 的 UDP socket，port 为 0 时由系统分配，并扩大收发缓冲
+    // reuse_port 时置 SO_REUSEPORT，多个 socket 共用同一端口；失败时抛出异常
+    SOCKET create_udp_socket(unsigned short port, bool reuse_port = false);
+
+    // 路径 MTU 探测期间置 DF 位，超过本机接口 MTU 的数据报在发送时即失败而不是被分片
+    // 关闭后恢复系统默认行为，平台不支持时返回 false
+    bool set_dont_fragment(SOCKET s, bool enable);
 } // namespace my
 
 #endif // _WSA_WRAPPER_H_INCLUDED_
\ No newline at end of file
@@ -1,7 +1,158 @@
 #include "../include/BasicRole.h"
+#include "../include/wsa_wapper.h"
 
-::std::random_device my::BasicRole::m_device;
-::std::mt19937 my::BasicRole::m_engine(m_device());
-::std::uniform_real_distribution<float> my::BasicRole::m_distribution(0.0f, 1.0f);
+thread_local ::std::random_device my::BasicRole::m_device;
+thread_local ::std::mt19937 my::BasicRole::m_engine(m_device());
+thread_local ::std::uniform_real_distribution<float> my::BasicRole::m_distribution(0.0f, 1.0f);
 
-::my::BasicRole::~BasicRole() {}
+::my::BasicRole::~BasicRole()
+{
+    detachDemux();
+}
+
+void my::BasicRole::attachDemux(UDPDemux &demux)
+{
+    demux.attach(m_peer, m_inbox);
+    m_demux = &demux;
+}
+
+void my::BasicRole::detachDemux() noexcept
+{
+    if (m_demux != nullptr) {
+        m_demux->detach(m_peer);
+        m_demux = nullptr;
+    }
+}
+
+bool my::BasicRole::waitFramesUntil(Reactor::TimePoint deadline)
+{
+    if (!m_inbox.isEmpty()) {
+        return true;
+    }
+    if (m_demux != nullptr) {
+        pretty_out << "throw from BasicRole::waitFramesUntil(): Blocking wait on a demultiplexed socket";
+        throw std::runtime_error("Blocking wait on a demultiplexed socket");
+    }
+    ++m_wait_count;
+    if (m_reactor.wait(m_host.getSocket(), deadline) == Reactor::Event::TIMEOUT) {
+        ++m_wait_timeout_count;
+        return false;
+    }
+    return m_inbox.recv(m_host, false) > 0;
+}
+
+void my::BasicRole::FramesAwaiter::await_suspend(::std::coroutine_handle<> handle)
+{
+    CoScheduler *scheduler = CoScheduler::current();
+    if (scheduler == nullptr) {
+        pretty_out << "throw from BasicRole::FramesAwaiter::await_suspend(): No scheduler running on this thread";
+        throw std::runtime_error("No scheduler running on this thread");
+    }
+    if (m_role.m_demux != nullptr) {
+        m_role.m_demux->waitFrames(m_role.m_peer, m_deadline, handle, &m_readable);
+    } else {
+        scheduler->waitReadable(m_role.m_host.getSocket(), m_deadline, handle, &m_readable);
+    }
+    m_suspended = true;
+    ++m_role.m_wait_count;
+}
+
+bool my::BasicRole::FramesAwaiter::await_resume()
+{
+    if (!m_role.m_inbox.isEmpty()) {
+        return true;
+    }
+    if (m_suspended && !m_readable) {
+        ++m_role.m_wait_timeout_count;
+        return false;
+    }
+    if (m_role.m_demux != nullptr) {
+        return false;
+    }
+    return m_role.m_inbox.recv(m_role.m_host, false) > 0;
+}
+
+void my::BasicRole::probePathMtu()
+{
+    if (!m_pmtu.isEnabled() || m_pmtu_peer != m_peer) {
+        m_pmtu.setEnabled(true);
+        m_pmtu.restart();
+        m_pmtu_peer = m_peer;
+    }
+    auto now = PathMtuProber::Clock::now();
+    if (!m_pmtu.isSearching() && !m_pmtu.isReprobeDue(now)) {
+        return;
+    }
+
+    do {
+        if (!m_pmtu.isRoundPending()) {
+            sendPathMtuProbes(m_pmtu.startRound(now));
+        }
+        while (!m_pmtu.isRoundDone(now)) {
+            waitFramesUntil(m_pmtu.getRoundDeadline());
+            for (; !m_inbox.isEmpty(); m_inbox.pop()) {
+                takeProbeFrame(m_inbox.front(), m_inbox.frontPeer());
+            }
+            now = PathMtuProber::Clock::now();
+        }
+        m_pmtu.finishRound(now);
+    } while (m_pmtu.isSearching());
+
+    pretty_log << ::std::format("Path MTU to {}: {}", m_peer.toString(), m_pmtu.toString());
+}
+
+void my::BasicRole::pollPathMtu(PathMtuProber::TimePoint now)
+{
+    if (!m_pmtu.isEnabled() || m_pmtu_peer != m_peer) {
+        return;
+    }
+    if (m_pmtu.isRoundPending()) {
+        if (!m_pmtu.isRoundDone(now)) {
+            return;
+        }
+        m_pmtu.finishRound(now);
+        if (!m_pmtu.isSearching()) {
+            pretty_log << ::std::format("Path MTU to {}: {}, applies from the next transfer", m_peer.toString(), m_pmtu.toString());
+            return;
+        }
+    } else if (!m_pmtu.isSearching() && !m_pmtu.isReprobeDue(now)) {
+        return;
+    }
+    sendPathMtuProbes(m_pmtu.startRound(now));
+}
+
+bool my::BasicRole::takeProbeFrame(const UDPDataframe &frame, const Peer &from)
+{
+    if (frame.isProbe()) {
+        sendUDPDataframeTo(UDPProbeAck(frame.getProbeSize()), m_host, from);
+        return true;
+    }
+    if (frame.isProbeAck()) {
+        if (m_pmtu.isEnabled() && from == m_peer) {
+            m_pmtu.onAck(frame.getProbeSize(), PathMtuProber::Clock::now());
+        }
+        return true;
+    }
+    return false;
+}
+
+// 每个大小发两份，单个探测帧的偶然丢失不至于压低结果
+void my::BasicRole::sendPathMtuProbes(const ::std::vector<int> &sizes)
+{
+    constexpr int PROBE_COPIES = 2;
+
+    set_dont_fragment(m_host.getSocket(), true);
+    for (int size : sizes) {
+        for (int copy = 0; copy < PROBE_COPIES; ++copy) {
+            if (sendProbeTo(size, m_host, m_peer)) {
+                continue;
+            }
+            // 超过本机接口 MTU，不必等待确认
+            if (WSAGetLastError() == WSAEMSGSIZE) {
+                m_pmtu.onTooBig(size);
+            }
+            break;
+        }
+    }
+    set_dont_fragment(m_host.getSocket(), false);
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <format>
+#include <thread>
+
+#include "../include/BlockCompressor.h"
+#include "../include/LzCodec.h"
+
+::std::string my::BlockCompressor::Stats::toString() const
+{
+    return ::std::format("{} of {} byte(s) on the wire ({:.2f}x), {} block(s) compressed, {} sent as is",
+                         wire_bytes, raw_bytes, wire_bytes > 0 ? (double)raw_bytes / wire_bytes : 1.0, compressed_blocks, bypassed_blocks);
+}
+
+my::BlockCompressor::BlockCompressor(::std::string_view filename, int block_size, BlockRanges ranges, int retain_blocks, int thread_count)
+    : m_reader(filename, UDPFileReader::Mode::MAPPED, block_size), m_retain_blocks(retain_blocks)
+{
+    if (!ranges.isAll()) {
+        m_reader.selectBlocks(::std::move(ranges));
+    }
+    m_block_count = m_reader.getBlockCount();
+    m_chunk_blocks = ::std::max(1, CHUNK_SIZE / block_size);
+    m_chunk_count = (m_block_count + m_chunk_blocks - 1) / m_chunk_blocks;
+    if (thread_count <= 0) {
+        thread_count = (int)::std::max(1u, ::std::thread::hardware_concurrency());
+    }
+    // 至少提前一段，发送当前段时下一段已在压缩
+    m_lookahead = ::std::max(2, thread_count);
+    m_counted.assign(m_chunk_count, false);
+    if (isEnabled()) {
+        for (int chunk = 0; chunk < m_lookahead; ++chunk) {
+            schedule(chunk);
+        }
+    }
+}
+
+// 先等所有压缩任务结束，再释放映射
+my::BlockCompressor::~BlockCompressor()
+{
+    m_slots.clear();
+}
+
+bool my::BlockCompressor::getBlock(int block_num, const char *&payload, int &size)
+{
+    if (!isEnabled() || block_num < 0 || block_num >= m_block_count) {
+        return false;
+    }
+    int chunk = block_num / m_chunk_blocks;
+    if (block_num > m_max_block) {
+        m_max_block = block_num;
+        while (!m_slots.empty() && (long long)(m_slots.begin()->first + 1) * m_chunk_blocks <= (long long)m_max_block - m_retain_blocks) {
+            m_slots.erase(m_slots.begin());
+        }
+        for (int next = chunk + 1; next <= chunk + m_lookahead; ++next) {
+            schedule(next);
+        }
+    }
+
+    Chunk &encoded = acquire(chunk);
+    int index = block_num - chunk * m_chunk_blocks;
+    if (encoded.sizes[index] == 0) {
+        return false;
+    }
+    payload = encoded.data.data() + encoded.offsets[index];
+    size = encoded.sizes[index];
+    return true;
+}
+
+// 在工作线程上运行，只读访问映射
+my::BlockCompressor::Chunk my::BlockCompressor::encode(int chunk)
+{
+    int first = chunk * m_chunk_blocks;
+    int last = ::std::min(first + m_chunk_blocks, m_block_count);
+    Chunk encoded;
+    encoded.offsets.assign(last - first, 0);
+    encoded.sizes.assign(last - first, 0);
+
+    for (int block = first; block < last; ++block) {
+        const char *data;
+        int size = m_reader.getBlock(block, data);
+        encoded.raw_bytes += size;
+
+        int offset = (int)encoded.data.size();
+        encoded.data.resize(offset + size);
+        int compressed = lzCompress(data, size, encoded.data.data() + offset, size - (size >> MIN_SAVING_SHIFT));
+        encoded.data.resize(offset + compressed);
+        encoded.wire_bytes += compressed > 0 ? compressed : size;
+        if (compressed == 0 && block == first) {
+            // 试压的第一块压不动，其余块也按原样发送
+            for (++block; block < last; ++block) {
+                size = m_reader.getBlock(block, data);
+                encoded.raw_bytes += size;
+                encoded.wire_bytes += size;
+            }
+            break;
+        }
+        encoded.offsets[block - first] = offset;
+        encoded.sizes[block - first] = compressed;
+    }
+    return encoded;
+}
+
+void my::BlockCompressor::schedule(int chunk)
+{
+    if (chunk >= m_chunk_count || m_slots.contains(chunk)) {
+        return;
+    }
+    m_slots[chunk].future = ::std::async(::std::launch::async, &BlockCompressor::encode, this, chunk);
+}
+
+// 已释放的段被再次请求时重新压缩，统计只计第一次
+my::BlockCompressor::Chunk &my::BlockCompressor::acquire(int chunk)
+{
+    schedule(chunk);
+    Slot &slot = m_slots.at(chunk);
+    if (!slot.ready) {
+        slot.chunk = slot.future.get();
+        slot.ready = true;
+        if (!m_counted[chunk]) {
+            m_counted[chunk] = true;
+            m_stats.raw_bytes += slot.chunk.raw_bytes;
+            m_stats.wire_bytes += slot.chunk.wire_bytes;
+            for (int size : slot.chunk.sizes) {
+                ++(size > 0 ? m_stats.compressed_blocks : m_stats.bypassed_blocks);
+            }
+        }
+    }
+    return slot.chunk;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <charconv>
+#include <format>
+
+#include "../include/BlockRanges.h"
+#include "../include/pretty_log.hpp"
+
+bool my::BlockRanges::isAll() const noexcept
+{
+    return m_all;
+}
+
+void my::BlockRanges::add(int begin, int end)
+{
+    if (begin < 0 || begin >= end || (!m_ranges.empty() && begin < m_ranges.back().second)) {
+        pretty_out << ::std::format("throw from BlockRanges::add(): Invalid range, begin = {0}, end = {1}", begin, end);
+        throw std::runtime_error("Invalid range");
+    }
+    m_all = false;
+    m_offsets.push_back(m_ranges.empty() ? 0 : m_offsets.back() + (m_ranges.back().second - m_ranges.back().first));
+    m_ranges.emplace_back(begin, end);
+}
+
+int my::BlockRanges::clip(int block_count)
+{
+    if (m_all) {
+        return block_count;
+    }
+    while (!m_ranges.empty() && m_ranges.back().first >= block_count) {
+        m_ranges.pop_back();
+        m_offsets.pop_back();
+    }
+    if (m_ranges.empty()) {
+        return 0;
+    }
+    m_ranges.back().second = ::std::min(m_ranges.back().second, block_count);
+    return (int)(m_offsets.back() + (m_ranges.back().second - m_ranges.back().first));
+}
+
+int my::BlockRanges::map(int position) const noexcept
+{
+    if (m_all) {
+        return position;
+    }
+    auto it = ::std::upper_bound(m_offsets.begin(), m_offsets.end(), (long long)position);
+    if (it == m_offsets.begin()) {
+        return -1;
+    }
+    int i = (int)(it - m_offsets.begin()) - 1;
+    long long block = m_ranges[i].first + (position - m_offsets[i]);
+    return block < m_ranges[i].second ? (int)block : -1;
+}
+
+::std::string my::BlockRanges::format(const ::std::vector<::std::pair<int, int>> &ranges)
+{
+    ::std::string text;
+    for (const auto &[begin, end] : ranges) {
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += ::std::to_string(begin);
+        if (end == END) {
+            text += '-';
+        } else if (end - begin > 1) {
+            text += '-' + ::std::to_string(end - 1);
+        }
+    }
+    return text;
+}
+
+// 合并的间隔越大文本越短，二分出能放下的最小间隔
+::std::string my::BlockRanges::toString(int max_size) const
+{
+    if (m_all) {
+        return "0-";
+    }
+    ::std::string text = format(m_ranges);
+    if ((int)text.size() <= max_size) {
+        return text;
+    }
+
+    ::std::vector<int> gaps;
+    for (::std::size_t i = 1; i < m_ranges.size(); ++i) {
+        gaps.push_back(m_ranges[i].first - m_ranges[i - 1].second);
+    }
+    ::std::sort(gaps.begin(), gaps.end());
+    gaps.erase(::std::unique(gaps.begin(), gaps.end()), gaps.end());
+
+    auto merge = [&](int max_gap) {
+        ::std::vector<::std::pair<int, int>> merged;
+        for (const auto &range : m_ranges) {
+            if (!merged.empty() && range.first - merged.back().second <= max_gap) {
+                merged.back().second = range.second;
+            } else {
+                merged.push_back(range);
+            }
+        }
+        return format(merged);
+    };
+    int low = 0, high = (int)gaps.size() - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if ((int)merge(gaps[mid]).size() <= max_size) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return merge(gaps[low]);
+}
+
+bool my::BlockRanges::parse(::std::string_view text, BlockRanges &ranges)
+{
+    BlockRanges result;
+    result.m_all = false;
+    while (!text.empty()) {
+        ::std::string_view item = text.substr(0, text.find(','));
+        text.remove_prefix(::std::min(text.size(), item.size() + 1));
+
+        int begin, last;
+        auto [ptr, ec] = ::std::from_chars(item.data(), item.data() + item.size(), begin);
+        if (ec != ::std::errc() || begin < 0 || begin == END) {
+            return false;
+        }
+        int end = begin + 1;
+        if (ptr != item.data() + item.size()) {
+            if (*ptr++ != '-') {
+                return false;
+            }
+            if (ptr == item.data() + item.size()) {
+                end = END;
+            } else {
+                auto [last_ptr, last_ec] = ::std::from_chars(ptr, item.data() + item.size(), last);
+                if (last_ec != ::std::errc() || last_ptr != item.data() + item.size() || last < begin || last == END) {
+                    return false;
+                }
+                end = last + 1;
+            }
+        }
+        if (!result.m_ranges.empty() && begin < result.m_ranges.back().second) {
+            return false;
+        }
+        result.add(begin, end);
+    }
+    ranges = ::std::move(result);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "../include/CoScheduler.h"
+#include "../include/pretty_log.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace
+{
+    thread_local ::my::CoScheduler *t_current = nullptr;
+
+    // run() 期间把调度器设为当前线程的调度器，结束时恢复
+    class CurrentGuard
+    {
+    public:
+        explicit CurrentGuard(::my::CoScheduler *scheduler) noexcept : m_previous(t_current) { t_current = scheduler; }
+        ~CurrentGuard() { t_current = m_previous; }
+
+    private:
+        ::my::CoScheduler *m_previous;
+    };
+} // namespace
+
+#ifdef __linux__
+
+my::CoScheduler::CoScheduler()
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd == -1 || m_timer_fd == -1 || m_event_fd == -1) {
+        pretty_out << ::std::format("throw from CoScheduler::CoScheduler(): epoll_create1(), timerfd_create() or eventfd() failed, errno = {0}", errno);
+        throw std::runtime_error("epoll_create1(), timerfd_create() or eventfd() failed");
+    }
+
+    for (int fd : {m_timer_fd, m_event_fd}) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            pretty_out << ::std::format("throw from CoScheduler::CoScheduler(): epoll_ctl() failed, errno = {0}", errno);
+            throw std::runtime_error("epoll_ctl() failed");
+        }
+    }
+}
+
+my::CoScheduler::~CoScheduler()
+{
+    ::close(m_event_fd);
+    ::close(m_timer_fd);
+    ::close(m_epoll_fd);
+}
+
+void my::CoScheduler::post(WaitToken token)
+{
+    {
+        ::std::lock_guard<::std::mutex> lock(m_posted_mutex);
+        m_posted.push_back(token);
+    }
+    unsigned long long one = 1;
+    (void)!::write(m_event_fd, &one, sizeof(one));
+}
+
+// 只在最近的截止时刻变化时才重设定时器
+void my::CoScheduler::armTimer(TimePoint deadline)
+{
+    if (deadline == m_timer_deadline) {
+        return;
+    }
+    itimerspec spec = {};
+    if (deadline != TimePoint::max()) {
+        long long ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        ns = ::std::max(ns, 1LL);
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    if (timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        pretty_out << ::std::format("throw from CoScheduler::armTimer(): timerfd_settime() failed, errno = {0}", errno);
+        throw std::runtime_error("timerfd_settime() failed");
+    }
+    m_timer_deadline = deadline;
+}
+
+void my::CoScheduler::waitReadable(SOCKET socket, TimePoint deadline, ::std::coroutine_handle<> handle, bool *readable)
+{
+    auto it = m_socket_waiters.try_emplace(socket).first;
+    if (it->second.empty()) {
+        // 水平触发，socket 一直注册到某次可读时没有协程在等待为止
+        // socket 关闭后会被 epoll 自动移除，编号可能被新 socket 复用，所以每次都尝试注册
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = socket;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1 && errno != EEXIST) {
+            pretty_out << ::std::format("throw from CoScheduler::waitReadable(): epoll_ctl() failed, errno = {0}", errno);
+            throw std::runtime_error("epoll_ctl() failed");
+        }
+    }
+
+    it->second.push_back(addWaiter(socket, deadline, handle, readable));
+}
+
+void my::CoScheduler::poll()
+{
+    armTimer(nextDeadline());
+
+    epoll_event events[64];
+    int count;
+    do {
+        count = epoll_wait(m_epoll_fd, events, 64, -1);
+    } while (count == -1 && errno == EINTR);
+    if (count == -1) {
+        pretty_out << ::std::format("throw from CoScheduler::poll(): epoll_wait() failed, errno = {0}", errno);
+        throw std::runtime_error("epoll_wait() failed");
+    }
+
+    for (int i = 0; i < count; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == m_timer_fd) {
+            unsigned long long expirations;
+            (void)!::read(m_timer_fd, &expirations, sizeof(expirations));
+            m_timer_deadline = TimePoint::max();
+            continue;
+        }
+        if (fd == m_event_fd) {
+            unsigned long long count;
+            (void)!::read(m_event_fd, &count, sizeof(count));
+            takePosted();
+            continue;
+        }
+
+        auto it = m_socket_waiters.find(fd);
+        if (it == m_socket_waiters.end()) {
+            continue;
+        }
+        if (it->second.empty()) {
+            // 无人等待的 socket 不再监听，避免水平触发反复唤醒
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            m_socket_waiters.erase(it);
+            continue;
+        }
+        ::std::vector<int> waiters = ::std::move(it->second);
+        it->second.clear();
+        for (int index : waiters) {
+            wake(index, true);
+        }
+    }
+}
+
+#else
+
+my::CoScheduler::CoScheduler()
+{
+    m_wakeup_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    m_wakeup_addr.sin_family = AF_INET;
+    m_wakeup_addr.sin_port = 0;
+    m_wakeup_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    socklen_t address_size = sizeof(m_wakeup_addr);
+    if (m_wakeup_socket == INVALID_SOCKET || bind(m_wakeup_socket, reinterpret_cast<sockaddr *>(&m_wakeup_addr), sizeof(m_wakeup_addr)) == SOCKET_ERROR ||
+        getsockname(m_wakeup_socket, reinterpret_cast<sockaddr *>(&m_wakeup_addr), &address_size) == SOCKET_ERROR) {
+        pretty_out << ::std::format("throw from CoScheduler::CoScheduler(): Create wakeup socket failed, WSAGetLastError() = {0}", WSAGetLastError());
+        throw std::runtime_error("Create wakeup socket failed");
+    }
+    u_long non_blocking = 1;
+    ioctlsocket(m_wakeup_socket, FIONBIO, &non_blocking);
+}
+
+my::CoScheduler::~CoScheduler()
+{
+    closesocket(m_wakeup_socket);
+}
+
+void my::CoScheduler::post(WaitToken token)
+{
+    {
+        ::std::lock_guard<::std::mutex> lock(m_posted_mutex);
+        m_posted.push_back(token);
+    }
+    char one = 1;
+    sendto(m_wakeup_socket, &one, 1, 0, reinterpret_cast<const sockaddr *>(&m_wakeup_addr), sizeof(m_wakeup_addr));
+}
+
+void my::CoScheduler::waitReadable(SOCKET socket, TimePoint deadline, ::std::coroutine_handle<> handle, bool *readable)
+{
+    m_socket_waiters[socket].push_back(addWaiter(socket, deadline, handle, readable));
+}
+
+// 没有 epoll 时用 select() 等待所有有协程在等的 socket
+void my::CoScheduler::poll()
+{
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(m_wakeup_socket, &readfds);
+    SOCKET max_socket = m_wakeup_socket;
+    for (const auto &[socket, waiters] : m_socket_waiters) {
+        if (!waiters.empty()) {
+            FD_SET(socket, &readfds);
+            max_socket = ::std::max(max_socket, socket);
+        }
+    }
+
+    TIMEVAL timeout;
+    TIMEVAL *timeout_ptr = nullptr;
+    TimePoint deadline = nextDeadline();
+    if (deadline != TimePoint::max()) {
+        long long us = ::std::chrono::ceil<::std::chrono::microseconds>(deadline - Clock::now()).count();
+        us = ::std::max(us, 0LL);
+        timeout = {(long)(us / 1000000), (long)(us % 1000000)};
+        timeout_ptr = &timeout;
+    }
+
+    int sum = select((int)max_socket + 1, &readfds, nullptr, nullptr, timeout_ptr);
+    if (sum == SOCKET_ERROR) {
+        pretty_out << ::std::format("throw from CoScheduler::poll(): select() failed, WSAGetLastError() = {0}", WSAGetLastError());
+        throw std::runtime_error("select() failed");
+    }
+    if (FD_ISSET(m_wakeup_socket, &readfds)) {
+        char buffer[64];
+        while (recv(m_wakeup_socket, buffer, sizeof(buffer), 0) > 0) {
+        }
+        takePosted();
+    }
+    for (auto &[socket, waiters] : m_socket_waiters) {
+        if (!waiters.empty() && FD_ISSET(socket, &readfds)) {
+            ::std::vector<int> woken = ::std::move(waiters);
+            waiters.clear();
+            for (int index : woken) {
+                wake(index, true);
+            }
+        }
+    }
+}
+
+#endif
+
+int my::CoScheduler::addWaiter(SOCKET socket, TimePoint deadline, ::std::coroutine_handle<> handle, bool *readable)
+{
+    int index;
+    if (m_free_waiters.empty()) {
+        index = (int)m_waiters.size();
+        m_waiters.emplace_back();
+    } else {
+        index = m_free_waiters.back();
+        m_free_waiters.pop_back();
+    }
+    Waiter &waiter = m_waiters[index];
+    waiter.handle = handle;
+    waiter.socket = socket;
+    waiter.deadline = deadline;
+    waiter.readable = readable;
+    waiter.active = true;
+    ++m_active_waiters;
+
+    if (deadline != TimePoint::max()) {
+        m_deadlines.push({deadline, {index, waiter.generation}});
+    }
+    return index;
+}
+
+// 不关联 socket 的等待，由其他协程调用 signal() 唤醒
+my::CoScheduler::WaitToken my::CoScheduler::waitSignal(TimePoint deadline, ::std::coroutine_handle<> handle, bool *signaled)
+{
+    int index = addWaiter(INVALID_SOCKET, deadline, handle, signaled);
+    return {index, m_waiters[index].generation};
+}
+
+void my::CoScheduler::signal(WaitToken token)
+{
+    if (token.index < 0 || token.index >= (int)m_waiters.size() || m_waiters[token.index].generation != token.generation) {
+        return;
+    }
+    wake(token.index, true);
+}
+
+void my::CoScheduler::takePosted()
+{
+    ::std::vector<WaitToken> posted;
+    {
+        ::std::lock_guard<::std::mutex> lock(m_posted_mutex);
+        posted.swap(m_posted);
+    }
+    for (WaitToken token : posted) {
+        signal(token);
+    }
+}
+
+void my::CoScheduler::wake(int index, bool readable)
+{
+    Waiter &waiter = m_waiters[index];
+    if (!waiter.active) {
+        return;
+    }
+    if (!readable) {
+        // 因超时唤醒时从 socket 的等待列表中摘除
+        auto it = m_socket_waiters.find(waiter.socket);
+        if (it != m_socket_waiters.end()) {
+            ::std::erase(it->second, index);
+        }
+    }
+    *waiter.readable = readable;
+    waiter.active = false;
+    ++waiter.generation;
+    --m_active_waiters;
+    m_ready.push_back(waiter.handle);
+    m_free_waiters.push_back(index);
+}
+
+// 丢弃已失效的堆顶，返回最近的截止时刻
+my::CoScheduler::TimePoint my::CoScheduler::nextDeadline()
+{
+    while (!m_deadlines.empty()) {
+        auto [index, generation] = m_deadlines.top().second;
+        const Waiter &waiter = m_waiters[index];
+        if (waiter.active && waiter.generation == generation) {
+            return m_deadlines.top().first;
+        }
+        m_deadlines.pop();
+    }
+    return TimePoint::max();
+}
+
+void my::CoScheduler::spawn(CoTask task)
+{
+    m_ready.push_back(task.getHandle());
+    m_tasks.push_back(::std::move(task));
+}
+
+int my::CoScheduler::reapFinished()
+{
+    int failed = 0;
+    for (const CoTask &task : m_tasks) {
+        if (!task.done()) {
+            continue;
+        }
+        if (::std::exception_ptr exception = task.getException()) {
+            ++failed;
+            try {
+                ::std::rethrow_exception(exception);
+            } catch (const ::std::exception &e) {
+                pretty_err << ::std::format("catch by CoScheduler::run():") << e.what();
+            }
+        }
+    }
+    ::std::erase_if(m_tasks, [](const CoTask &task) { return task.done(); });
+    return failed;
+}
+
+void my::CoScheduler::drainReady()
+{
+    while (!m_ready.empty()) {
+        ::std::coroutine_handle<> handle = m_ready.front();
+        m_ready.pop_front();
+        handle.resume();
+    }
+}
+
+// 阻塞到有 socket 可读或最近的截止时刻，唤醒相应的协程
+void my::CoScheduler::waitEvents()
+{
+    poll();
+    TimePoint now = Clock::now();
+    while (nextDeadline() <= now) {
+        auto [index, generation] = m_deadlines.top().second;
+        m_deadlines.pop();
+        wake(index, false);
+    }
+}
+
+int my::CoScheduler::run()
+{
+    CurrentGuard guard(this);
+    int failed = 0;
+    while (true) {
+        drainReady();
+        failed += reapFinished();
+        if (m_tasks.empty()) {
+            break;
+        }
+        if (m_active_waiters == 0) {
+            pretty_err << ::std::format("CoScheduler::run(): {} task(s) suspended without waiting on anything, abandoned", m_tasks.size());
+            m_tasks.clear();
+            break;
+        }
+        waitEvents();
+    }
+    return failed;
+}
+
+void my::CoScheduler::runSync(CoTask task)
+{
+    CoScheduler scheduler;
+    CoTask::Handle handle = task.getHandle();
+    scheduler.m_ready.push_back(handle);
+
+    CurrentGuard guard(&scheduler);
+    while (true) {
+        scheduler.drainReady();
+        if (handle.done()) {
+            break;
+        }
+        if (scheduler.m_active_waiters == 0) {
+            pretty_out << "throw from CoScheduler::runSync(): Task suspended without waiting on anything";
+            throw std::runtime_error("Task suspended without waiting on anything");
+        }
+        scheduler.waitEvents();
+    }
+    task.await_resume();
+}
+
+my::CoScheduler *my::CoScheduler::current() noexcept
+{
+    return t_current;
+}
\ No newline at end of file
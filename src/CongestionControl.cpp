@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <format>
+#include <limits>
+
+#include "../include/CongestionControl.h"
+
+void my::CongestionController::reset() noexcept
+{
+    m_cwnd = INITIAL_WINDOW;
+    m_ssthresh = 1e9;
+    m_loss_count = 0;
+}
+
+// 超时说明在途数据已全部离开网络，窗口回到一个数据帧重新慢启动
+void my::CongestionController::onTimeout() noexcept
+{
+    m_ssthresh = ::std::max(m_cwnd / 2, 2.0);
+    m_cwnd = MIN_WINDOW;
+    ++m_loss_count;
+}
+
+void my::CongestionController::onLoss(int in_flight) noexcept
+{
+    m_ssthresh = ::std::max(in_flight / 2.0, 2.0);
+    m_cwnd = m_ssthresh;
+    ++m_loss_count;
+}
+
+::std::string my::CongestionController::toString() const
+{
+    // 尚未发生丢包时 ssthresh 为无穷大
+    ::std::string ssthresh = m_ssthresh >= 1e9 ? "inf" : ::std::format("{:.2f}", m_ssthresh);
+    return ::std::format("{}, cwnd {:.2f}, ssthresh {}, {} loss event(s)", getName(), m_cwnd, ssthresh, m_loss_count);
+}
+
+void my::FixedWindowController::reset() noexcept
+{
+    CongestionController::reset();
+    m_cwnd = ::std::numeric_limits<int>::max();
+}
+
+::std::string my::FixedWindowController::toString() const
+{
+    return ::std::format("{}, fixed window, {} loss event(s)", getName(), m_loss_count);
+}
+
+void my::RenoController::onAck(int acked_count, long long) noexcept
+{
+    while (acked_count-- > 0) {
+        if (m_cwnd < m_ssthresh) {
+            m_cwnd += 1.0;
+        } else {
+            m_cwnd += 1.0 / m_cwnd;
+        }
+    }
+    m_cwnd = ::std::min(m_cwnd, m_max_cwnd);
+}
+
+void my::DelayController::reset() noexcept
+{
+    CongestionController::reset();
+    m_base_rtt = -1;
+    m_round_min_rtt = -1;
+    m_round_acked = 0;
+}
+
+void my::DelayController::onAck(int acked_count, long long rtt) noexcept
+{
+    if (rtt >= 0) {
+        m_base_rtt = m_base_rtt < 0 ? rtt : ::std::min(m_base_rtt, rtt);
+        m_round_min_rtt = m_round_min_rtt < 0 ? rtt : ::std::min(m_round_min_rtt, rtt);
+    }
+
+    // 每确认一个窗口的数据帧（约一个 RTT）调整一次
+    m_round_acked += acked_count;
+    if (m_round_acked < m_cwnd) {
+        return;
+    }
+    m_round_acked = 0;
+
+    if (m_base_rtt <= 0 || m_round_min_rtt < 0) {
+        m_cwnd = ::std::min(m_cwnd + (m_cwnd < m_ssthresh ? m_cwnd : 1.0), m_max_cwnd);
+        return;
+    }
+
+    // diff 为积压在瓶颈队列中的数据帧数的估计
+    double diff = m_cwnd * (1.0 - (double)m_base_rtt / m_round_min_rtt);
+    m_round_min_rtt = -1;
+    if (m_cwnd < m_ssthresh) {
+        // 慢启动阶段每轮翻倍，一旦出现积压即转入拥塞避免
+        if (diff > ALPHA) {
+            m_ssthresh = m_cwnd;
+        } else {
+            m_cwnd *= 2;
+        }
+    } else if (diff < ALPHA) {
+        m_cwnd += 1.0;
+    } else if (diff > BETA) {
+        m_cwnd = ::std::max(m_cwnd - 1.0, 2.0);
+    }
+    m_cwnd = ::std::min(m_cwnd, m_max_cwnd);
+}
+
+::std::string my::DelayController::toString() const
+{
+    return ::std::format("{}, base rtt {:.3f} ms", CongestionController::toString(), m_base_rtt / 1000.0);
+}
+
+::std::unique_ptr<my::CongestionController> my::makeCongestionController(::std::string_view name)
+{
+    ::std::unique_ptr<CongestionController> controller;
+    if (name == "none") {
+        controller = ::std::make_unique<FixedWindowController>();
+    } else if (name == "reno") {
+        controller = ::std::make_unique<RenoController>();
+    } else if (name == "delay") {
+        controller = ::std::make_unique<DelayController>();
+    } else {
+        return nullptr;
+    }
+    controller->reset();
+    return controller;
+}
\ No newline at end of file
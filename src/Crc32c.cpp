@@ -0,0 +1,199 @@
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "../include/Crc32c.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MY_CRC32C_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define MY_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+    // 反射形式的 Castagnoli 多项式
+    constexpr ::std::uint32_t POLY = 0x82F63B78u;
+
+    // 8 张表，一次处理 8 字节（slicing-by-8）
+    constexpr ::std::array<::std::array<::std::uint32_t, 256>, 8> makeTables() noexcept
+    {
+        ::std::array<::std::array<::std::uint32_t, 256>, 8> tables{};
+        for (::std::uint32_t i = 0; i < 256; ++i) {
+            ::std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (crc & 1 ? POLY : 0);
+            }
+            tables[0][i] = crc;
+        }
+        for (int t = 1; t < 8; ++t) {
+            for (int i = 0; i < 256; ++i) {
+                tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+            }
+        }
+        return tables;
+    }
+
+    constexpr auto TABLES = makeTables();
+
+    ::std::uint32_t crc32cTable(::std::uint32_t crc, const unsigned char *p, ::std::size_t size) noexcept
+    {
+        for (; size >= 8; p += 8, size -= 8) {
+            ::std::uint32_t low, high;
+            ::std::memcpy(&low, p, 4);
+            ::std::memcpy(&high, p + 4, 4);
+            // 按小端序解释，大端平台上退回逐字节
+            if constexpr (::std::endian::native != ::std::endian::little) {
+                for (int i = 0; i < 8; ++i) {
+                    crc = (crc >> 8) ^ TABLES[0][(crc ^ p[i]) & 0xFF];
+                }
+                continue;
+            }
+            low ^= crc;
+            crc = TABLES[7][low & 0xFF] ^ TABLES[6][(low >> 8) & 0xFF] ^ TABLES[5][(low >> 16) & 0xFF] ^ TABLES[4][low >> 24] ^
+                  TABLES[3][high & 0xFF] ^ TABLES[2][(high >> 8) & 0xFF] ^ TABLES[1][(high >> 16) & 0xFF] ^ TABLES[0][high >> 24];
+        }
+        for (; size > 0; ++p, --size) {
+            crc = (crc >> 8) ^ TABLES[0][(crc ^ *p) & 0xFF];
+        }
+        return crc;
+    }
+
+#if defined(MY_CRC32C_X86)
+#if defined(__GNUC__)
+#define MY_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define MY_TARGET_SSE42
+#endif
+
+    MY_TARGET_SSE42 ::std::uint32_t crc32cSingle(::std::uint32_t crc, const unsigned char *p, ::std::size_t size) noexcept
+    {
+        ::std::uint64_t crc64 = crc;
+        for (; size >= 8; p += 8, size -= 8) {
+            ::std::uint64_t word;
+            ::std::memcpy(&word, p, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = (::std::uint32_t)crc64;
+        for (; size > 0; ++p, --size) {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+        return crc;
+    }
+
+    // crc32 指令延迟 3 个周期而每周期可发射一条，三路交错计算三段相邻数据后再合并
+    // 合并时把前一段的结果平移过后一段的长度，平移是线性的，按字节查 4 张预先算好的表
+    constexpr ::std::size_t STREAM_SIZE = 4096;
+
+    struct ShiftTables {
+        ::std::uint32_t table[4][256];
+
+        ShiftTables() noexcept
+        {
+            static const unsigned char zeros[STREAM_SIZE] = {};
+            ::std::uint32_t bits[32];
+            for (int i = 0; i < 32; ++i) {
+                bits[i] = crc32cSingle(1u << i, zeros, STREAM_SIZE);
+            }
+            for (int k = 0; k < 4; ++k) {
+                for (int b = 0; b < 256; ++b) {
+                    ::std::uint32_t value = 0;
+                    for (int j = 0; j < 8; ++j) {
+                        if (b >> j & 1) {
+                            value ^= bits[8 * k + j];
+                        }
+                    }
+                    table[k][b] = value;
+                }
+            }
+        }
+
+        ::std::uint32_t shift(::std::uint32_t crc) const noexcept
+        {
+            return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^ table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+        }
+    };
+
+    MY_TARGET_SSE42 ::std::uint32_t crc32cHardware(::std::uint32_t crc, const unsigned char *p, ::std::size_t size) noexcept
+    {
+        static const ShiftTables shift_tables;
+
+        for (; size >= 3 * STREAM_SIZE; p += 3 * STREAM_SIZE, size -= 3 * STREAM_SIZE) {
+            ::std::uint64_t a = crc, b = 0, c = 0;
+            for (::std::size_t i = 0; i < STREAM_SIZE; i += 8) {
+                ::std::uint64_t wa, wb, wc;
+                ::std::memcpy(&wa, p + i, 8);
+                ::std::memcpy(&wb, p + STREAM_SIZE + i, 8);
+                ::std::memcpy(&wc, p + 2 * STREAM_SIZE + i, 8);
+                a = _mm_crc32_u64(a, wa);
+                b = _mm_crc32_u64(b, wb);
+                c = _mm_crc32_u64(c, wc);
+            }
+            crc = shift_tables.shift(shift_tables.shift((::std::uint32_t)a) ^ (::std::uint32_t)b) ^ (::std::uint32_t)c;
+        }
+        return crc32cSingle(crc, p, size);
+    }
+
+    bool hasHardwareCrc() noexcept
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        // 可能早于 libgcc 的初始化执行
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+#elif defined(MY_CRC32C_ARM)
+    ::std::uint32_t crc32cHardware(::std::uint32_t crc, const unsigned char *p, ::std::size_t size) noexcept
+    {
+        for (; size >= 8; p += 8, size -= 8) {
+            ::std::uint64_t word;
+            ::std::memcpy(&word, p, 8);
+            crc = __crc32cd(crc, word);
+        }
+        for (; size > 0; ++p, --size) {
+            crc = __crc32cb(crc, *p);
+        }
+        return crc;
+    }
+
+    // 编译时已要求 CRC 扩展
+    bool hasHardwareCrc() noexcept { return true; }
+#else
+    ::std::uint32_t crc32cHardware(::std::uint32_t crc, const unsigned char *p, ::std::size_t size) noexcept
+    {
+        return crc32cTable(crc, p, size);
+    }
+
+    bool hasHardwareCrc() noexcept { return false; }
+#endif
+
+    using Kernel = ::std::uint32_t (*)(::std::uint32_t, const unsigned char *, ::std::size_t) noexcept;
+
+    const bool HARDWARE = hasHardwareCrc();
+    const Kernel KERNEL = HARDWARE ? crc32cHardware : crc32cTable;
+} // namespace
+
+::std::uint32_t my::crc32c(const void *data, ::std::size_t size, ::std::uint32_t crc) noexcept
+{
+    return ~KERNEL(~crc, static_cast<const unsigned char *>(data), size);
+}
+
+const char *my::crc32cImplementation() noexcept
+{
+#if defined(MY_CRC32C_X86)
+    return HARDWARE ? "sse4.2" : "table";
+#elif defined(MY_CRC32C_ARM)
+    return "armv8-crc";
+#else
+    return "table";
+#endif
+}
\ No newline at end of file
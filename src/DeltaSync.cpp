@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <unordered_map>
+
+#include "../include/DeltaSync.h"
+#include "../include/Sha256.h"
+#include "../include/UDPFileReader.h"
+#include "../include/pretty_log.hpp"
+
+namespace
+{
+    constexpr char SIGNATURE_MAGIC[4] = {'R', 'D', 'T', 'S'};
+    constexpr char DELTA_MAGIC[4] = {'R', 'D', 'T', 'D'};
+    constexpr char COPY_RECORD = 'C';
+    constexpr char LITERAL_RECORD = 'L';
+
+    void writeUint32(::std::ostream &os, ::std::uint32_t value)
+    {
+        char bytes[4];
+        for (int i = 0; i < 4; ++i) {
+            bytes[i] = (char)(value >> (24 - 8 * i));
+        }
+        os.write(bytes, 4);
+    }
+
+    bool readUint32(::std::istream &is, ::std::uint32_t &value)
+    {
+        char bytes[4];
+        if (!is.read(bytes, 4)) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value = value << 8 | (unsigned char)bytes[i];
+        }
+        return true;
+    }
+
+    // 整个文件的内容，能映射时直接用映射，否则读入内存
+    class FileContent
+    {
+    public:
+        FileContent(::std::string_view filename, int block_size) : m_reader(filename, ::my::UDPFileReader::Mode::MAPPED, block_size)
+        {
+            m_size = m_reader.getFileSize();
+            if (m_reader.isMapped()) {
+                const char *data;
+                m_reader.getBlock(0, data);
+                m_data = reinterpret_cast<const unsigned char *>(data);
+                return;
+            }
+            m_buffer.resize(m_size);
+            ::std::ifstream ifs(::std::string(filename), ::std::ios::binary);
+            ifs.read(reinterpret_cast<char *>(m_buffer.data()), m_size);
+            m_data = m_buffer.data();
+        }
+
+        const unsigned char *data() const noexcept { return m_data; }
+        long long size() const noexcept { return m_size; }
+
+    private:
+        ::my::UDPFileReader m_reader;
+        ::std::vector<unsigned char> m_buffer;
+        const unsigned char *m_data = nullptr;
+        long long m_size = 0;
+    };
+} // namespace
+
+::std::string my::DeltaSync::Stats::toString() const
+{
+    return ::std::format("{} literal byte(s), {} block(s) copied, delta {} of {} byte(s)", literal_bytes, copied_blocks, delta_size, file_size);
+}
+
+void my::DeltaSync::RollingChecksum::reset(const unsigned char *data, int size) noexcept
+{
+    m_a = m_b = 0;
+    m_size = size;
+    for (int i = 0; i < size; ++i) {
+        m_a += data[i];
+        m_b += (::std::uint32_t)(size - i) * data[i];
+    }
+}
+
+::std::array<unsigned char, my::DeltaSync::STRONG_SIZE> my::DeltaSync::strongHash(const void *data, int size) noexcept
+{
+    Sha256::Digest digest = Sha256::hash(data, size);
+    ::std::array<unsigned char, STRONG_SIZE> strong;
+    ::std::memcpy(strong.data(), digest.data(), STRONG_SIZE);
+    return strong;
+}
+
+void my::DeltaSync::makeSignatures(::std::string_view filename, int block_size, ::std::string_view signature_path)
+{
+    FileContent content(filename, block_size);
+    ::std::ofstream ofs(::std::string(signature_path), ::std::ios::binary | ::std::ios::trunc);
+    if (!ofs.is_open()) {
+        pretty_out << ::std::format("throw from DeltaSync::makeSignatures(): Failed to open file \"{0}\"", signature_path);
+        throw std::runtime_error("Failed to open file");
+    }
+    ofs.write(SIGNATURE_MAGIC, sizeof(SIGNATURE_MAGIC));
+    writeUint32(ofs, (::std::uint32_t)block_size);
+
+    RollingChecksum checksum;
+    for (long long offset = 0; offset + block_size <= content.size(); offset += block_size) {
+        checksum.reset(content.data() + offset, block_size);
+        writeUint32(ofs, checksum.value());
+        ofs.write(reinterpret_cast<const char *>(strongHash(content.data() + offset, block_size).data()), STRONG_SIZE);
+    }
+}
+
+::std::vector<my::DeltaSync::Signature> my::DeltaSync::loadSignatures(::std::string_view signature_path, int &block_size)
+{
+    ::std::ifstream ifs(::std::string(signature_path), ::std::ios::binary);
+    char magic[sizeof(SIGNATURE_MAGIC)];
+    ::std::uint32_t size;
+    if (!ifs.read(magic, sizeof(magic)) || ::std::memcmp(magic, SIGNATURE_MAGIC, sizeof(magic)) != 0 || !readUint32(ifs, size)) {
+        pretty_out << ::std::format("throw from DeltaSync::loadSignatures(): Invalid signature file \"{0}\"", signature_path);
+        throw std::runtime_error("Invalid signature file");
+    }
+    block_size = (int)size;
+
+    ::std::vector<Signature> signatures;
+    Signature signature;
+    while (readUint32(ifs, signature.weak) && ifs.read(reinterpret_cast<char *>(signature.strong.data()), STRONG_SIZE)) {
+        signatures.push_back(signature);
+    }
+    return signatures;
+}
+
+// 上一次命中的下一块优先比对，追加与少量修改的文件几乎总是按顺序命中
+my::DeltaSync::Stats my::DeltaSync::makeDelta(::std::string_view filename, const ::std::vector<Signature> &signatures, int block_size, ::std::string_view delta_path)
+{
+    FileContent content(filename, block_size);
+    const unsigned char *data = content.data();
+    const long long size = content.size();
+
+    ::std::ofstream ofs(::std::string(delta_path), ::std::ios::binary | ::std::ios::trunc);
+    if (!ofs.is_open()) {
+        pretty_out << ::std::format("throw from DeltaSync::makeDelta(): Failed to open file \"{0}\"", delta_path);
+        throw std::runtime_error("Failed to open file");
+    }
+    ofs.write(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+    writeUint32(ofs, (::std::uint32_t)block_size);
+
+    Stats stats;
+    stats.file_size = size;
+
+    // 先按弱校验和的低 16 位过滤，多数不命中的位置不必查表
+    ::std::vector<bool> filter(1 << 16, false);
+    ::std::unordered_multimap<::std::uint32_t, int> index;
+    index.reserve(signatures.size());
+    for (int i = 0; i < (int)signatures.size(); ++i) {
+        filter[signatures[i].weak & 0xFFFF] = true;
+        index.emplace(signatures[i].weak, i);
+    }
+
+    int copy_begin = -1;
+    int copy_count = 0;
+    auto flush_copy = [&]() {
+        if (copy_count > 0) {
+            ofs.put(COPY_RECORD);
+            writeUint32(ofs, (::std::uint32_t)copy_begin);
+            writeUint32(ofs, (::std::uint32_t)copy_count);
+            stats.copied_blocks += copy_count;
+            copy_count = 0;
+        }
+    };
+    auto flush_literal = [&](long long begin, long long end) {
+        if (begin < end) {
+            flush_copy();
+            ofs.put(LITERAL_RECORD);
+            writeUint32(ofs, (::std::uint32_t)(end - begin));
+            ofs.write(reinterpret_cast<const char *>(data + begin), end - begin);
+            stats.literal_bytes += end - begin;
+        }
+    };
+
+    long long pos = 0;
+    long long literal_begin = 0;
+    int expected = -1;
+    RollingChecksum checksum;
+    if (size >= block_size && !signatures.empty()) {
+        checksum.reset(data, block_size);
+    }
+    while (!signatures.empty() && pos + block_size <= size) {
+        ::std::uint32_t weak = checksum.value();
+        int match = -1;
+        if (filter[weak & 0xFFFF]) {
+            auto [first, last] = index.equal_range(weak);
+            if (first != last) {
+                auto strong = strongHash(data + pos, block_size);
+                if (expected >= 0 && expected < (int)signatures.size() && signatures[expected].weak == weak && signatures[expected].strong == strong) {
+                    match = expected;
+                } else {
+                    for (auto it = first; it != last; ++it) {
+                        if (signatures[it->second].strong == strong) {
+                            match = it->second;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (match >= 0) {
+            flush_literal(literal_begin, pos);
+            // 连续的块合并为一条记录
+            if (copy_count > 0 && copy_begin + copy_count == match) {
+                ++copy_count;
+            } else {
+                flush_copy();
+                copy_begin = match;
+                copy_count = 1;
+            }
+            pos += block_size;
+            literal_begin = pos;
+            expected = match + 1;
+            if (pos + block_size <= size) {
+                checksum.reset(data + pos, block_size);
+            }
+            continue;
+        }
+
+        if (pos + block_size < size) {
+            checksum.roll(data[pos], data[pos + block_size]);
+        }
+        ++pos;
+        if (pos - literal_begin >= MAX_LITERAL_SIZE) {
+            flush_literal(literal_begin, pos);
+            literal_begin = pos;
+        }
+    }
+    for (; literal_begin < size; literal_begin += MAX_LITERAL_SIZE) {
+        flush_literal(literal_begin, ::std::min(size, literal_begin + MAX_LITERAL_SIZE));
+    }
+    flush_copy();
+
+    stats.delta_size = ofs.tellp();
+    return stats;
+}
+
+void my::DeltaSync::applyDelta(::std::string_view base, ::std::string_view delta_path, ::std::string_view output)
+{
+    ::std::ifstream ifs(::std::string(delta_path), ::std::ios::binary);
+    char magic[sizeof(DELTA_MAGIC)];
+    ::std::uint32_t block_size;
+    if (!ifs.read(magic, sizeof(magic)) || ::std::memcmp(magic, DELTA_MAGIC, sizeof(magic)) != 0 || !readUint32(ifs, block_size) ||
+        block_size == 0 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+        pretty_out << ::std::format("throw from DeltaSync::applyDelta(): Invalid delta file \"{0}\"", delta_path);
+        throw std::runtime_error("Invalid delta file");
+    }
+
+    FileContent content(base, (int)block_size);
+    ::std::ofstream ofs(::std::string(output), ::std::ios::binary | ::std::ios::trunc);
+    if (!ofs.is_open()) {
+        pretty_out << ::std::format("throw from DeltaSync::applyDelta(): Failed to open file \"{0}\"", output);
+        throw std::runtime_error("Failed to open file");
+    }
+
+    // 只有在记录边界上读到文件尾才算完整，任何记录读到一半就结束都视为损坏
+    ::std::vector<char> buffer;
+    char type;
+    bool complete = false;
+    while (true) {
+        if (!ifs.get(type)) {
+            complete = ifs.eof();
+            break;
+        }
+        ::std::uint32_t first, second;
+        if (type == COPY_RECORD && readUint32(ifs, first) && readUint32(ifs, second)) {
+            long long begin = (long long)first * block_size;
+            long long end = (long long)(first + (long long)second) * block_size;
+            if (end > content.size()) {
+                pretty_out << ::std::format("throw from DeltaSync::applyDelta(): Block out of range, block = {0}, count = {1}", first, second);
+                throw std::runtime_error("Block out of range");
+            }
+            ofs.write(reinterpret_cast<const char *>(content.data() + begin), end - begin);
+        } else if (type == LITERAL_RECORD && readUint32(ifs, first) && first <= (::std::uint32_t)MAX_LITERAL_SIZE) {
+            buffer.resize(first);
+            if (!ifs.read(buffer.data(), first)) {
+                break;
+            }
+            ofs.write(buffer.data(), first);
+        } else {
+            break;
+        }
+    }
+    if (!complete) {
+        pretty_out << ::std::format("throw from DeltaSync::applyDelta(): Corrupted delta file \"{0}\"", delta_path);
+        throw std::runtime_error("Corrupted delta file");
+    }
+}
\ No newline at end of file
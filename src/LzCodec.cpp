@@ -0,0 +1,205 @@
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#include "../include/LzCodec.h"
+
+namespace
+{
+    constexpr int MIN_MATCH = 4;
+    constexpr int HASH_BITS = 12;
+    // 最后这么多字节总是作为字面数据，匹配查找时读 4 字节不会越界
+    constexpr int LAST_LITERALS = 5;
+    constexpr int MAX_OFFSET = 65535;
+    // 连续未命中时逐渐加大步长，不可压缩的数据很快扫过
+    constexpr int SKIP_TRIGGER = 6;
+
+    inline ::std::uint32_t read32(const char *p) noexcept
+    {
+        ::std::uint32_t value;
+        ::std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    inline ::std::uint64_t read64(const char *p) noexcept
+    {
+        ::std::uint64_t value;
+        ::std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    inline int hash32(::std::uint32_t value) noexcept
+    {
+        return (int)((value * 2654435761u) >> (32 - HASH_BITS));
+    }
+
+    // 写出 15 以上的长度扩展，空间不足时返回 nullptr
+    inline char *writeLength(char *op, const char *end, int length) noexcept
+    {
+        for (; length >= 255; length -= 255) {
+            if (op >= end) {
+                return nullptr;
+            }
+            *op++ = (char)255;
+        }
+        if (op >= end) {
+            return nullptr;
+        }
+        *op++ = (char)length;
+        return op;
+    }
+
+    inline bool readLength(const unsigned char *&ip, const unsigned char *end, int &length) noexcept
+    {
+        unsigned char byte;
+        do {
+            if (ip >= end) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    // 输出一个序列：字面数据后跟一个匹配，match_length 为 0 表示最后一个序列
+    char *writeSequence(char *op, const char *end, const char *literal, int literal_length, int offset, int match_length) noexcept
+    {
+        if (op >= end) {
+            return nullptr;
+        }
+        char *token = op++;
+        int literal_code = literal_length < 15 ? literal_length : 15;
+        int match_code = 0;
+        if (literal_code == 15 && !(op = writeLength(op, end, literal_length - 15))) {
+            return nullptr;
+        }
+        if (end - op < literal_length) {
+            return nullptr;
+        }
+        ::std::memcpy(op, literal, literal_length);
+        op += literal_length;
+
+        if (match_length > 0) {
+            if (end - op < 2) {
+                return nullptr;
+            }
+            *op++ = (char)(offset & 0xFF);
+            *op++ = (char)(offset >> 8);
+            match_code = match_length - MIN_MATCH < 15 ? match_length - MIN_MATCH : 15;
+            if (match_code == 15 && !(op = writeLength(op, end, match_length - MIN_MATCH - 15))) {
+                return nullptr;
+            }
+        }
+        *token = (char)(literal_code << 4 | match_code);
+        return op;
+    }
+} // namespace
+
+int my::lzCompress(const char *src, int size, char *dst, int capacity) noexcept
+{
+    int table[1 << HASH_BITS];
+    ::std::memset(table, 0xFF, sizeof(table));
+
+    char *op = dst;
+    char *const op_end = dst + capacity;
+    const char *anchor = src;
+    const int match_limit = size - LAST_LITERALS;
+
+    int pos = 0;
+    int misses = 0;
+    while (pos + MIN_MATCH <= match_limit) {
+        ::std::uint32_t sequence = read32(src + pos);
+        int h = hash32(sequence);
+        int candidate = table[h];
+        table[h] = pos;
+        if (candidate < 0 || pos - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+            pos += 1 + (misses++ >> SKIP_TRIGGER);
+            continue;
+        }
+        misses = 0;
+
+        // 向前扩展到字面数据的起点，向后扩展到不再相同
+        while (pos > anchor - src && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+            --pos;
+            --candidate;
+        }
+        // 一次比较 8 字节，小端序下最低的不同位所在字节即第一个不同的字节
+        int length = MIN_MATCH;
+        while (pos + length + 8 <= match_limit) {
+            ::std::uint64_t diff = read64(src + pos + length) ^ read64(src + candidate + length);
+            if (diff != 0) {
+                length += ::std::countr_zero(diff) / 8;
+                break;
+            }
+            length += 8;
+        }
+        while (pos + length < match_limit && src[pos + length] == src[candidate + length]) {
+            ++length;
+        }
+
+        op = writeSequence(op, op_end, anchor, (int)(src + pos - anchor), pos - candidate, length);
+        if (!op) {
+            return 0;
+        }
+        pos += length;
+        anchor = src + pos;
+        // 匹配中间的位置也记入表中，提高下一次命中的机会
+        if (pos - 2 >= 0 && pos + 2 <= match_limit) {
+            table[hash32(read32(src + pos - 2))] = pos - 2;
+        }
+    }
+
+    op = writeSequence(op, op_end, anchor, (int)(src + size - anchor), 0, 0);
+    return op ? (int)(op - dst) : 0;
+}
+
+int my::lzDecompress(const char *src, int size, char *dst, int capacity) noexcept
+{
+    const unsigned char *ip = reinterpret_cast<const unsigned char *>(src);
+    const unsigned char *const ip_end = ip + size;
+    char *op = dst;
+    char *const op_end = dst + capacity;
+
+    while (ip < ip_end) {
+        int token = *ip++;
+        int literal_length = token >> 4;
+        if (literal_length == 15 && !readLength(ip, ip_end, literal_length)) {
+            return -1;
+        }
+        if (ip_end - ip < literal_length || op_end - op < literal_length) {
+            return -1;
+        }
+        ::std::memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        int match_length = token & 0x0F;
+        if (match_length == 15 && !readLength(ip, ip_end, match_length)) {
+            return -1;
+        }
+        match_length += MIN_MATCH;
+        if (offset == 0 || offset > op - dst || op_end - op < match_length) {
+            return -1;
+        }
+        const char *match = op - offset;
+        if (offset >= match_length) {
+            ::std::memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // 重叠的匹配逐字节复制，得到重复的模式
+            for (int i = 0; i < match_length; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int)(op - dst);
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <thread>
+
+#include "../include/MerkleTree.h"
+#include "../include/UDPFileReader.h"
+#include "../include/pretty_log.hpp"
+
+namespace
+{
+    constexpr unsigned char LEAF_TAG = 0x00;
+    constexpr unsigned char NODE_TAG = 0x01;
+
+    ::my::MerkleTree::Digest hashLeaf(const char *data, int size) noexcept
+    {
+        ::my::Sha256 sha;
+        sha.update(&LEAF_TAG, 1);
+        sha.update(data, size);
+        return sha.finish();
+    }
+
+    ::my::MerkleTree::Digest hashNode(const ::my::MerkleTree::Digest &left, const ::my::MerkleTree::Digest &right) noexcept
+    {
+        ::my::Sha256 sha;
+        sha.update(&NODE_TAG, 1);
+        sha.update(left.data(), left.size());
+        sha.update(right.data(), right.size());
+        return sha.finish();
+    }
+} // namespace
+
+my::MerkleTree::MerkleTree()
+{
+    build();
+}
+
+my::MerkleTree::MerkleTree(::std::vector<Digest> leaves)
+{
+    m_levels.push_back(::std::move(leaves));
+    build();
+}
+
+void my::MerkleTree::build()
+{
+    m_levels.resize(1);
+    m_leaf_count = (int)m_levels.front().size();
+    if (m_leaf_count == 0) {
+        m_levels.push_back({Sha256::hash(nullptr, 0)});
+        return;
+    }
+    while (m_levels.back().size() > 1) {
+        const ::std::vector<Digest> &below = m_levels.back();
+        ::std::vector<Digest> level((below.size() + 1) / 2);
+        for (::std::size_t i = 0; i < level.size(); ++i) {
+            level[i] = 2 * i + 1 < below.size() ? hashNode(below[2 * i], below[2 * i + 1]) : below[2 * i];
+        }
+        m_levels.push_back(::std::move(level));
+    }
+}
+
+my::MerkleTree my::MerkleTree::fromFile(::std::string_view filename, int block_size, int thread_count)
+{
+    UDPFileReader reader(filename, UDPFileReader::Mode::MAPPED, block_size);
+    const int block_count = reader.getBlockCount();
+    ::std::vector<Digest> leaves(block_count);
+
+    if (!reader.isMapped()) {
+        // 映射失败时退回单线程流式读取
+        for (int i = 0; i < block_count; ++i) {
+            UDPDataframe dataframe = reader.getDataframe(i);
+            int size;
+            const char *data = dataframe.data(size);
+            leaves[i] = hashLeaf(data, size);
+        }
+        return MerkleTree(::std::move(leaves));
+    }
+
+    if (thread_count <= 0) {
+        thread_count = (int)::std::max(1u, ::std::thread::hardware_concurrency());
+    }
+    thread_count = ::std::clamp(block_count / MIN_BLOCKS_PER_THREAD, 1, thread_count);
+
+    // 每个线程负责连续的一段块，映射只读，线程之间无需同步
+    auto hash_range = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const char *data;
+            int size = reader.getBlock(i, data);
+            leaves[i] = hashLeaf(data, size);
+        }
+    };
+    ::std::vector<::std::thread> threads;
+    for (int t = 1; t < thread_count; ++t) {
+        threads.emplace_back(hash_range, (int)((long long)block_count * t / thread_count), (int)((long long)block_count * (t + 1) / thread_count));
+    }
+    hash_range(0, block_count / thread_count);
+    for (::std::thread &thread : threads) {
+        thread.join();
+    }
+    return MerkleTree(::std::move(leaves));
+}
+
+my::MerkleTree my::MerkleTree::loadLeaves(::std::string_view filename)
+{
+    ::std::ifstream ifs(::std::string(filename), ::std::ios::binary | ::std::ios::ate);
+    if (!ifs.is_open()) {
+        pretty_out << ::std::format("throw from MerkleTree::loadLeaves(): Failed to open file \"{0}\"", filename);
+        throw std::runtime_error("Failed to open file");
+    }
+    long long size = ifs.tellg();
+    if (size % DIGEST_SIZE != 0) {
+        pretty_out << ::std::format("throw from MerkleTree::loadLeaves(): Invalid file size, size = {0}", size);
+        throw std::runtime_error("Invalid file size");
+    }
+    ::std::vector<Digest> leaves(size / DIGEST_SIZE);
+    ifs.seekg(0);
+    ifs.read(reinterpret_cast<char *>(leaves.data()), size);
+    return MerkleTree(::std::move(leaves));
+}
+
+void my::MerkleTree::saveLeaves(::std::string_view filename) const
+{
+    ::std::ofstream ofs(::std::string(filename), ::std::ios::binary | ::std::ios::trunc);
+    if (!ofs.is_open()) {
+        pretty_out << ::std::format("throw from MerkleTree::saveLeaves(): Failed to open file \"{0}\"", filename);
+        throw std::runtime_error("Failed to open file");
+    }
+    ofs.write(reinterpret_cast<const char *>(getLeaves().data()), (long long)m_leaf_count * DIGEST_SIZE);
+}
+
+// 叶子数相同时从根向下只进入哈希不同的子树，否则逐块比较
+::std::vector<int> my::MerkleTree::diff(const MerkleTree &other) const
+{
+    ::std::vector<int> blocks;
+    if (m_leaf_count != other.m_leaf_count) {
+        int common = ::std::min(m_leaf_count, other.m_leaf_count);
+        for (int i = 0; i < common; ++i) {
+            if (getLeaves()[i] != other.getLeaves()[i]) {
+                blocks.push_back(i);
+            }
+        }
+        for (int i = common; i < ::std::max(m_leaf_count, other.m_leaf_count); ++i) {
+            blocks.push_back(i);
+        }
+        return blocks;
+    }
+    if (m_leaf_count > 0 && getRoot() != other.getRoot()) {
+        diffSubtree(other, (int)m_levels.size() - 1, 0, blocks);
+    }
+    return blocks;
+}
+
+void my::MerkleTree::diffSubtree(const MerkleTree &other, int level, int index, ::std::vector<int> &blocks) const
+{
+    if (level == 0) {
+        blocks.push_back(index);
+        return;
+    }
+    const ::std::vector<Digest> &below = m_levels[level - 1];
+    for (int child = 2 * index; child < 2 * index + 2 && child < (int)below.size(); ++child) {
+        if (below[child] != other.m_levels[level - 1][child]) {
+            diffSubtree(other, level - 1, child, blocks);
+        }
+    }
+}
\ No newline at end of file
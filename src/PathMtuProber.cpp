@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <format>
+
+#include "../include/PathMtuProber.h"
+
+namespace
+{
+    // 常见链路的 MTU，首轮直接探测这些大小，大多数路径一轮即可定位
+    constexpr int COMMON_PLPMTUS[] = {1280, 1500, 4352, 9000, 16384, 32768, 65535};
+} // namespace
+
+void my::PathMtuProber::restart() noexcept
+{
+    m_searching = true;
+    m_round_pending = false;
+    m_verifying = false;
+    m_any_acked = false;
+    m_confirmed = BASE_SIZE;
+    m_upper = MAX_SIZE;
+    m_round = 0;
+    ++m_search_count;
+}
+
+const ::std::vector<int> &my::PathMtuProber::startRound(TimePoint now)
+{
+    if (!m_searching) {
+        // 重新探测：上界放开，当前值本身也在本轮中确认
+        m_searching = true;
+        m_verifying = true;
+        m_verify_size = m_confirmed;
+        m_any_acked = false;
+        m_upper = MAX_SIZE;
+        m_round = 0;
+        ++m_search_count;
+    }
+
+    // 当前下界总是一同探测，它的确认到达后其余探测帧只需再等 2 倍 RTT
+    // 重新探测时也借此确认当前值仍然可用
+    m_candidates.assign(1, m_confirmed);
+    if (m_round == 0) {
+        for (int plpmtu : COMMON_PLPMTUS) {
+            int size = ::std::min(plpmtu - IP_UDP_OVERHEAD, MAX_SIZE);
+            if (size > m_confirmed && size <= m_upper) {
+                m_candidates.push_back(size);
+            }
+        }
+    }
+    if (m_candidates.back() <= m_confirmed) {
+        // 在上下界之间等分
+        for (int k = 1; k <= PROBES_PER_ROUND; ++k) {
+            int size = m_confirmed + (int)((long long)(m_upper - m_confirmed) * k / PROBES_PER_ROUND);
+            if (size > m_candidates.back()) {
+                m_candidates.push_back(size);
+            }
+        }
+    }
+
+    m_acked.assign(m_candidates.size(), false);
+    m_round_pending = true;
+    m_round_start = now;
+    m_round_deadline = now + ::std::chrono::milliseconds(ROUND_TIMEOUT_MS);
+    m_probe_count += (long long)m_candidates.size();
+    ++m_round;
+    return m_candidates;
+}
+
+// 迟到的确认同样有效，无论属于哪一轮
+void my::PathMtuProber::onAck(int size, TimePoint now) noexcept
+{
+    if (size < BASE_SIZE || size > MAX_SIZE) {
+        return;
+    }
+    m_any_acked = true;
+    if (size > m_confirmed) {
+        m_confirmed = size;
+        m_upper = ::std::max(m_upper, size);
+    }
+    if (!m_round_pending) {
+        return;
+    }
+
+    bool first = ::std::none_of(m_acked.begin(), m_acked.end(), [](bool acked) { return acked; });
+    for (::std::size_t i = 0; i < m_candidates.size(); ++i) {
+        if (m_candidates[i] == size && !m_acked[i]) {
+            m_acked[i] = true;
+            ++m_ack_count;
+        }
+    }
+    if (first) {
+        auto wait = ::std::max<Clock::duration>(2 * (now - m_round_start), ::std::chrono::milliseconds(MIN_ROUND_WAIT_MS));
+        m_round_deadline = ::std::min(m_round_deadline, now + wait);
+    }
+}
+
+void my::PathMtuProber::onTooBig(int size) noexcept
+{
+    m_upper = ::std::max(m_confirmed, ::std::min(m_upper, size - 1));
+}
+
+bool my::PathMtuProber::isRoundDone(TimePoint now) const noexcept
+{
+    return !m_round_pending || now >= m_round_deadline || ::std::all_of(m_acked.begin(), m_acked.end(), [](bool acked) { return acked; });
+}
+
+void my::PathMtuProber::finishRound(TimePoint now) noexcept
+{
+    if (!m_round_pending) {
+        return;
+    }
+    m_round_pending = false;
+
+    if (m_verifying) {
+        m_verifying = false;
+        if (m_verify_size > BASE_SIZE && m_confirmed == m_verify_size && !m_acked.front()) {
+            // 之前确认过的大小不再能通过，路径变窄，从头搜索
+            ++m_black_hole_count;
+            m_confirmed = BASE_SIZE;
+            m_upper = m_verify_size - 1;
+            m_round = 0;
+            return;
+        }
+    }
+
+    // 比下界大而未确认的最小值成为新的上界
+    for (::std::size_t i = 0; i < m_candidates.size(); ++i) {
+        if (!m_acked[i] && m_candidates[i] > m_confirmed) {
+            m_upper = ::std::min(m_upper, m_candidates[i] - 1);
+            break;
+        }
+    }
+
+    if (m_upper - m_confirmed < SEARCH_GRANULARITY || m_round >= MAX_ROUNDS || !m_any_acked) {
+        m_searching = false;
+        m_has_result = true;
+        m_next_reprobe = now + ::std::chrono::milliseconds(REPROBE_INTERVAL_MS);
+    }
+}
+
+::std::string my::PathMtuProber::toString() const
+{
+    if (!m_has_result) {
+        return m_searching ? "searching" : "not probed";
+    }
+    return ::std::format("{} byte(s) ({} byte(s) UDP payload){}, {} search(es), {} size(s) probed, {} acked{}",
+                         getPlpmtu(), getPayloadSize(), m_any_acked ? "" : ", peer did not answer probes",
+                         m_search_count, m_probe_count, m_ack_count,
+                         m_black_hole_count > 0 ? ::std::format(", {} black hole(s)", m_black_hole_count) : "");
+}
\ No newline at end of file
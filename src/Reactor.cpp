@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "../include/Reactor.h"
+#include "../include/pretty_log.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#ifdef __linux__
+
+my::Reactor::~Reactor()
+{
+    if (m_timer_fd != -1) {
+        ::close(m_timer_fd);
+    }
+    if (m_epoll_fd != -1) {
+        ::close(m_epoll_fd);
+    }
+}
+
+// 首次等待或 socket 变化时才注册，之后每次等待只需一次 epoll_wait()
+void my::Reactor::init(SOCKET socket)
+{
+    if (m_epoll_fd == -1) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_epoll_fd == -1 || m_timer_fd == -1) {
+            pretty_out << ::std::format("throw from Reactor::init(): epoll_create1() or timerfd_create() failed, errno = {0}", errno);
+            throw std::runtime_error("epoll_create1() or timerfd_create() failed");
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = m_timer_fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_timer_fd, &event) == -1) {
+            pretty_out << ::std::format("throw from Reactor::init(): epoll_ctl() failed, errno = {0}", errno);
+            throw std::runtime_error("epoll_ctl() failed");
+        }
+    }
+
+    if (m_socket != INVALID_SOCKET) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_socket, nullptr);
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = socket;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1) {
+        pretty_out << ::std::format("throw from Reactor::init(): epoll_ctl() failed, errno = {0}", errno);
+        throw std::runtime_error("epoll_ctl() failed");
+    }
+    m_socket = socket;
+}
+
+// steady_clock 在 Linux 上即 CLOCK_MONOTONIC，截止时刻可直接作为绝对时间
+void my::Reactor::armTimer(TimePoint deadline)
+{
+    itimerspec spec = {};
+    if (deadline != TimePoint::max()) {
+        long long ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        // 全零表示停止定时器，已过去的截止时刻取 1ns 令其立即触发
+        ns = ::std::max(ns, 1LL);
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    } else if (!m_timer_armed) {
+        return;
+    }
+    if (timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        pretty_out << ::std::format("throw from Reactor::armTimer(): timerfd_settime() failed, errno = {0}", errno);
+        throw std::runtime_error("timerfd_settime() failed");
+    }
+    m_timer_armed = deadline != TimePoint::max();
+}
+
+my::Reactor::Event my::Reactor::wait(SOCKET socket, TimePoint deadline)
+{
+    if (socket != m_socket) {
+        init(socket);
+    }
+    if (deadline <= Clock::now()) {
+        return Event::TIMEOUT;
+    }
+    armTimer(deadline);
+
+    while (true) {
+        epoll_event events[2];
+        int count = epoll_wait(m_epoll_fd, events, 2, -1);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            pretty_out << ::std::format("throw from Reactor::wait(): epoll_wait() failed, errno = {0}", errno);
+            throw std::runtime_error("epoll_wait() failed");
+        }
+
+        bool readable = false;
+        bool expired = false;
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.fd == m_timer_fd) {
+                expired = true;
+            } else {
+                readable = true;
+            }
+        }
+        if (expired) {
+            unsigned long long expirations;
+            (void)!::read(m_timer_fd, &expirations, sizeof(expirations));
+            m_timer_armed = false;
+        }
+        // 同时就绪时优先处理到达的帧，确认可能使定时器不再需要
+        if (readable) {
+            return Event::READABLE;
+        }
+        if (expired) {
+            return Event::TIMEOUT;
+        }
+    }
+}
+
+#else
+
+my::Reactor::~Reactor() {}
+
+my::Reactor::Event my::Reactor::wait(SOCKET socket, TimePoint deadline)
+{
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(socket, &readfds);
+
+    TIMEVAL timeout;
+    TIMEVAL *timeout_ptr = nullptr;
+    if (deadline != TimePoint::max()) {
+        // select() 只有微秒精度，向上取整避免提前醒来后空转
+        long long us = ::std::chrono::ceil<::std::chrono::microseconds>(deadline - Clock::now()).count();
+        us = ::std::max(us, 0LL);
+        timeout = {(long)(us / 1000000), (long)(us % 1000000)};
+        timeout_ptr = &timeout;
+    }
+
+    int sum = select(socket + 1, &readfds, nullptr, nullptr, timeout_ptr);
+    if (sum == SOCKET_ERROR) {
+        pretty_out << ::std::format("throw from Reactor::wait(): select() failed, WSAGetLastError() = {0}", WSAGetLastError());
+        throw std::runtime_error("select() failed");
+    }
+    if (sum == 0) {
+        return Event::TIMEOUT;
+    }
+    return Event::READABLE;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+
+#include "../include/RtoEstimator.h"
+
+my::RtoEstimator::RtoEstimator(int initial_rto_ms) noexcept
+{
+    reset(initial_rto_ms);
+}
+
+void my::RtoEstimator::reset(int initial_rto_ms) noexcept
+{
+    m_rto = ::std::clamp((long long)initial_rto_ms * 1000, MIN_RTO, MAX_RTO);
+    m_srtt = 0;
+    m_rttvar = 0;
+    m_sample_count = 0;
+    m_backoff_count = 0;
+    m_samples.clear();
+}
+
+void my::RtoEstimator::sample(long long rtt) noexcept
+{
+    rtt = ::std::max(rtt, 0LL);
+    if (m_sample_count == 0) {
+        m_srtt = rtt;
+        m_rttvar = rtt / 2;
+    } else {
+        // RTTVAR 须先于 SRTT 更新，用的是旧的 SRTT
+        m_rttvar = (3 * m_rttvar + ::std::abs(m_srtt - rtt)) / 4;
+        m_srtt = (7 * m_srtt + rtt) / 8;
+    }
+    ++m_sample_count;
+    // 得到新样本后退避作废，直接按估计值重算
+    m_rto = ::std::clamp(m_srtt + ::std::max(CLOCK_GRANULARITY, 4 * m_rttvar), MIN_RTO, MAX_RTO);
+
+    // 样本满了丢掉较旧的一半，摊还 O(1)
+    if (m_samples.size() >= MAX_SAMPLES) {
+        m_samples.erase(m_samples.begin(), m_samples.begin() + MAX_SAMPLES / 2);
+    }
+    m_samples.push_back(rtt);
+}
+
+void my::RtoEstimator::backoff() noexcept
+{
+    m_rto = ::std::min(m_rto * 2, MAX_RTO);
+    ++m_backoff_count;
+}
+
+::std::string my::RtoEstimator::toString() const
+{
+    return ::std::format("srtt {:.3f} ms, rttvar {:.3f} ms, rto {:.3f} ms, {} sample(s), {} backoff(s)",
+                         m_srtt / 1000.0, m_rttvar / 1000.0, m_rto / 1000.0, m_sample_count, m_backoff_count);
+}
\ No newline at end of file
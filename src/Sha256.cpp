@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstring>
+
+#include "../include/Sha256.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MY_SHA256_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+    constexpr ::std::uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    constexpr ::std::uint32_t rotr(::std::uint32_t x, int n) noexcept { return (x >> n) | (x << (32 - n)); }
+
+    ::std::uint32_t loadBigEndian(const unsigned char *p) noexcept
+    {
+        return (::std::uint32_t)p[0] << 24 | (::std::uint32_t)p[1] << 16 | (::std::uint32_t)p[2] << 8 | p[3];
+    }
+
+    void compressBlock(::std::uint32_t *state, const unsigned char *block) noexcept
+    {
+        ::std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = loadBigEndian(block + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            ::std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            ::std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        ::std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        ::std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            ::std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            ::std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+    void compressPortable(::std::uint32_t *state, const unsigned char *blocks, ::std::size_t count) noexcept
+    {
+        for (; count > 0; --count, blocks += 64) {
+            compressBlock(state, blocks);
+        }
+    }
+
+#if defined(MY_SHA256_X86)
+    // 状态在寄存器中按 ABEF/CDGH 排列，每条 sha256rnds2 完成两轮
+#if defined(__GNUC__)
+    __attribute__((target("sha,ssse3,sse4.1")))
+#endif
+    void compressShaNi(::std::uint32_t *state, const unsigned char *blocks, ::std::size_t count) noexcept
+    {
+        const __m128i BYTE_SWAP = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+        __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+        for (; count > 0; --count, blocks += 64) {
+            __m128i abef = state0;
+            __m128i cdgh = state1;
+            __m128i w[4];
+            for (int g = 0; g < 16; ++g) {
+                if (g < 4) {
+                    w[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 16 * g)), BYTE_SWAP);
+                } else {
+                    // W[t] = σ1(W[t-2]) + W[t-7] + σ0(W[t-15]) + W[t-16]，四个字一组
+                    __m128i x = _mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4]);
+                    x = _mm_add_epi32(x, _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4));
+                    w[g % 4] = _mm_sha256msg2_epu32(x, w[(g + 3) % 4]);
+                }
+                __m128i msg = _mm_add_epi32(w[g % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(K + 4 * g)));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+            }
+            state0 = _mm_add_epi32(state0, abef);
+            state1 = _mm_add_epi32(state1, cdgh);
+        }
+
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+        state1 = _mm_alignr_epi8(state1, tmp, 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+    }
+
+    bool hasShaExtensions() noexcept
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 29)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)) != 0;
+#endif
+    }
+
+    using Kernel = void (*)(::std::uint32_t *, const unsigned char *, ::std::size_t) noexcept;
+    const Kernel COMPRESS = hasShaExtensions() ? compressShaNi : compressPortable;
+#else
+    constexpr auto COMPRESS = compressPortable;
+#endif
+} // namespace
+
+my::Sha256::Sha256() noexcept
+    : m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void my::Sha256::update(const void *data, ::std::size_t size) noexcept
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    m_length += size;
+
+    if (m_buffered > 0) {
+        ::std::size_t take = ::std::min(size, sizeof(m_buffer) - m_buffered);
+        ::std::memcpy(m_buffer + m_buffered, p, take);
+        m_buffered += take;
+        p += take;
+        size -= take;
+        if (m_buffered < sizeof(m_buffer)) {
+            return;
+        }
+        COMPRESS(m_state, m_buffer, 1);
+        m_buffered = 0;
+    }
+    // 整块直接从输入压缩，不经过缓冲
+    ::std::size_t blocks = size / sizeof(m_buffer);
+    if (blocks > 0) {
+        COMPRESS(m_state, p, blocks);
+        p += blocks * sizeof(m_buffer);
+        size -= blocks * sizeof(m_buffer);
+    }
+    ::std::memcpy(m_buffer, p, size);
+    m_buffered = size;
+}
+
+my::Sha256::Digest my::Sha256::finish() noexcept
+{
+    ::std::uint64_t bit_length = m_length * 8;
+    unsigned char padding[72] = {0x80};
+    ::std::size_t padding_size = (m_buffered < 56 ? 56 : 120) - m_buffered;
+    for (int i = 0; i < 8; ++i) {
+        padding[padding_size + i] = (unsigned char)(bit_length >> (56 - 8 * i));
+    }
+    update(padding, padding_size + 8);
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = (unsigned char)(m_state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(m_state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(m_state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)m_state[i];
+    }
+    return digest;
+}
+
+my::Sha256::Digest my::Sha256::hash(const void *data, ::std::size_t size) noexcept
+{
+    Sha256 sha;
+    sha.update(data, size);
+    return sha.finish();
+}
+
+::std::string my::Sha256::toHex(const Digest &digest)
+{
+    constexpr char DIGITS[] = "0123456789abcdef";
+    ::std::string hex(2 * DIGEST_SIZE, '0');
+    for (int i = 0; i < DIGEST_SIZE; ++i) {
+        hex[2 * i] = DIGITS[digest[i] >> 4];
+        hex[2 * i + 1] = DIGITS[digest[i] & 0xF];
+    }
+    return hex;
+}
\ No newline at end of file
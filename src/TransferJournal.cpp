@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <format>
+
+#include "../include/Crc32c.h"
+#include "../include/TransferJournal.h"
+#include "../include/pretty_log.hpp"
+
+namespace
+{
+    void storeUint32(char *dst, ::std::uint32_t value) noexcept
+    {
+        for (int i = 0; i < 4; ++i) {
+            dst[i] = (char)(value >> (24 - 8 * i));
+        }
+    }
+
+    ::std::uint32_t loadUint32(const char *src) noexcept
+    {
+        ::std::uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value = value << 8 | (unsigned char)src[i];
+        }
+        return value;
+    }
+} // namespace
+
+my::TransferJournal::~TransferJournal()
+{
+    close();
+}
+
+::std::string my::TransferJournal::pathFor(::std::string_view file_path)
+{
+    return ::std::string(file_path) + ::std::string(SUFFIX);
+}
+
+bool my::TransferJournal::isJournal(::std::string_view file_path) noexcept
+{
+    return file_path.ends_with(SUFFIX);
+}
+
+// 文件不存在时返回 0
+::std::uint32_t my::TransferJournal::fileTag(::std::string_view file_path)
+{
+    ::std::error_code ec;
+    ::std::filesystem::path path(file_path);
+    long long identity[2] = {(long long)::std::filesystem::file_size(path, ec), 0};
+    if (ec) {
+        return 0;
+    }
+    identity[1] = (long long)::std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return crc32c(identity, sizeof(identity)) & 0x7FFFFFFF;
+}
+
+bool my::TransferJournal::load(::std::string_view file_path)
+{
+    close();
+    m_path = pathFor(file_path);
+    m_fs.open(m_path, ::std::ios::binary | ::std::ios::in | ::std::ios::out | ::std::ios::ate);
+    if (!m_fs.is_open()) {
+        return false;
+    }
+
+    long long size = m_fs.tellg();
+    char header[HEADER_SIZE];
+    m_fs.seekg(0);
+    if (size < HEADER_SIZE || !m_fs.read(header, HEADER_SIZE) || ::std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+        m_fs.close();
+        return false;
+    }
+    m_tag = loadUint32(header + 4);
+    m_block_size = (int)loadUint32(header + 8);
+    m_bitmap.resize(size - HEADER_SIZE);
+    m_fs.read(reinterpret_cast<char *>(m_bitmap.data()), m_bitmap.size());
+
+    m_received = 0;
+    for (unsigned char byte : m_bitmap) {
+        m_received += ::std::popcount(byte);
+    }
+    m_dirty_begin = m_dirty_end = 0;
+    m_unflushed = 0;
+    return true;
+}
+
+void my::TransferJournal::create(::std::string_view file_path, ::std::uint32_t tag, int block_size)
+{
+    close();
+    m_path = pathFor(file_path);
+    m_fs.open(m_path, ::std::ios::binary | ::std::ios::in | ::std::ios::out | ::std::ios::trunc);
+    if (!m_fs.is_open()) {
+        pretty_out << ::std::format("throw from TransferJournal::create(): Failed to open file \"{0}\"", m_path);
+        throw std::runtime_error("Failed to open file");
+    }
+
+    char header[HEADER_SIZE];
+    ::std::memcpy(header, MAGIC, sizeof(MAGIC));
+    storeUint32(header + 4, tag);
+    storeUint32(header + 8, (::std::uint32_t)block_size);
+    m_fs.write(header, HEADER_SIZE);
+    m_fs.flush();
+
+    m_tag = tag;
+    m_block_size = block_size;
+    m_bitmap.clear();
+    m_received = 0;
+    m_dirty_begin = m_dirty_end = 0;
+    m_unflushed = 0;
+}
+
+my::BlockRanges my::TransferJournal::getMissing() const
+{
+    BlockRanges missing;
+    const int bit_count = (int)m_bitmap.size() * 8;
+    int begin = -1;
+    for (int i = 0; i < bit_count; ++i) {
+        // 整字节已收到时跳过
+        if (begin == -1 && i % 8 == 0 && m_bitmap[i / 8] == 0xFF) {
+            i += 7;
+            continue;
+        }
+        bool received = m_bitmap[i / 8] >> (i % 8) & 1;
+        if (!received && begin == -1) {
+            begin = i;
+        } else if (received && begin != -1) {
+            missing.add(begin, i);
+            begin = -1;
+        }
+    }
+    missing.add(begin == -1 ? bit_count : begin, BlockRanges::END);
+    return missing;
+}
+
+bool my::TransferJournal::markReceived(int block)
+{
+    ::std::size_t byte = block / 8;
+    if (byte >= m_bitmap.size()) {
+        m_bitmap.resize(byte + 1, 0);
+    }
+    unsigned char mask = (unsigned char)(1 << (block % 8));
+    if (!(m_bitmap[byte] & mask)) {
+        m_bitmap[byte] |= mask;
+        ++m_received;
+        if (m_dirty_begin == m_dirty_end) {
+            m_dirty_begin = byte;
+            m_dirty_end = byte + 1;
+        } else {
+            m_dirty_begin = ::std::min(m_dirty_begin, byte);
+            m_dirty_end = ::std::max(m_dirty_end, byte + 1);
+        }
+    }
+    return ++m_unflushed >= FLUSH_BLOCKS;
+}
+
+void my::TransferJournal::flush()
+{
+    m_unflushed = 0;
+    if (!m_fs.is_open() || m_dirty_begin == m_dirty_end) {
+        return;
+    }
+    m_fs.seekp(HEADER_SIZE + (long long)m_dirty_begin);
+    m_fs.write(reinterpret_cast<const char *>(m_bitmap.data() + m_dirty_begin), m_dirty_end - m_dirty_begin);
+    m_fs.flush();
+    m_dirty_begin = m_dirty_end = 0;
+}
+
+void my::TransferJournal::close()
+{
+    if (m_fs.is_open()) {
+        flush();
+        m_fs.close();
+    }
+}
+
+void my::TransferJournal::remove()
+{
+    if (m_fs.is_open()) {
+        m_fs.close();
+    }
+    ::std::error_code ec;
+    ::std::filesystem::remove(m_path, ec);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iterator>
+
+#include "../include/TransferMetrics.h"
+
+namespace
+{
+    struct CounterInfo {
+        const char *name;
+        const char *help;
+    };
+
+    // 与 TransferMetrics::Counter 的顺序一致
+    constexpr CounterInfo COUNTER_INFO[] = {
+        {"frames_sent", "Data frames sent, including retransmissions and end frames"},
+        {"frames_retransmitted", "Data frames sent again after a timeout or fast retransmit"},
+        {"acks_received", "Ack and sack frames received by senders"},
+        {"duplicate_acks", "Ack frames that acknowledged nothing new"},
+        {"timeouts", "Retransmission timer expirations"},
+        {"fast_retransmits", "Fast retransmits triggered by duplicate acks"},
+        {"frames_received", "Data frames received from peers, including corrupted ones"},
+        {"duplicate_frames", "Data frames received more than once"},
+        {"corrupted_frames", "Data frames discarded on checksum mismatch"},
+        {"acks_sent", "Ack and sack frames sent by receivers"},
+        {"simulated_losses", "Frames dropped by the configured loss rates"},
+    };
+    static_assert(::std::size(COUNTER_INFO) == my::TransferMetrics::COUNTER_COUNT);
+} // namespace
+
+void my::TransferMetrics::recordRtt(long long rtt) noexcept
+{
+    // (RTT_FIRST_BOUND << (i - 1), RTT_FIRST_BOUND << i] 落在第 i 桶
+    unsigned long long scaled = (unsigned long long)::std::max(rtt - 1, 0LL) / RTT_FIRST_BOUND;
+    int bucket = ::std::min((int)::std::bit_width(scaled), RTT_BUCKET_COUNT - 1);
+    ++m_rtt_buckets[bucket];
+    ++m_rtt_count;
+    m_rtt_sum += rtt;
+}
+
+void my::TransferMetrics::endTransfer(long long bytes, TimePoint now) noexcept
+{
+    m_last_bytes = bytes;
+    m_last_us = ::std::chrono::duration_cast<::std::chrono::microseconds>(now - m_transfer_start).count();
+    ++m_transfers;
+    m_transfer_bytes += m_last_bytes;
+    m_transfer_us += m_last_us;
+}
+
+long long my::TransferMetrics::getRttQuantile(double q) const noexcept
+{
+    if (m_rtt_count == 0) {
+        return 0;
+    }
+    long long rank = ::std::max(1LL, (long long)(q * m_rtt_count + 0.5));
+    long long seen = 0;
+    for (int bucket = 0; bucket < RTT_BUCKET_COUNT; ++bucket) {
+        seen += m_rtt_buckets[bucket];
+        if (seen >= rank) {
+            return getRttBound(bucket);
+        }
+    }
+    return -1;
+}
+
+double my::TransferMetrics::getGoodput() const noexcept
+{
+    return m_transfer_us > 0 ? m_transfer_bytes * 1e6 / m_transfer_us : 0.0;
+}
+
+double my::TransferMetrics::getLastGoodput() const noexcept
+{
+    return m_last_us > 0 ? m_last_bytes * 1e6 / m_last_us : 0.0;
+}
+
+double my::TransferMetrics::getRetransmitRatio() const noexcept
+{
+    long long sent = get(Counter::FRAMES_SENT);
+    return sent > 0 ? (double)get(Counter::FRAMES_RETRANSMITTED) / sent : 0.0;
+}
+
+// 最近一次传输的字节数与用时取 other 的
+void my::TransferMetrics::merge(const TransferMetrics &other) noexcept
+{
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        m_counters[i] += other.m_counters[i];
+    }
+    for (int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        m_rtt_buckets[i] += other.m_rtt_buckets[i];
+    }
+    m_rtt_count += other.m_rtt_count;
+    m_rtt_sum += other.m_rtt_sum;
+    m_transfers += other.m_transfers;
+    m_transfer_bytes += other.m_transfer_bytes;
+    m_transfer_us += other.m_transfer_us;
+    if (other.m_transfers > 0) {
+        m_last_bytes = other.m_last_bytes;
+        m_last_us = other.m_last_us;
+    }
+}
+
+::std::string my::TransferMetrics::toString() const
+{
+    return ::std::format("{} transfer(s), {} byte(s) in {:.3f} s, goodput {:.2f} MB/s, {} frame(s) sent, {:.2f}% retransmitted",
+                         m_transfers, m_transfer_bytes, m_transfer_us / 1e6, getGoodput() / 1e6,
+                         get(Counter::FRAMES_SENT), getRetransmitRatio() * 100);
+}
+
+::std::string my::TransferMetrics::toPrometheus(::std::string_view prefix) const
+{
+    ::std::string text;
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        text += ::std::format("# HELP {0}_{1}_total {2}\n# TYPE {0}_{1}_total counter\n{0}_{1}_total {3}\n",
+                              prefix, COUNTER_INFO[i].name, COUNTER_INFO[i].help, m_counters[i]);
+    }
+
+    text += ::std::format("# HELP {0}_rtt_microseconds RTT samples of data frames that were not retransmitted\n"
+                          "# TYPE {0}_rtt_microseconds histogram\n",
+                          prefix);
+    long long cumulative = 0;
+    for (int bucket = 0; bucket < RTT_BUCKET_COUNT; ++bucket) {
+        cumulative += m_rtt_buckets[bucket];
+        long long bound = getRttBound(bucket);
+        text += ::std::format("{}_rtt_microseconds_bucket{{le=\"{}\"}} {}\n", prefix, bound < 0 ? "+Inf" : ::std::to_string(bound), cumulative);
+    }
+    text += ::std::format("{0}_rtt_microseconds_sum {1}\n{0}_rtt_microseconds_count {2}\n", prefix, m_rtt_sum, m_rtt_count);
+
+    text += ::std::format("# HELP {0}_transfers_total Completed file transfers\n# TYPE {0}_transfers_total counter\n{0}_transfers_total {1}\n"
+                          "# HELP {0}_transfer_bytes_total File bytes delivered by completed transfers\n# TYPE {0}_transfer_bytes_total counter\n{0}_transfer_bytes_total {2}\n"
+                          "# HELP {0}_transfer_seconds_total Time spent in completed transfers\n# TYPE {0}_transfer_seconds_total counter\n{0}_transfer_seconds_total {3:.6f}\n",
+                          prefix, m_transfers, m_transfer_bytes, m_transfer_us / 1e6);
+    return text;
+}
\ No newline at end of file
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#include "../include/UDPBatchIO.h"
+#include "../include/pretty_log.hpp"
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif
+
+void my::UDPBatchStats::record(int batch_size) noexcept
+{
+    ++m_calls;
+    m_frames += batch_size;
+    m_max_batch = ::std::max(m_max_batch, batch_size);
+}
+
+void my::UDPBatchStats::reset() noexcept
+{
+    m_calls = 0;
+    m_frames = 0;
+    m_max_batch = 0;
+}
+
+double my::UDPBatchStats::getAverageBatch() const noexcept
+{
+    return m_calls == 0 ? 0.0 : (double)m_frames / m_calls;
+}
+
+::std::string my::UDPBatchStats::toString() const
+{
+    return ::std::format("{} frame(s) in {} call(s), avg batch {:.2f}, max batch {}", m_frames, m_calls, getAverageBatch(), m_max_batch);
+}
+
+my::UDPBatchSender::UDPBatchSender()
+{
+    m_frames.reserve(MAX_BATCH);
+#if defined(__linux__) && defined(UDP_SEGMENT)
+    m_segmentation = true;
+#endif
+}
+
+void my::UDPBatchSender::setSegmentationEnabled(bool enabled) noexcept
+{
+#if defined(__linux__) && defined(UDP_SEGMENT)
+    m_segmentation = enabled;
+#else
+    (void)enabled;
+#endif
+}
+
+int my::UDPBatchSender::entrySize(int index) const noexcept
+{
+    const Entry &entry = m_entries[index];
+    return entry.frame >= 0 ? m_frames[entry.frame].m_size : UDPDataframe::HEADER_SIZE + entry.payload_size;
+}
+
+void my::UDPBatchSender::push(UDPDataframe &&dataframe)
+{
+    if (!dataframe.isValid()) {
+        pretty_out << "throw from UDPBatchSender::push(): Not a valid UDPDataframe";
+        throw std::runtime_error("Not a valid UDPDataframe");
+    }
+    if (isFull()) {
+        pretty_out << "throw from UDPBatchSender::push(): Batch is full";
+        throw std::runtime_error("Batch is full");
+    }
+    m_entries[m_count++] = {(int)m_frames.size(), nullptr, 0};
+    m_frames.push_back(::std::move(dataframe));
+}
+
+/**
+ * @brief Queue a DATA frame without copying its payload.
+ * @param payload Must stay valid until the next flush() or clear().
+ */
+void my::UDPBatchSender::push(SeqNum data_num, const char *payload, int payload_size, char flags)
+{
+    if (payload_size < 0 || payload_size > UDPDataframe::MAX_DATA_SIZE) {
+        pretty_out << ::std::format("throw from UDPBatchSender::push(): Invalid payload_size, payload_size = {0}", payload_size);
+        throw std::runtime_error("Invalid payload_size");
+    }
+    if (isFull()) {
+        pretty_out << "throw from UDPBatchSender::push(): Batch is full";
+        throw std::runtime_error("Batch is full");
+    }
+    UDPDataframe::makeDataHeader(m_headers[m_count], data_num, payload, payload_size, flags);
+    m_entries[m_count++] = {-1, payload, payload_size};
+}
+
+void my::UDPBatchSender::clear() noexcept
+{
+    m_frames.clear();
+    m_count = 0;
+}
+
+// 传输结束后丢弃残留的数据帧与确认帧
+// 对端紧接着发来的命令帧可能已被一并收入缓冲，需要保留给命令循环
+void my::UDPBatchReceiver::discardStale() noexcept
+{
+    while (!isEmpty() && !front().isCmd()) {
+        pop();
+    }
+}
+
+// 未取走的帧保持顺序，新帧追加在其后
+bool my::UDPBatchReceiver::push(UDPDataframe &dataframe, const Peer &peer) noexcept
+{
+    if (isEmpty()) {
+        m_pos = m_count = 0;
+    } else if (m_count == (int)m_frames.size() && m_pos > 0) {
+        for (int i = m_pos; i < m_count; ++i) {
+            ::std::swap(m_frames[i - m_pos], m_frames[i]);
+            m_peers[i - m_pos] = m_peers[i];
+        }
+        m_count -= m_pos;
+        m_pos = 0;
+    }
+    if (m_count == (int)m_frames.size()) {
+        if (m_count >= MAX_QUEUED) {
+            return false;
+        }
+        m_frames.emplace_back();
+        m_peers.emplace_back();
+    }
+    ::std::swap(m_frames[m_count], dataframe);
+    m_peers[m_count] = peer;
+    ++m_count;
+    return true;
+}
+
+void my::UDPBatchReceiver::store(const char *data, int size, const sockaddr_in &address)
+{
+    if (m_count == (int)m_frames.size()) {
+        m_frames.emplace_back();
+        m_peers.emplace_back();
+    }
+    m_frames[m_count].assign(data, size);
+    m_peers[m_count].setAddr(address);
+    ++m_count;
+}
+
+#ifdef __linux__
+
+// 从第 first 个帧开始组装消息，返回消息数
+// 开启分段时，连续的等长帧（最后一个可以更短）合成一条带 UDP_SEGMENT 的消息
+int my::UDPBatchSender::buildMessages(int first)
+{
+    int msg_count = 0;
+    int iov_count = 0;
+    for (int i = first; i < m_count;) {
+        int segment_size = entrySize(i);
+        int entries = 1;
+        int total = segment_size;
+        if (m_segmentation) {
+            while (i + entries < m_count && entries < MAX_SEGMENTS) {
+                int size = entrySize(i + entries);
+                if (size > segment_size || total + size > UDPDataframe::MAX_SIZE) {
+                    break;
+                }
+                total += size;
+                ++entries;
+                if (size < segment_size) {
+                    break;
+                }
+            }
+        }
+
+        mmsghdr &msg = m_msgs[msg_count];
+        msg.msg_hdr = {};
+        msg.msg_hdr.msg_iov = m_iovs + iov_count;
+        for (int k = i; k < i + entries; ++k) {
+            const Entry &entry = m_entries[k];
+            if (entry.frame >= 0) {
+                m_iovs[iov_count++] = {m_frames[entry.frame].m_data, (size_t)m_frames[entry.frame].m_size};
+            } else {
+                m_iovs[iov_count++] = {m_headers[k], (size_t)UDPDataframe::HEADER_SIZE};
+                if (entry.payload_size > 0) {
+                    m_iovs[iov_count++] = {const_cast<char *>(entry.payload), (size_t)entry.payload_size};
+                }
+            }
+        }
+        msg.msg_hdr.msg_iovlen = (m_iovs + iov_count) - msg.msg_hdr.msg_iov;
+
+#ifdef UDP_SEGMENT
+        if (entries > 1) {
+            msg.msg_hdr.msg_control = m_controls[msg_count];
+            msg.msg_hdr.msg_controllen = sizeof(m_controls[msg_count]);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(::std::uint16_t));
+            ::std::uint16_t gso_size = (::std::uint16_t)segment_size;
+            ::std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+#endif
+
+        m_msg_entries[msg_count++] = entries;
+        i += entries;
+    }
+    return msg_count;
+}
+
+void my::UDPBatchSender::flush(const Host &host, const Peer &peer_to)
+{
+    // sendmmsg 可能只发出一部分，剩余的重新组装后继续发送
+    int sent = 0;
+    while (sent < m_count) {
+        int msg_count = buildMessages(sent);
+        for (int i = 0; i < msg_count; ++i) {
+            m_msgs[i].msg_hdr.msg_name = const_cast<sockaddr *>(peer_to.getAddrPtr());
+            m_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        int ret = sendmmsg(host.getSocket(), m_msgs, msg_count, 0);
+        if (ret == SOCKET_ERROR) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 网卡或内核不支持分段卸载时退回逐帧发送
+            if (m_segmentation && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                pretty_log << ::std::format("UDP segmentation offload unavailable (errno = {0}), fall back to one datagram per frame", errno);
+                m_segmentation = false;
+                continue;
+            }
+            clear();
+            pretty_out << ::std::format("throw from UDPBatchSender::flush(): sendmmsg() failed, errno = {0}", errno);
+            throw std::runtime_error("sendmmsg() failed");
+        }
+
+        int frames = 0;
+        for (int i = 0; i < ret; ++i) {
+            frames += m_msg_entries[i];
+        }
+        m_stats.record(frames);
+        sent += frames;
+    }
+    clear();
+}
+
+void my::UDPBatchReceiver::enableGro(SOCKET socket) noexcept
+{
+    if (socket == m_gro_socket) {
+        return;
+    }
+    m_gro_socket = socket;
+#ifdef UDP_GRO
+    // 失败时内核不会合并，照常逐个接收
+    int enable = 1;
+    setsockopt(socket, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable));
+#endif
+}
+
+int my::UDPBatchReceiver::recv(const Host &host, bool wait)
+{
+    if (!m_raw) {
+        m_raw.reset(new char[(size_t)MAX_BATCH * RAW_SIZE]);
+    }
+    enableGro(host.getSocket());
+
+    mmsghdr msgs[MAX_BATCH];
+    iovec iovs[MAX_BATCH];
+    sockaddr_in addrs[MAX_BATCH];
+    alignas(cmsghdr) char controls[MAX_BATCH][CMSG_SPACE(sizeof(int))];
+
+    for (int i = 0; i < MAX_BATCH; ++i) {
+        iovs[i].iov_base = m_raw.get() + (size_t)i * RAW_SIZE;
+        iovs[i].iov_len = RAW_SIZE;
+        msgs[i].msg_hdr = {};
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = controls[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    // MSG_WAITFORONE: 阻塞到第一个数据帧到达，之后不再等待
+    int ret;
+    do {
+        ret = recvmmsg(host.getSocket(), msgs, MAX_BATCH, wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+    } while (ret == SOCKET_ERROR && errno == EINTR);
+
+    if (isEmpty()) {
+        m_pos = m_count = 0;
+    }
+    if (ret == SOCKET_ERROR) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        pretty_out << ::std::format("throw from UDPBatchReceiver::recv(): recvmmsg() failed, errno = {0}", errno);
+        throw std::runtime_error("recvmmsg() failed");
+    }
+
+    int before = m_count;
+    for (int i = 0; i < ret; ++i) {
+        const char *data = static_cast<const char *>(iovs[i].iov_base);
+        int size = (int)msgs[i].msg_len;
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            ++m_truncated;
+            continue;
+        }
+
+        // 没有 UDP_GRO 控制信息时整个数据报就是一个帧
+        int segment_size = size;
+#ifdef UDP_GRO
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int gso_size;
+                ::std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                if (gso_size > 0 && gso_size < size) {
+                    segment_size = gso_size;
+                    ++m_coalesced;
+                }
+            }
+        }
+#endif
+        for (int offset = 0; offset < size; offset += segment_size) {
+            store(data + offset, ::std::min(segment_size, size - offset), addrs[i]);
+        }
+    }
+    m_stats.record(m_count - before);
+    return m_count - before;
+}
+
+#else
+
+void my::UDPBatchSender::flush(const Host &host, const Peer &peer_to)
+{
+    // 无 sendmmsg 时逐帧发送，统计如实记录每次调用只发送一帧
+    for (int i = 0; i < m_count; ++i) {
+        const Entry &entry = m_entries[i];
+        int ret;
+        if (entry.frame >= 0) {
+            const UDPDataframe &dataframe = m_frames[entry.frame];
+            ret = sendto(host.getSocket(), dataframe.m_data, dataframe.m_size, 0, peer_to.getAddrPtr(), sizeof(sockaddr));
+        } else {
+#ifdef _WIN32
+            WSABUF bufs[2] = {{UDPDataframe::HEADER_SIZE, m_headers[i]}, {(ULONG)entry.payload_size, const_cast<char *>(entry.payload)}};
+            DWORD bytes_sent;
+            ret = WSASendTo(host.getSocket(), bufs, entry.payload_size > 0 ? 2 : 1, &bytes_sent, 0, peer_to.getAddrPtr(), sizeof(sockaddr), nullptr, nullptr);
+#else
+            iovec iovs[2] = {{m_headers[i], UDPDataframe::HEADER_SIZE}, {const_cast<char *>(entry.payload), (size_t)entry.payload_size}};
+            msghdr msg = {};
+            msg.msg_name = const_cast<sockaddr *>(peer_to.getAddrPtr());
+            msg.msg_namelen = sizeof(sockaddr_in);
+            msg.msg_iov = iovs;
+            msg.msg_iovlen = entry.payload_size > 0 ? 2 : 1;
+            ret = sendmsg(host.getSocket(), &msg, 0);
+#endif
+        }
+        if (ret == SOCKET_ERROR) {
+            clear();
+            pretty_out << ::std::format("throw from UDPBatchSender::flush(): send failed, WSAGetLastError() = {0}", WSAGetLastError());
+            throw std::runtime_error("send failed");
+        }
+        m_stats.record(1);
+    }
+    clear();
+}
+
+void my::UDPBatchReceiver::enableGro(SOCKET socket) noexcept
+{
+    m_gro_socket = socket;
+}
+
+int my::UDPBatchReceiver::recv(const Host &host, bool wait)
+{
+    if (!m_raw) {
+        m_raw.reset(new char[RAW_SIZE]);
+    }
+    if (isEmpty()) {
+        m_pos = m_count = 0;
+    }
+
+    // 无 recvmmsg 时逐帧接收，直到接收缓冲区为空
+    int count = 0;
+    while (count < MAX_BATCH) {
+        if (count > 0 || !wait) {
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(host.getSocket(), &readfds);
+            TIMEVAL timeout = {0, 0};
+            if (select(host.getSocket() + 1, &readfds, nullptr, nullptr, &timeout) <= 0) {
+                break;
+            }
+        }
+
+        sockaddr_in peer_addr;
+        socklen_t addr_len = sizeof(peer_addr);
+        int recv_size = recvfrom(host.getSocket(), m_raw.get(), RAW_SIZE, 0, reinterpret_cast<sockaddr *>(&peer_addr), &addr_len);
+        if (recv_size == SOCKET_ERROR) {
+            pretty_out << ::std::format("throw from UDPBatchReceiver::recv(): recvfrom() failed, WSAGetLastError() = {0}", WSAGetLastError());
+            throw std::runtime_error("recvfrom() failed");
+        }
+        store(m_raw.get(), recv_size, peer_addr);
+        m_stats.record(1);
+        ++count;
+    }
+    return count;
+}
+
+#endif
\ No newline at end of file
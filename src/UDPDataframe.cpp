@@ -1,48 +1,89 @@
+#include <algorithm>
 #include <cstring>
 #include <format>
 
+#include "../include/Crc32c.h"
 #include "../include/UDPDataframe.h"
+#include "../include/UDPFramePool.h"
 #include "../include/pretty_log.hpp"
 
-my::UDPDataframe::UDPDataframe()
+namespace
 {
-    m_data = new char[MAX_SIZE + 1];
+    // 帧头中的多字节字段按网络字节序存放，memcpy 避免非对齐访问
+    ::my::SeqNum loadSeqNum(const char *src) noexcept
+    {
+        ::std::uint32_t value;
+        ::std::memcpy(&value, src, sizeof(value));
+        return ntohl(value);
+    }
+
+    void storeSeqNum(char *dst, ::my::SeqNum seq_num) noexcept
+    {
+        ::std::uint32_t value = htonl(seq_num);
+        ::std::memcpy(dst, &value, sizeof(value));
+    }
+
+    void storeAckHeader(char *dst, ::my::SeqNum ack_num) noexcept
+    {
+        dst[0] = ::my::UDPDataframe::ACK;
+        dst[1] = 0;
+        dst[2] = 0;
+        dst[3] = 0;
+        storeSeqNum(dst + 4, ack_num);
+        storeSeqNum(dst + 8, 0);
+    }
+
+    // 校验和字段不参与计算
+    ::std::uint32_t dataChecksum(const char *header, const char *payload, int data_size) noexcept
+    {
+        return ::my::crc32c(payload, data_size, ::my::crc32c(header, 8));
+    }
+} // namespace
+
+my::UDPDataframe::UDPDataframe() : UDPDataframe(DEFAULT_SIZE) {}
+
+my::UDPDataframe::UDPDataframe(int capacity)
+{
+    m_data = UDPFramePool::acquire(capacity);
+    m_capacity = UDPFramePool::capacityOf(capacity);
     m_data[0] = NONE;
     m_size = 0;
 }
 
 my::UDPDataframe::UDPDataframe(const char *buffer, int recv_size) : m_size(recv_size)
 {
-    m_data = new char[MAX_SIZE + 1];
-    if (buffer[0] != ACK && buffer[0] != DATA && buffer[0] != CMD) {
+    if (buffer[0] != ACK && buffer[0] != SACK && buffer[0] != DATA && buffer[0] != CMD && buffer[0] != PROBE && buffer[0] != PROBE_ACK) {
         pretty_out << ::std::format("throw from UDPDataframe::UDPDataframe(): Invalid UDPDataframe type, buffer[0] = {0}", (int)buffer[0]);
         throw std::runtime_error("Invalid UDPDataframe type");
     }
-    if (recv_size > MAX_DATA_SIZE + 4) {
+    if (recv_size > MAX_SIZE) {
         pretty_out << ::std::format("throw from UDPDataframe::UDPDataframe(): Size too large, recv_size = {0}", recv_size);
         throw std::runtime_error("Size too large");
     }
+    m_data = UDPFramePool::acquire(recv_size);
+    m_capacity = UDPFramePool::capacityOf(recv_size);
     ::std::memcpy(m_data, buffer, recv_size);
 }
 
 my::UDPDataframe::UDPDataframe(const UDPDataframe &other) : m_size(other.m_size)
 {
-    m_data = new char[MAX_SIZE + 1];
+    m_data = UDPFramePool::acquire(m_size);
+    m_capacity = UDPFramePool::capacityOf(m_size);
     ::std::memcpy(m_data, other.m_data, m_size);
 }
 
 my::UDPDataframe::UDPDataframe(UDPDataframe &&other) noexcept
-    : m_data(other.m_data), m_size(other.m_size)
+    : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity)
 {
     other.m_data = nullptr;
     other.m_size = 0;
+    other.m_capacity = 0;
 }
 
 my::UDPDataframe &my::UDPDataframe::operator=(const UDPDataframe &other)
 {
     if (this != &other) {
-        m_size = other.m_size;
-        ::std::memcpy(m_data, other.m_data, m_size);
+        assign(other.m_data, other.m_size);
     }
     return *this;
 }
@@ -50,18 +91,39 @@ my::UDPDataframe &my::UDPDataframe::operator=(const UDPDataframe &other)
 my::UDPDataframe &my::UDPDataframe::operator=(UDPDataframe &&other) noexcept
 {
     if (this != &other) {
-        delete[] m_data;
+        UDPFramePool::release(m_data, m_capacity);
         m_data = other.m_data;
         m_size = other.m_size;
+        m_capacity = other.m_capacity;
         other.m_data = nullptr;
         other.m_size = 0;
+        other.m_capacity = 0;
     }
     return *this;
 }
 
 my::UDPDataframe::~UDPDataframe()
 {
-    delete[] m_data;
+    UDPFramePool::release(m_data, m_capacity);
+}
+
+// 缓冲不够大，或比 size 所需的级别大时换一个，避免小帧长期占着大缓冲
+void my::UDPDataframe::assign(const char *buffer, int size)
+{
+    if (size < 0 || size > MAX_SIZE) {
+        pretty_out << ::std::format("throw from UDPDataframe::assign(): Invalid size, size = {0}", size);
+        throw std::runtime_error("Invalid size");
+    }
+    int capacity = UDPFramePool::capacityOf(size);
+    if (!m_data || m_capacity != capacity) {
+        UDPFramePool::release(m_data, m_capacity);
+        m_data = UDPFramePool::acquire(size);
+        m_capacity = capacity;
+    }
+    ::std::memcpy(m_data, buffer, size);
+    // 留出的 1 字节作为命令帧的结尾
+    m_data[size] = '\0';
+    m_size = size;
 }
 
 void my::UDPDataframe::setType(Type type)
@@ -71,7 +133,7 @@ void my::UDPDataframe::setType(Type type)
 
 bool my::UDPDataframe::isValid() const noexcept
 {
-    return m_data[0] == ACK || m_data[0] == DATA || m_data[0] == CMD;
+    return m_data[0] == ACK || m_data[0] == SACK || m_data[0] == DATA || m_data[0] == CMD || m_data[0] == PROBE || m_data[0] == PROBE_ACK;
 }
 
 bool my::UDPDataframe::isAck() const noexcept
@@ -79,9 +141,9 @@ bool my::UDPDataframe::isAck() const noexcept
     return m_data[0] == ACK;
 }
 
-bool my::UDPDataframe::isAck(char ack_num) const noexcept
+bool my::UDPDataframe::isAck(SeqNum ack_num) const noexcept
 {
-    return m_data[0] == ACK && m_data[1] == ack_num;
+    return m_data[0] == ACK && loadSeqNum(m_data + 4) == ack_num;
 }
 
 bool my::UDPDataframe::isData() const noexcept
@@ -94,14 +156,56 @@ bool my::UDPDataframe::isCmd() const noexcept
     return m_data[0] == CMD;
 }
 
+bool my::UDPDataframe::isSack() const noexcept
+{
+    return m_data[0] == SACK;
+}
+
+bool my::UDPDataframe::isProbe() const noexcept
+{
+    return m_data[0] == PROBE;
+}
+
+bool my::UDPDataframe::isProbeAck() const noexcept
+{
+    return m_data[0] == PROBE_ACK;
+}
+
+bool my::UDPDataframe::isFin() const noexcept
+{
+    return m_data[0] == DATA && (m_data[1] & FLAG_FIN);
+}
+
+bool my::UDPDataframe::isCompressed() const noexcept
+{
+    return m_data[0] == DATA && (m_data[1] & FLAG_COMPRESSED);
+}
+
+// 长度字段与实际收到的长度也须一致，否则载荷越界
+bool my::UDPDataframe::verifyChecksum() const noexcept
+{
+    if (m_data[0] != DATA) {
+        return true;
+    }
+    if (m_size < HEADER_SIZE) {
+        return false;
+    }
+    ::std::uint16_t size;
+    ::std::memcpy(&size, m_data + 2, sizeof(size));
+    int data_size = ntohs(size);
+    return data_size == m_size - HEADER_SIZE && loadSeqNum(m_data + 8) == dataChecksum(m_data, m_data + HEADER_SIZE, data_size);
+}
+
 const char *my::UDPDataframe::data(int &data_size) const
 {
     if (!isData()) {
         pretty_out << "throw from UDPDataframe::data(): Not a DATA frame";
         throw std::runtime_error("Not a DATA frame");
     }
-    data_size = *reinterpret_cast<const short *>(m_data + 2);
-    return m_data + 4;
+    ::std::uint16_t size;
+    ::std::memcpy(&size, m_data + 2, sizeof(size));
+    data_size = ntohs(size);
+    return m_data + HEADER_SIZE;
 }
 
 const char *my::UDPDataframe::cmd() const
@@ -113,71 +217,149 @@ const char *my::UDPDataframe::cmd() const
     return m_data + 1;
 }
 
-char my::UDPDataframe::getDataNum() const
+my::SeqNum my::UDPDataframe::getDataNum() const
 {
     if (!isData()) {
         pretty_out << "throw from UDPDataframe::dataNum(): Not a DATA frame";
         throw std::runtime_error("Not a DATA frame");
     }
-    return *reinterpret_cast<const char *>(m_data + 1);
+    return loadSeqNum(m_data + 4);
 }
 
-void my::UDPDataframe::setDataNum(char data_num)
+void my::UDPDataframe::setDataNum(SeqNum data_num)
 {
     if (!isData()) {
         pretty_out << "throw from UDPDataframe::transDataNum(): Not a DATA frame";
         throw std::runtime_error("Not a DATA frame");
     }
-    m_data[1] = (char)data_num;
+    storeSeqNum(m_data + 4, data_num);
+    storeSeqNum(m_data + 8, dataChecksum(m_data, m_data + HEADER_SIZE, m_size - HEADER_SIZE));
 }
 
-char my::UDPDataframe::getAckNum() const
+// SACK 帧返回其累计确认号
+my::SeqNum my::UDPDataframe::getAckNum() const
 {
-    if (!isAck()) {
+    if (!isAck() && !isSack()) {
         pretty_out << "throw from UDPDataframe::ackNum(): Not an ACK frame";
         throw std::runtime_error("Not an ACK frame");
     }
-    return *reinterpret_cast<const char *>(m_data + 1);
+    return loadSeqNum(m_data + 4);
 }
 
-void my::UDPDataframe::setAckNum(char ack_num)
+void my::UDPDataframe::setAckNum(SeqNum ack_num)
 {
     if (!isAck()) {
         pretty_out << "throw from UDPDataframe::transAckNum(): Not an ACK frame";
         throw std::runtime_error("Not an ACK frame");
     }
-    m_data[1] = (char)ack_num;
+    storeSeqNum(m_data + 4, ack_num);
 }
 
-my::UDPDataframe my::UDPAck(char ack_num)
+const unsigned char *my::UDPDataframe::sackBitmap(int &bitmap_size) const
+{
+    if (!isSack()) {
+        pretty_out << "throw from UDPDataframe::sackBitmap(): Not a SACK frame";
+        throw std::runtime_error("Not a SACK frame");
+    }
+    ::std::uint16_t size;
+    ::std::memcpy(&size, m_data + 2, sizeof(size));
+    // 以实际收到的长度为准，防止畸形帧越界
+    bitmap_size = ::std::min<int>(ntohs(size), m_size - HEADER_SIZE);
+    return reinterpret_cast<const unsigned char *>(m_data + HEADER_SIZE);
+}
+
+int my::UDPDataframe::getProbeSize() const
+{
+    if (isProbe()) {
+        return m_size;
+    }
+    if (!isProbeAck()) {
+        pretty_out << "throw from UDPDataframe::getProbeSize(): Not a PROBE or PROBE_ACK frame";
+        throw std::runtime_error("Not a PROBE or PROBE_ACK frame");
+    }
+    return (int)loadSeqNum(m_data + 4);
+}
+
+void my::UDPDataframe::makeDataHeader(char *header, SeqNum data_num, const char *payload, int data_size, char flags) noexcept
+{
+    header[0] = DATA;
+    header[1] = flags;
+    ::std::uint16_t size = htons((::std::uint16_t)data_size);
+    ::std::memcpy(header + 2, &size, sizeof(size));
+    storeSeqNum(header + 4, data_num);
+    storeSeqNum(header + 8, dataChecksum(header, payload, data_size));
+}
+
+my::UDPDataframe my::UDPAck(SeqNum ack_num)
 {
     UDPDataframe frame;
-    frame.m_data[0] = UDPDataframe::ACK;
-    frame.m_data[1] = (char)ack_num;
-    frame.m_size = 2;
+    storeAckHeader(frame.m_data, ack_num);
+    frame.m_size = UDPDataframe::HEADER_SIZE;
     return frame;
 }
 
-my::UDPDataframe my::UDPData(char data_num, const char *data, int data_size)
+my::UDPDataframe my::UDPSack(SeqNum cum_ack, const unsigned char *bitmap, int bitmap_size)
+{
+    if (bitmap_size < 0 || bitmap_size > UDPDataframe::MAX_DATA_SIZE) {
+        pretty_out << ::std::format("throw from my::UDPSack(): Invalid bitmap_size, bitmap_size = {0}", bitmap_size);
+        throw std::runtime_error("Invalid bitmap_size");
+    }
+
+    UDPDataframe frame(UDPDataframe::HEADER_SIZE + bitmap_size);
+    frame.m_data[0] = UDPDataframe::SACK;
+    frame.m_data[1] = 0;
+    ::std::uint16_t size = htons((::std::uint16_t)bitmap_size);
+    ::std::memcpy(frame.m_data + 2, &size, sizeof(size));
+    storeSeqNum(frame.m_data + 4, cum_ack);
+    storeSeqNum(frame.m_data + 8, 0);
+    ::std::memcpy(frame.m_data + UDPDataframe::HEADER_SIZE, bitmap, bitmap_size);
+    frame.m_size = UDPDataframe::HEADER_SIZE + bitmap_size;
+    return frame;
+}
+
+// 填充部分置零，内容无意义，只有长度重要
+my::UDPDataframe my::UDPProbe(int size)
+{
+    if (size < UDPDataframe::HEADER_SIZE || size > UDPDataframe::MAX_SIZE) {
+        pretty_out << ::std::format("throw from my::UDPProbe(): Invalid size, size = {0}", size);
+        throw std::runtime_error("Invalid size");
+    }
+
+    UDPDataframe frame(size);
+    ::std::memset(frame.m_data, 0, size);
+    frame.m_data[0] = UDPDataframe::PROBE;
+    storeSeqNum(frame.m_data + 4, (SeqNum)size);
+    frame.m_size = size;
+    return frame;
+}
+
+my::UDPDataframe my::UDPProbeAck(int size)
+{
+    UDPDataframe frame;
+    storeAckHeader(frame.m_data, (SeqNum)size);
+    frame.m_data[0] = UDPDataframe::PROBE_ACK;
+    frame.m_size = UDPDataframe::HEADER_SIZE;
+    return frame;
+}
+
+my::UDPDataframe my::UDPData(SeqNum data_num, const char *data, int data_size, char flags)
 {
     if (data_size > UDPDataframe::MAX_DATA_SIZE) {
         pretty_out << ::std::format("throw from my::UDPData(): Size too large, data_size = {0}, MAX_DATA_SIZE = {1}", data_size, UDPDataframe::MAX_DATA_SIZE);
         throw std::runtime_error("Size too large");
     }
 
-    UDPDataframe frame;
-    frame.m_data[0] = UDPDataframe::DATA;
-    frame.m_data[1] = (char)data_num;
-    *reinterpret_cast<short *>(frame.m_data + 2) = (short)data_size;
-    ::std::memcpy(frame.m_data + 4, data, data_size);
-    frame.m_size = data_size + 4;
+    UDPDataframe frame(UDPDataframe::HEADER_SIZE + data_size);
+    ::std::memcpy(frame.m_data + UDPDataframe::HEADER_SIZE, data, data_size);
+    UDPDataframe::makeDataHeader(frame.m_data, data_num, data, data_size, flags);
+    frame.m_size = data_size + UDPDataframe::HEADER_SIZE;
     return frame;
 }
 
 my::UDPDataframe my::UDPCmd(::std::string_view cmd)
 {
-    if (cmd.size() > UDPDataframe::MAX_DATA_SIZE) {
-        pretty_out << ::std::format("throw from my::UDPCmd(): Size too large, cmd.size() = {0}, MAX_DATA_SIZE = {1}", cmd.size(), UDPDataframe::MAX_DATA_SIZE);
+    if (cmd.size() > UDPDataframe::DEFAULT_DATA_SIZE) {
+        pretty_out << ::std::format("throw from my::UDPCmd(): Size too large, cmd.size() = {0}, DEFAULT_DATA_SIZE = {1}", cmd.size(), UDPDataframe::DEFAULT_DATA_SIZE);
         throw std::runtime_error("Size too large");
     }
 
@@ -190,10 +372,10 @@ my::UDPDataframe my::UDPCmd(::std::string_view cmd)
 
 my::UDPDataframe my::recvUDPDataframeFrom(const Host &host, Peer &peer_from)
 {
-    UDPDataframe frame;
+    UDPDataframe frame(UDPDataframe::MAX_SIZE);
 
     sockaddr_in peer_addr;
-    int addr_len = sizeof(peer_addr);
+    socklen_t addr_len = sizeof(peer_addr);
     int recv_size = recvfrom(host.getSocket(), frame.m_data, frame.MAX_SIZE, 0, reinterpret_cast<sockaddr *>(&peer_addr), &addr_len);
 
     if (recv_size == SOCKET_ERROR) {
@@ -219,7 +401,7 @@ void my::sendUDPDataframeTo(const UDPDataframe &dataframe, const Host &host, con
     }
 }
 
-char my::recvAckFrom(const Host &host, Peer &peer_from)
+my::SeqNum my::recvAckFrom(const Host &host, Peer &peer_from)
 {
     UDPDataframe frame = recvUDPDataframeFrom(host, peer_from);
     if (!frame.isAck()) {
@@ -229,10 +411,11 @@ char my::recvAckFrom(const Host &host, Peer &peer_from)
     return frame.getAckNum();
 }
 
-void my::sendAckTo(char ack_num, const Host &host, const Peer &peer_to)
+void my::sendAckTo(SeqNum ack_num, const Host &host, const Peer &peer_to)
 {
-    char buffer[3] = {UDPDataframe::ACK, ack_num, 0};
-    if (sendto(host.getSocket(), buffer, 2, 0, peer_to.getAddrPtr(), sizeof(sockaddr)) == SOCKET_ERROR) {
+    char buffer[UDPDataframe::HEADER_SIZE];
+    storeAckHeader(buffer, ack_num);
+    if (sendto(host.getSocket(), buffer, UDPDataframe::HEADER_SIZE, 0, peer_to.getAddrPtr(), sizeof(sockaddr)) == SOCKET_ERROR) {
         pretty_out << ::std::format("throw from my::sendAckTo(): sendto() failed, WSAGetLastError() = {0}", WSAGetLastError());
         throw std::runtime_error("sendto() failed");
     }
@@ -250,7 +433,12 @@ void my::sendAckTo(char ack_num, const Host &host, const Peer &peer_to)
 
 void my::sendCmdTo(::std::string_view cmd, const Host &host, const Peer &peer_to)
 {
-    char buffer[UDPDataframe::MAX_SIZE + 2];
+    if (cmd.size() > UDPDataframe::DEFAULT_DATA_SIZE) {
+        pretty_out << ::std::format("throw from my::sendCmdTo(): Size too large, cmd.size() = {0}, DEFAULT_DATA_SIZE = {1}", cmd.size(), UDPDataframe::DEFAULT_DATA_SIZE);
+        throw std::runtime_error("Size too large");
+    }
+
+    char buffer[UDPDataframe::DEFAULT_SIZE + 2];
     buffer[0] = UDPDataframe::CMD;
     ::std::memcpy(buffer + 1, cmd.data(), cmd.size());
     buffer[cmd.size() + 1] = '\0';
@@ -259,4 +447,10 @@ void my::sendCmdTo(::std::string_view cmd, const Host &host, const Peer &peer_to
         pretty_out << ::std::format("throw from my::sendCmdTo(): sendto() failed, WSAGetLastError() = {0}", WSAGetLastError());
         throw std::runtime_error("sendto() failed");
     }
+}
+
+bool my::sendProbeTo(int size, const Host &host, const Peer &peer_to)
+{
+    UDPDataframe frame = UDPProbe(size);
+    return sendto(host.getSocket(), frame.m_data, frame.m_size, 0, peer_to.getAddrPtr(), sizeof(sockaddr)) != SOCKET_ERROR;
 }
\ No newline at end of file
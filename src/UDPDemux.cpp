@@ -0,0 +1,114 @@
+#include <format>
+#include <stdexcept>
+
+#include "../include/UDPDemux.h"
+#include "../include/pretty_log.hpp"
+
+unsigned long long my::UDPDemux::keyOf(const Peer &peer) noexcept
+{
+    sockaddr_in address = peer.getAddr();
+    return ((unsigned long long)address.sin_addr.s_addr << 16) | address.sin_port;
+}
+
+void my::UDPDemux::attach(const Peer &peer, UDPBatchReceiver &inbox)
+{
+    if (!m_routes.try_emplace(keyOf(peer), Route{&inbox}).second) {
+        pretty_out << ::std::format("throw from UDPDemux::attach(): Peer {} already attached", peer.toString());
+        throw std::runtime_error("Peer already attached");
+    }
+}
+
+void my::UDPDemux::detach(const Peer &peer) noexcept
+{
+    m_routes.erase(keyOf(peer));
+}
+
+void my::UDPDemux::waitFrames(const Peer &peer, TimePoint deadline, ::std::coroutine_handle<> handle, bool *delivered)
+{
+    auto it = m_routes.find(keyOf(peer));
+    if (it == m_routes.end()) {
+        pretty_out << ::std::format("throw from UDPDemux::waitFrames(): Peer {} not attached", peer.toString());
+        throw std::runtime_error("Peer not attached");
+    }
+    CoScheduler *scheduler = CoScheduler::current();
+    if (scheduler == nullptr) {
+        pretty_out << "throw from UDPDemux::waitFrames(): No scheduler running on this thread";
+        throw std::runtime_error("No scheduler running on this thread");
+    }
+    it->second.waiter = scheduler->waitSignal(deadline, handle, delivered);
+    it->second.waiting = true;
+}
+
+void my::UDPDemux::ReadableAwaiter::await_suspend(::std::coroutine_handle<> handle)
+{
+    CoScheduler *scheduler = CoScheduler::current();
+    if (scheduler == nullptr) {
+        pretty_out << "throw from UDPDemux::ReadableAwaiter::await_suspend(): No scheduler running on this thread";
+        throw std::runtime_error("No scheduler running on this thread");
+    }
+    scheduler->waitReadable(m_socket, TimePoint::max(), handle, &m_readable);
+}
+
+my::CoTask my::UDPDemux::co_run(AcceptHandler on_new_peer)
+{
+    while (true) {
+        co_await ReadableAwaiter(m_host.getSocket());
+        try {
+            m_inbox.recv(m_host, false);
+            dispatch(on_new_peer);
+        } catch (const ::std::runtime_error &e) {
+            m_inbox.clear();
+            pretty_out << ::std::format("catch by UDPDemux::co_run():") << e.what();
+        }
+    }
+}
+
+// 会话来不及取走时缓冲会满，多出的帧按丢失处理，由协议重传
+void my::UDPDemux::dispatch(const AcceptHandler &on_new_peer)
+{
+    for (; !m_inbox.isEmpty(); m_inbox.pop()) {
+        UDPDataframe &frame = m_inbox.front();
+        const Peer &peer = m_inbox.frontPeer();
+        if (frame.isProbe()) {
+            // 路径 MTU 探测与会话无关，直接应答，客户端可以在请求之前探测
+            sendUDPDataframeTo(UDPProbeAck(frame.getProbeSize()), m_host, peer);
+            ++m_probes_answered;
+            continue;
+        }
+        unsigned long long key = keyOf(peer);
+
+        auto it = m_routes.find(key);
+        if (it == m_routes.end()) {
+            // 只有命令帧能开启新会话，其余是已结束会话的残留
+            if (!frame.isCmd() || !on_new_peer(frame, peer) || (it = m_routes.find(key)) == m_routes.end()) {
+                ++m_dropped;
+                continue;
+            }
+        }
+
+        Route &route = it->second;
+        if (!route.inbox->push(frame, peer)) {
+            ++m_dropped;
+            continue;
+        }
+        if (route.delivered++ == 0) {
+            m_touched.push_back(key);
+        }
+    }
+
+    CoScheduler *scheduler = CoScheduler::current();
+    for (unsigned long long key : m_touched) {
+        auto it = m_routes.find(key);
+        if (it == m_routes.end()) {
+            continue;
+        }
+        Route &route = it->second;
+        route.inbox->recordDelivery(route.delivered);
+        route.delivered = 0;
+        if (route.waiting) {
+            route.waiting = false;
+            scheduler->signal(route.waiter);
+        }
+    }
+    m_touched.clear();
+}
\ No newline at end of file
@@ -1,10 +1,30 @@
 #include "../include/UDPFileReader.h"
 #include "../include/pretty_log.hpp"
 
+#include <cstring>
 #include <format>
 
-::my::UDPFileReader::UDPFileReader(::std::string_view filename)
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+::my::UDPFileReader::UDPFileReader(::std::string_view filename, Mode mode, int block_size) : m_mode(mode), m_block_size(block_size)
 {
+    if (block_size <= 0 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+        pretty_out << ::std::format("throw from UDPFileReader::UDPFileReader(): Invalid block_size, block_size = {0}", block_size);
+        throw std::runtime_error("Invalid block_size");
+    }
+
+    // 映射失败（如空文件）时退回到流式读取
+    if (m_mode == Mode::MAPPED && map(filename)) {
+        m_block_count = (m_file_size + m_block_size - 1) / m_block_size;
+        m_file_block_count = m_block_count;
+        return;
+    }
+    m_mode = Mode::STREAM;
+
     m_ifs.open(filename.data(), ::std::ios::binary);
     if (!m_ifs.is_open()) {
         pretty_out << ::std::format("throw from UDPFileReader::UDPFileReader(): Failed to open file \"{0}\"", filename);
@@ -13,7 +33,8 @@
 
     m_ifs.seekg(0, ::std::ios::end);
     m_file_size = m_ifs.tellg();
-    m_block_count = (m_file_size + UDPDataframe::MAX_DATA_SIZE - 1) / UDPDataframe::MAX_DATA_SIZE;
+    m_block_count = (m_file_size + m_block_size - 1) / m_block_size;
+    m_file_block_count = m_block_count;
     m_ifs.seekg(0, ::std::ios::beg);
 }
 
@@ -24,6 +45,7 @@
 
 void ::my::UDPFileReader::close()
 {
+    unmap();
     m_ifs.close();
 }
 
@@ -32,6 +54,60 @@ int ::my::UDPFileReader::getBlockCount()
     return m_block_count;
 }
 
+void my::UDPFileReader::selectBlocks(BlockRanges ranges)
+{
+    m_ranges = ::std::move(ranges);
+    m_block_count = m_ranges.clip(m_file_block_count);
+}
+
+// 只有文件的最后一块可能不满
+long long my::UDPFileReader::getSelectedSize() const noexcept
+{
+    if (m_block_count == 0) {
+        return 0;
+    }
+    return (long long)(m_block_count - 1) * m_block_size + getBlockSize(toFileBlock(m_block_count - 1));
+}
+
+// 块号换算为文件中的块号，结束块对应文件末尾
+int my::UDPFileReader::toFileBlock(int block_num) const noexcept
+{
+    return block_num == m_block_count ? m_file_block_count : m_ranges.map(block_num);
+}
+
+int my::UDPFileReader::getBlockSize(int file_block) const noexcept
+{
+    if (file_block == m_file_block_count) {
+        return 0;
+    }
+    long long remain = m_file_size - (long long)file_block * m_block_size;
+    return remain < m_block_size ? (int)remain : m_block_size;
+}
+
+/**
+ * @brief Get a pointer to the content of a block.
+ * @param block_num Block number, block_count stands for the empty end block.
+ *                  After selectBlocks() it counts only the selected blocks.
+ * @param data Set to the first byte of the block. In MAPPED mode it points into the mapping
+ *             and stays valid until the reader is closed, in STREAM mode it is not set.
+ * @return Size of the block in bytes.
+ */
+int my::UDPFileReader::getBlock(int block_num, const char *&data)
+{
+    if (block_num < 0 || block_num > m_block_count) {
+        pretty_out << ::std::format("throw from UDPFileReader::getBlock(): Invalid block_num, block_num = {0}", block_num);
+        throw std::runtime_error("Invalid block_num");
+    }
+    if (m_mode != Mode::MAPPED) {
+        pretty_out << "throw from UDPFileReader::getBlock(): File is not mapped";
+        throw std::runtime_error("File is not mapped");
+    }
+
+    int file_block = toFileBlock(block_num);
+    data = m_map + (long long)file_block * m_block_size;
+    return getBlockSize(file_block);
+}
+
 ::my::UDPDataframe my::UDPFileReader::getDataframe(int block_num)
 {
     if (block_num < 0 || block_num > m_block_count) {
@@ -39,26 +115,106 @@ int ::my::UDPFileReader::getBlockCount()
         throw std::runtime_error("Invalid block_num");
     }
 
-    UDPDataframe dataframe;
-    dataframe.m_data[0] = UDPDataframe::DATA;
-    dataframe.m_data[1] = (char)0;
-
-    // 如果是最后一个数据块
-    if (block_num == m_block_count) {
-        // 发送一个空数据块
-        *reinterpret_cast<short *>(dataframe.m_data + 2) = 0;
-        dataframe.m_size = 4;
-    } else {
-        // 发送一个正常的数据块
-        m_ifs.seekg(block_num * UDPDataframe::MAX_DATA_SIZE, ::std::ios::beg);
-        int can_get_size = (block_num < m_block_count - 1) ? UDPDataframe::MAX_DATA_SIZE : m_file_size % UDPDataframe::MAX_DATA_SIZE;
-        *reinterpret_cast<short *>(dataframe.m_data + 2) = (short)can_get_size;
-        m_ifs.read(dataframe.m_data + 4, can_get_size);
-        dataframe.m_size = can_get_size + 4;
+    // 如果是最后一个数据块，发送一个空数据块，否则发送一个正常的数据块
+    int file_block = toFileBlock(block_num);
+    int can_get_size = getBlockSize(file_block);
+    UDPDataframe dataframe(UDPDataframe::HEADER_SIZE + can_get_size);
+    if (m_mode == Mode::MAPPED) {
+        ::std::memcpy(dataframe.m_data + UDPDataframe::HEADER_SIZE, m_map + (long long)file_block * m_block_size, can_get_size);
+    } else if (can_get_size > 0) {
+        m_ifs.seekg((long long)file_block * m_block_size, ::std::ios::beg);
+        m_ifs.read(dataframe.m_data + UDPDataframe::HEADER_SIZE, can_get_size);
     }
+    UDPDataframe::makeDataHeader(dataframe.m_data, 0, dataframe.m_data + UDPDataframe::HEADER_SIZE, can_get_size);
+    dataframe.m_size = can_get_size + UDPDataframe::HEADER_SIZE;
     return dataframe;
 }
 
+#ifdef _WIN32
+
+bool my::UDPFileReader::map(::std::string_view filename)
+{
+    m_file = CreateFileA(::std::string(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        unmap();
+        return false;
+    }
+    m_file_size = size.QuadPart;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        unmap();
+        return false;
+    }
+    m_map = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_map) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void my::UDPFileReader::unmap() noexcept
+{
+    if (m_map) {
+        UnmapViewOfFile(m_map);
+        m_map = nullptr;
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+#else
+
+bool my::UDPFileReader::map(::std::string_view filename)
+{
+    m_fd = open(::std::string(filename).c_str(), O_RDONLY);
+    if (m_fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) == -1 || st.st_size == 0) {
+        unmap();
+        return false;
+    }
+    m_file_size = st.st_size;
+
+    void *addr = mmap(nullptr, m_file_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (addr == MAP_FAILED) {
+        unmap();
+        return false;
+    }
+    m_map = static_cast<const char *>(addr);
+    madvise(addr, m_file_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void my::UDPFileReader::unmap() noexcept
+{
+    if (m_map) {
+        munmap(const_cast<char *>(m_map), m_file_size);
+        m_map = nullptr;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+#endif
+
 // my::UDPFileReader::iterator my::UDPFileReader::begin()
 // {
 //     return UDPFileReaderIterator(*this, false);
@@ -1,10 +1,48 @@
+#include <algorithm>
 #include <format>
 
 #include "../include/UDPFileWriter.h"
 #include "../include/pretty_log.hpp"
 
-my::UDPFileWriter::UDPFileWriter(::std::string_view filename)
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+my::UDPFileWriter::UDPFileWriter(::std::string_view filename, Mode mode, int block_size, bool truncate) : m_mode(mode), m_block_size(block_size)
 {
+    if (block_size <= 0 || block_size > UDPDataframe::MAX_DATA_SIZE) {
+        pretty_out << ::std::format("throw from UDPFileWriter::UDPFileWriter(): Invalid block_size, block_size = {0}", block_size);
+        throw std::runtime_error("Invalid block_size");
+    }
+
+    if (m_mode == Mode::POSITIONAL) {
+#ifdef _WIN32
+        m_file = CreateFileA(::std::string(filename).c_str(), GENERIC_WRITE, 0, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        bool opened = m_file != INVALID_HANDLE_VALUE;
+#else
+        m_fd = open(::std::string(filename).c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+        bool opened = m_fd != -1;
+#endif
+        if (!opened) {
+            pretty_out << ::std::format("throw from UDPFileWriter::UDPFileWriter(): Failed to open file \"{0}\"", filename);
+            throw std::runtime_error("Failed to open file");
+        }
+        if (!truncate) {
+#ifdef _WIN32
+            LARGE_INTEGER size;
+            m_file_size = GetFileSizeEx(m_file, &size) ? size.QuadPart : 0;
+#else
+            m_file_size = ::std::max(0LL, (long long)lseek(m_fd, 0, SEEK_END));
+#endif
+        }
+        return;
+    }
+
+    if (!truncate) {
+        pretty_out << "throw from UDPFileWriter::UDPFileWriter(): Keeping existing content requires POSITIONAL mode";
+        throw std::runtime_error("Keeping existing content requires POSITIONAL mode");
+    }
     m_ofs.open(filename.data(), ::std::ios::binary | ::std::ios::app);
     if (!m_ofs.is_open()) {
         pretty_out << ::std::format("throw from UDPFileWriter::UDPFileWriter(): Failed to open file \"{0}\"", filename);
@@ -18,19 +56,135 @@ my::UDPFileWriter::~UDPFileWriter()
 }
 
 void my::UDPFileWriter::append(const UDPDataframe &dataframe)
+{
+    int data_size;
+    const char *data = dataframe.data(data_size);
+    append(data, data_size);
+}
+
+void my::UDPFileWriter::append(const char *data, int data_size)
 {
     if (!m_ofs.is_open()) {
         pretty_out << "throw from UDPWriteFile::append(): File is not open";
         throw std::runtime_error("File is not open");
     }
 
+    m_ofs.write(data, data_size);
+}
+
+/**
+ * @brief Write the payload of a block at its final offset, blocks may arrive in any order.
+ */
+void my::UDPFileWriter::writeAt(int block_num, const UDPDataframe &dataframe)
+{
     int data_size;
     const char *data = dataframe.data(data_size);
-    m_ofs.write(data, data_size);
+    writeAt(block_num, data, data_size);
+}
+
+void my::UDPFileWriter::writeAt(int block_num, const char *data, int data_size)
+{
+    if (m_mode != Mode::POSITIONAL) {
+        pretty_out << "throw from UDPFileWriter::writeAt(): Not in POSITIONAL mode";
+        throw std::runtime_error("Not in POSITIONAL mode");
+    }
+    if (block_num < 0) {
+        pretty_out << ::std::format("throw from UDPFileWriter::writeAt(): Invalid block_num, block_num = {0}", block_num);
+        throw std::runtime_error("Invalid block_num");
+    }
+
+    long long offset = (long long)block_num * m_block_size;
+    long long end = offset + data_size;
+    if (end > m_allocated_size) {
+        preallocate(end);
+    }
+
+#ifdef _WIN32
+    if (m_file == INVALID_HANDLE_VALUE) {
+        pretty_out << "throw from UDPFileWriter::writeAt(): File is not open";
+        throw std::runtime_error("File is not open");
+    }
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD written;
+    if (!WriteFile(m_file, data, data_size, &written, &overlapped) || written != (DWORD)data_size) {
+        pretty_out << ::std::format("throw from UDPFileWriter::writeAt(): WriteFile() failed, GetLastError() = {0}", GetLastError());
+        throw std::runtime_error("WriteFile() failed");
+    }
+#else
+    if (m_fd == -1) {
+        pretty_out << "throw from UDPFileWriter::writeAt(): File is not open";
+        throw std::runtime_error("File is not open");
+    }
+    int written = 0;
+    while (written < data_size) {
+        ssize_t ret = pwrite(m_fd, data + written, data_size - written, offset + written);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            pretty_out << ::std::format("throw from UDPFileWriter::writeAt(): pwrite() failed, errno = {0}", errno);
+            throw std::runtime_error("pwrite() failed");
+        }
+        written += ret;
+    }
+#endif
+
+    m_file_size = ::std::max(m_file_size, end);
+}
+
+// 按 PREALLOCATE_SIZE 为步长扩展文件，减少碎片与元数据更新
+// 预分配失败（如文件系统不支持）不影响正确性，忽略即可
+void my::UDPFileWriter::preallocate(long long size)
+{
+    long long target = (size + PREALLOCATE_SIZE - 1) / PREALLOCATE_SIZE * PREALLOCATE_SIZE;
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = target;
+    SetFileInformationByHandle(m_file, FileAllocationInfo, &info, sizeof(info));
+#elif defined(__linux__)
+    posix_fallocate(m_fd, m_allocated_size, target - m_allocated_size);
+#endif
+    m_allocated_size = target;
+}
+
+void my::UDPFileWriter::flush()
+{
+    if (m_mode == Mode::APPEND) {
+        m_ofs.flush();
+    }
+}
+
+void my::UDPFileWriter::setFileSize(long long size) noexcept
+{
+    m_file_size = size;
 }
 
 void my::UDPFileWriter::close()
 {
+    if (m_mode == Mode::POSITIONAL) {
+        // 截掉预分配的多余部分
+#ifdef _WIN32
+        if (m_file != INVALID_HANDLE_VALUE) {
+            FILE_END_OF_FILE_INFO info;
+            info.EndOfFile.QuadPart = m_file_size;
+            SetFileInformationByHandle(m_file, FileEndOfFileInfo, &info, sizeof(info));
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_fd != -1) {
+            if (ftruncate(m_fd, m_file_size) == -1) {
+                pretty_err << ::std::format("UDPFileWriter::close(): ftruncate() failed, errno = {0}", errno);
+            }
+            ::close(m_fd);
+            m_fd = -1;
+        }
+#endif
+        return;
+    }
+
     m_ofs.flush();
     m_ofs.close();
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "../include/UDPFramePool.h"
+
+namespace
+{
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    // 各级缓冲的字节数，容量为其减 1
+    constexpr int CLASS_BUFFER_SIZES[::my::UDPFramePool::CLASS_COUNT] = {
+        ::my::UDPDataframe::DEFAULT_SIZE + 1, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16};
+    static_assert(CLASS_BUFFER_SIZES[::my::UDPFramePool::CLASS_COUNT - 1] > ::my::UDPDataframe::MAX_SIZE);
+
+    struct ThreadFramePool {
+        FreeNode *heads[::my::UDPFramePool::CLASS_COUNT] = {};
+        int free_counts[::my::UDPFramePool::CLASS_COUNT] = {};
+        long long alloc_count = 0;
+        long long acquire_count = 0;
+
+        ~ThreadFramePool()
+        {
+            for (FreeNode *head : heads) {
+                while (head) {
+                    FreeNode *next = head->next;
+                    delete[] reinterpret_cast<char *>(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    thread_local ThreadFramePool t_pool;
+
+    int classOf(int size) noexcept
+    {
+        int index = 0;
+        while (index < ::my::UDPFramePool::CLASS_COUNT - 1 && CLASS_BUFFER_SIZES[index] - 1 < size) {
+            ++index;
+        }
+        return index;
+    }
+
+    void pushFree(int index, char *buffer) noexcept
+    {
+        FreeNode *node = reinterpret_cast<FreeNode *>(buffer);
+        node->next = t_pool.heads[index];
+        t_pool.heads[index] = node;
+        ++t_pool.free_counts[index];
+    }
+} // namespace
+
+char *my::UDPFramePool::acquire(int size)
+{
+    ++t_pool.acquire_count;
+    int index = classOf(size);
+    if (FreeNode *node = t_pool.heads[index]) {
+        t_pool.heads[index] = node->next;
+        --t_pool.free_counts[index];
+        return reinterpret_cast<char *>(node);
+    }
+    ++t_pool.alloc_count;
+    return new char[CLASS_BUFFER_SIZES[index]];
+}
+
+void my::UDPFramePool::release(char *buffer, int capacity) noexcept
+{
+    if (!buffer) {
+        return;
+    }
+    // 空闲链过长时直接归还给堆，避免突发流量后长期占用内存
+    int index = classOf(capacity);
+    if (t_pool.free_counts[index] >= MAX_FREE_COUNT) {
+        delete[] buffer;
+        return;
+    }
+    pushFree(index, buffer);
+}
+
+void my::UDPFramePool::reserve(int count, int size)
+{
+    int index = classOf(size);
+    while (t_pool.free_counts[index] < count && t_pool.free_counts[index] < MAX_FREE_COUNT) {
+        ++t_pool.alloc_count;
+        pushFree(index, new char[CLASS_BUFFER_SIZES[index]]);
+    }
+}
+
+int my::UDPFramePool::capacityOf(int size) noexcept
+{
+    return CLASS_BUFFER_SIZES[classOf(size)] - 1;
+}
+
+long long my::UDPFramePool::getAllocCount() noexcept
+{
+    return t_pool.alloc_count;
+}
+
+long long my::UDPFramePool::getAcquireCount() noexcept
+{
+    return t_pool.acquire_count;
+}
+
+int my::UDPFramePool::getFreeCount() noexcept
+{
+    int count = 0;
+    for (int free_count : t_pool.free_counts) {
+        count += free_count;
+    }
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "../include/GBN_Protocol.hpp"
+#include "../include/SR_Protocol.hpp"
+#include "../include/StopWait_Protocol.hpp"
+#include "../include/wsa_wapper.h"
+
+// 在进程内经环回地址运行发送端与接收端，按协议、窗口、序号空间、文件大小与丢包率组成的矩阵逐项传输
+// 结果以 CSV 写到标准输出，传输日志写到日志文件，用于比较热路径改动前后的性能
+//
+// 用法: benchmark [-protocol StopWait,GBN,SR] [-size 1M,4M] [-loss 0,0.01,0.05] [-bs <bytes>] [-repeat <n>] [-log <path>]
+//
+// 协议、窗口与序号空间是模板参数，矩阵中的实例在下面的 CASES 中列出
+
+namespace
+{
+    using namespace ::my;
+
+    struct Result {
+        double completion_s = 0;
+        double cpu_s = 0;
+        long long frames_sent = 0;
+        long long frames_retransmitted = 0;
+        long long timeouts = 0;
+        long long rtt_p50_us = 0;
+        bool verified = false;
+    };
+
+    struct Options {
+        ::std::vector<::std::string> protocols = {"StopWait", "GBN", "SR"};
+        ::std::vector<long long> sizes = {1 << 20, 4 << 20};
+        ::std::vector<float> losses = {0.0f, 0.01f, 0.05f};
+        int block_size = UDPDataframe::DEFAULT_DATA_SIZE;
+        int repeat = 1;
+        ::std::string log_path = "benchmark.log";
+    };
+
+    // 整个进程（含 Merkle 树与压缩等工作线程）消耗的 CPU 时间，单位为秒
+    double processCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+        GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+        auto to_seconds = [](FILETIME time) { return (((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7; };
+        return to_seconds(kernel_time) + to_seconds(user_time);
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+    }
+
+    // 记下发送端结束的时刻，接收端之后还要为可能丢失的最后确认逗留一段时间，不计入完成时间
+    CoTask co_timed(CoTask task, ::std::chrono::steady_clock::time_point &done)
+    {
+        co_await task;
+        done = ::std::chrono::steady_clock::now();
+    }
+
+    // 数据帧在发送端、确认帧在接收端按 loss 模拟丢失，双方在同一线程的调度器上并发运行
+    template <class Transceiver>
+    Result runTransfer(const ::std::string &src_path, const ::std::string &dst_path, int block_size, float loss)
+    {
+        SOCKET sender_socket = create_udp_socket(0);
+        SOCKET receiver_socket = create_udp_socket(0);
+        Result result;
+        {
+            Transceiver sender(sender_socket);
+            Transceiver receiver(receiver_socket);
+            sender.setPeer(Host(receiver_socket));
+            receiver.setPeer(Host(sender_socket));
+            sender.setBlockSize(block_size);
+            receiver.setBlockSize(block_size);
+            sender.setSendLoss(loss);
+            receiver.setSendAckLoss(loss);
+            sender.enableSenderLoss();
+            receiver.enableReceiverLoss();
+
+            ::std::filesystem::remove(dst_path);
+            CoScheduler scheduler;
+            auto start = ::std::chrono::steady_clock::now();
+            auto done = start;
+            double cpu_start = processCpuSeconds();
+            scheduler.spawn(receiver.co_recvfromPeer(dst_path));
+            scheduler.spawn(co_timed(sender.co_sendtoPeer(src_path), done));
+            int failed = scheduler.run();
+            result.cpu_s = processCpuSeconds() - cpu_start;
+            result.completion_s = ::std::chrono::duration<double>(done - start).count();
+
+            const TransferMetrics &metrics = sender.getMetrics();
+            result.frames_sent = metrics.get(TransferMetrics::Counter::FRAMES_SENT);
+            result.frames_retransmitted = metrics.get(TransferMetrics::Counter::FRAMES_RETRANSMITTED);
+            result.timeouts = metrics.get(TransferMetrics::Counter::TIMEOUTS);
+            result.rtt_p50_us = metrics.getRttQuantile(0.5);
+            result.verified = failed == 0 && receiver.getLastVerify() == Transceiver::Verify::MATCH;
+        }
+        closesocket(sender_socket);
+        closesocket(receiver_socket);
+        return result;
+    }
+
+    struct Case {
+        const char *protocol;
+        int window;
+        int seq_num_bound;
+        Result (*run)(const ::std::string &, const ::std::string &, int, float);
+    };
+
+    // 窗口从小到大，另有序号空间取协议允许的最小值与远大于窗口的对照
+    const Case CASES[] = {
+        {"StopWait", 1, 2, &runTransfer<StopWait_Transceiver<2>>},
+        {"GBN", 4, 8, &runTransfer<GBN_Transceiver<4, 8>>},
+        {"GBN", 16, 17, &runTransfer<GBN_Transceiver<16, 17>>},
+        {"GBN", 16, 256, &runTransfer<GBN_Transceiver<16, 256>>},
+        {"GBN", 64, 128, &runTransfer<GBN_Transceiver<64, 128>>},
+        {"SR", 5, 10, &runTransfer<SR_Transceiver<5, 10>>},
+        {"SR", 16, 32, &runTransfer<SR_Transceiver<16, 32>>},
+        {"SR", 16, 256, &runTransfer<SR_Transceiver<16, 256>>},
+        {"SR", 64, 128, &runTransfer<SR_Transceiver<64, 128>>},
+    };
+
+    ::std::vector<::std::string> splitList(const ::std::string &list)
+    {
+        ::std::vector<::std::string> items;
+        ::std::istringstream iss(list);
+        ::std::string item;
+        while (::std::getline(iss, item, ',')) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    // 支持 K / M / G 后缀，无效时返回 -1
+    long long parseSize(const ::std::string &text)
+    {
+        ::std::size_t end = 0;
+        long long size = -1;
+        try {
+            size = ::std::stoll(text, &end);
+        } catch (const ::std::exception &) {
+            return -1;
+        }
+        ::std::string suffix = text.substr(end);
+        if (suffix == "K" || suffix == "k") {
+            size <<= 10;
+        } else if (suffix == "M" || suffix == "m") {
+            size <<= 20;
+        } else if (suffix == "G" || suffix == "g") {
+            size <<= 30;
+        } else if (!suffix.empty()) {
+            return -1;
+        }
+        return size;
+    }
+
+    bool parseOptions(int argc, char const *argv[], Options &options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            ::std::string token = argv[i];
+            if (i + 1 >= argc) {
+                pretty_err << ::std::format("Missing value for option \"{}\"", token);
+                return false;
+            }
+            ::std::string value = argv[++i];
+            if (token == "-protocol") {
+                options.protocols = splitList(value);
+            } else if (token == "-size") {
+                options.sizes.clear();
+                for (const ::std::string &item : splitList(value)) {
+                    long long size = parseSize(item);
+                    if (size < 0) {
+                        pretty_err << ::std::format("Invalid file size \"{}\"", item);
+                        return false;
+                    }
+                    options.sizes.push_back(size);
+                }
+            } else if (token == "-loss") {
+                options.losses.clear();
+                for (const ::std::string &item : splitList(value)) {
+                    float loss = ::std::strtof(item.c_str(), nullptr);
+                    if (loss < 0 || loss >= 1) {
+                        pretty_err << ::std::format("Invalid loss rate \"{}\", should be in [0, 1)", item);
+                        return false;
+                    }
+                    options.losses.push_back(loss);
+                }
+            } else if (token == "-bs") {
+                options.block_size = ::std::atoi(value.c_str());
+                if (options.block_size < 1 || options.block_size > UDPDataframe::MAX_DATA_SIZE) {
+                    pretty_err << ::std::format("Invalid block size, should be in [1, {}]", UDPDataframe::MAX_DATA_SIZE);
+                    return false;
+                }
+            } else if (token == "-repeat") {
+                options.repeat = ::std::max(1, ::std::atoi(value.c_str()));
+            } else if (token == "-log") {
+                options.log_path = value;
+            } else {
+                pretty_err << ::std::format("Unknown option \"{}\"", token);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 固定种子的随机内容，不可压缩，各次运行的输入相同
+    ::std::string makeInputFile(const ::std::filesystem::path &dir, long long size)
+    {
+        ::std::filesystem::path path = dir / ::std::format("input_{}.bin", size);
+        if (::std::filesystem::exists(path) && (long long)::std::filesystem::file_size(path) == size) {
+            return path.string();
+        }
+        ::std::mt19937_64 engine(size);
+        ::std::vector<unsigned long long> buffer(1 << 13);
+        ::std::ofstream ofs(path, ::std::ios::binary | ::std::ios::trunc);
+        for (long long written = 0; written < size;) {
+            for (auto &word : buffer) {
+                word = engine();
+            }
+            long long chunk = ::std::min<long long>(size - written, (long long)(buffer.size() * sizeof(buffer[0])));
+            ofs.write(reinterpret_cast<const char *>(buffer.data()), chunk);
+            written += chunk;
+        }
+        return path.string();
+    }
+} // namespace
+
+int main(int argc, char const *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    ::std::ofstream log_file(options.log_path);
+    if (!log_file) {
+        pretty_err << ::std::format("Open log file \"{}\" failed", options.log_path);
+        return 1;
+    }
+    // 传输日志转到日志文件，标准输出只留 CSV
+    ::std::ostream csv(::std::cout.rdbuf());
+    ::std::streambuf *cout_buf = ::std::cout.rdbuf(log_file.rdbuf());
+    ::std::streambuf *clog_buf = ::std::clog.rdbuf(log_file.rdbuf());
+    ::std::streambuf *cerr_buf = ::std::cerr.rdbuf(log_file.rdbuf());
+
+    int exit_code = 0;
+    if (!wsa_initialized) {
+        init_wsa();
+    }
+    ::std::filesystem::path dir = ::std::filesystem::temp_directory_path() / "rdt_benchmark";
+    ::std::filesystem::create_directories(dir);
+
+    csv << "protocol,window,seq_num_bound,block_size,file_bytes,loss,run,completion_s,throughput_mb_s,cpu_s,"
+           "frames_sent,frames_retransmitted,retransmit_ratio,timeouts,rtt_p50_us,verified"
+        << ::std::endl;
+    for (const Case &test_case : CASES) {
+        if (::std::find(options.protocols.begin(), options.protocols.end(), test_case.protocol) == options.protocols.end()) {
+            continue;
+        }
+        for (long long size : options.sizes) {
+            ::std::string src_path = makeInputFile(dir, size);
+            ::std::string dst_path = (dir / "output.bin").string();
+            for (float loss : options.losses) {
+                for (int run = 0; run < options.repeat; ++run) {
+                    pretty_log << ::std::format("Benchmark {}<{}, {}>, {} byte(s), loss {:.3f}, run {}",
+                                                test_case.protocol, test_case.window, test_case.seq_num_bound, size, loss, run);
+                    Result result;
+                    try {
+                        result = test_case.run(src_path, dst_path, options.block_size, loss);
+                    } catch (const ::std::exception &e) {
+                        pretty_err << ::std::format("catch by main(): {}", e.what());
+                        exit_code = 1;
+                    }
+                    csv << ::std::format("{},{},{},{},{},{:.3f},{},{:.6f},{:.3f},{:.6f},{},{},{:.6f},{},{},{}",
+                                         test_case.protocol, test_case.window, test_case.seq_num_bound, options.block_size, size, loss, run,
+                                         result.completion_s, result.completion_s > 0 ? size / result.completion_s / 1e6 : 0.0, result.cpu_s,
+                                         result.frames_sent, result.frames_retransmitted,
+                                         result.frames_sent > 0 ? (double)result.frames_retransmitted / result.frames_sent : 0.0,
+                                         result.timeouts, result.rtt_p50_us, result.verified ? 1 : 0)
+                        << ::std::endl;
+                    exit_code |= result.verified ? 0 : 1;
+                }
+            }
+        }
+    }
+    ::std::filesystem::remove_all(dir);
+
+    if (wsa_initialized) {
+        cleanup_wsa();
+    }
+    // 后台日志线程写完之后再恢复各流
+    AsyncLogger::drain();
+    ::std::cout.rdbuf(cout_buf);
+    ::std::clog.rdbuf(clog_buf);
+    ::std::cerr.rdbuf(cerr_buf);
+    return exit_code;
+}
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <format>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/CoScheduler.h"
+#include "../include/Entity.hpp"
+#include "../include/UDPDemux.h"
+#include "../include/pretty_log.hpp"
+#include "../include/wsa_wapper.h"
+
+// 环回上的网络损伤代理：客户端把请求发到代理端口，代理为每个客户端开一个上游 socket 转发给服务端，
+// 两个方向各自按设定的随机种子施加丢包、带宽、排队、时延、抖动、乱序与重复，服务端只看到代理的地址
+//
+// 用法: impair_proxy [-listen <port>] [-server <ip>:<port>] [-seed <n>] [-stats <seconds>] [<impairment> ...]
+// 损伤选项默认作用于两个方向，其后出现 -up（客户端到服务端）或 -down（服务端到客户端）时只作用于该方向，-both 恢复为两个方向
+//   -loss <p> [-burst <len>]  平均丢包率 p；len 大于 1 时为 Gilbert 模型的突发丢包，丢包平均连续 len 个，
+//                             此时 p 不能超过 len / (len + 1)；len 不超过 1 时各包独立丢弃
+//   -rate <Mbit/s> -queue <packets>  瓶颈带宽与其队列长度，队列满时尾部丢弃
+//   -delay <ms> -jitter <ms> -dist uniform|normal  出瓶颈后的传播时延，抖动不改变包的先后顺序
+//   -reorder <p>  以概率 p 不经传播时延直接发出，越过之前的包
+//   -dup <p>  以概率 p 多发一份，两份各自取时延
+//
+// 例: 客户端 "upload -port 23456"，代理 impair_proxy -delay 20 -jitter 5 -rate 50 -queue 100 -up -loss 0.02 -burst 3
+
+namespace
+{
+    using namespace ::my;
+    using Clock = CoScheduler::Clock;
+    using TimePoint = CoScheduler::TimePoint;
+
+    struct Impairment {
+        enum class Distribution { UNIFORM, NORMAL };
+
+        double loss = 0;
+        double burst = 1;
+        double rate_mbps = 0;
+        int queue = 1000;
+        double delay_ms = 0;
+        double jitter_ms = 0;
+        Distribution distribution = Distribution::UNIFORM;
+        double reorder = 0;
+        double duplicate = 0;
+
+        ::std::string toString() const
+        {
+            return ::std::format("loss {:.3f} (burst {:.1f}), rate {}, queue {}, delay {:.1f} ms ± {:.1f} ms ({}), reorder {:.3f}, duplicate {:.3f}",
+                                 loss, burst, rate_mbps > 0 ? ::std::format("{:.1f} Mbit/s", rate_mbps) : "unlimited", queue, delay_ms, jitter_ms,
+                                 distribution == Distribution::NORMAL ? "normal" : "uniform", reorder, duplicate);
+        }
+    };
+
+    // 一个方向的损伤，按到达顺序逐包决定丢弃与否及各副本的发出时刻
+    class ImpairedLink
+    {
+    public:
+        struct Stats {
+            long long received = 0;
+            long long forwarded = 0;
+            long long lost = 0;
+            long long queue_dropped = 0;
+            long long duplicated = 0;
+            long long reordered = 0;
+
+            ::std::string toString() const
+            {
+                return ::std::format("{} received, {} forwarded, {} lost, {} dropped by queue, {} duplicated, {} reordered",
+                                     received, forwarded, lost, queue_dropped, duplicated, reordered);
+            }
+        };
+
+        ImpairedLink(const Impairment &impairment, unsigned long long seed)
+            : m_impairment(impairment), m_engine(seed)
+        {
+            // 好状态每包以 p 进入坏状态，坏状态以 r = 1 / burst 回到好状态，平均丢包率为 p / (p + r)
+            // burst 不超过 1 时各包独立丢弃，不用状态机
+            if (isBursty()) {
+                m_leave_bad = 1.0 / m_impairment.burst;
+                m_enter_bad = m_impairment.loss * m_leave_bad / (1 - m_impairment.loss);
+            }
+        }
+
+        bool isBursty() const noexcept { return m_impairment.burst > 1; }
+
+        // 返回各副本的发出时刻，丢弃时为空
+        const ::std::vector<TimePoint> &admit(TimePoint now, int size)
+        {
+            m_departures.clear();
+            ++m_stats.received;
+            bool lost;
+            if (isBursty()) {
+                m_bad = m_bad ? uniform() >= m_leave_bad : uniform() < m_enter_bad;
+                lost = m_bad;
+            } else {
+                lost = uniform() < m_impairment.loss;
+            }
+            if (lost) {
+                ++m_stats.lost;
+                return m_departures;
+            }
+
+            TimePoint departure = now;
+            if (m_impairment.rate_mbps > 0) {
+                while (!m_queue.empty() && m_queue.front() <= now) {
+                    m_queue.pop_front();
+                }
+                if ((int)m_queue.size() >= m_impairment.queue) {
+                    ++m_stats.queue_dropped;
+                    return m_departures;
+                }
+                // 串行发送：排在前面的包发完后才开始发这个包
+                m_link_free = ::std::max(m_link_free, now) + ::std::chrono::duration_cast<Clock::duration>(::std::chrono::duration<double, ::std::micro>(size * 8 / m_impairment.rate_mbps));
+                m_queue.push_back(m_link_free);
+                departure = m_link_free;
+            }
+
+            int copies = uniform() < m_impairment.duplicate ? 2 : 1;
+            m_stats.duplicated += copies - 1;
+            for (int i = 0; i < copies; ++i) {
+                if (uniform() < m_impairment.reorder) {
+                    ++m_stats.reordered;
+                    m_departures.push_back(departure);
+                } else {
+                    // 抖动不改变先后顺序，不早于前一个按序的包发出
+                    m_last_in_order = ::std::max(m_last_in_order, departure + ::std::chrono::duration_cast<Clock::duration>(::std::chrono::duration<double, ::std::milli>(sampleDelay())));
+                    m_departures.push_back(m_last_in_order);
+                }
+            }
+            m_stats.forwarded += copies;
+            return m_departures;
+        }
+
+        const Impairment &getImpairment() const noexcept { return m_impairment; }
+        const Stats &getStats() const noexcept { return m_stats; }
+
+    private:
+        Impairment m_impairment;
+        ::std::mt19937_64 m_engine;
+        ::std::uniform_real_distribution<double> m_uniform{0.0, 1.0};
+        double m_enter_bad = 0;
+        double m_leave_bad = 1;
+        bool m_bad = false;
+        // 瓶颈队列中各包发完的时刻
+        ::std::deque<TimePoint> m_queue;
+        TimePoint m_link_free{};
+        TimePoint m_last_in_order{};
+        ::std::vector<TimePoint> m_departures;
+        Stats m_stats;
+
+        double uniform() { return m_uniform(m_engine); }
+
+        double sampleDelay()
+        {
+            double delay = m_impairment.delay_ms;
+            if (m_impairment.jitter_ms > 0) {
+                if (m_impairment.distribution == Impairment::Distribution::NORMAL) {
+                    delay = ::std::normal_distribution<double>(m_impairment.delay_ms, m_impairment.jitter_ms)(m_engine);
+                } else {
+                    delay += (2 * uniform() - 1) * m_impairment.jitter_ms;
+                }
+            }
+            return ::std::max(delay, 0.0);
+        }
+    };
+
+    class ReadableAwaiter
+    {
+    public:
+        ReadableAwaiter(SOCKET socket, TimePoint deadline) noexcept : m_socket(socket), m_deadline(deadline) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(::std::coroutine_handle<> handle) { CoScheduler::current()->waitReadable(m_socket, m_deadline, handle, &m_readable); }
+        bool await_resume() const noexcept { return m_readable; }
+
+    private:
+        SOCKET m_socket;
+        TimePoint m_deadline;
+        bool m_readable = false;
+    };
+
+    // 等到 deadline 或被 signal() 提前唤醒，凭据写入 token
+    class SignalAwaiter
+    {
+    public:
+        SignalAwaiter(CoScheduler::WaitToken &token, TimePoint deadline) noexcept : m_token(token), m_deadline(deadline) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(::std::coroutine_handle<> handle) { m_token = CoScheduler::current()->waitSignal(m_deadline, handle, &m_signaled); }
+        bool await_resume() const noexcept { return m_signaled; }
+
+    private:
+        CoScheduler::WaitToken &m_token;
+        TimePoint m_deadline;
+        bool m_signaled = false;
+    };
+
+    class ImpairProxy
+    {
+    public:
+        // 客户端空闲超过该时长后关闭其上游 socket
+        static constexpr int IDLE_TIMEOUT_MS = 60000;
+        static constexpr int MAX_DATAGRAM_SIZE = 65536;
+
+        ImpairProxy(unsigned short listen_port, const Peer &server, const Impairment &up, const Impairment &down, unsigned long long seed, int stats_interval_s)
+            : m_server(server), m_up(up, seed), m_down(down, seed + 1), m_stats_interval_s(stats_interval_s)
+        {
+            m_listen = Host(create_udp_socket(listen_port));
+        }
+
+        ~ImpairProxy()
+        {
+            for (auto &[key, session] : m_sessions) {
+                closesocket(session->socket);
+            }
+            closesocket(m_listen.getSocket());
+        }
+
+        void run()
+        {
+            pretty_log << ::std::format("Impairment proxy on {}, forwarding to {}", m_listen.toString(), m_server.toString())
+                       << ::std::format("up:   {}", m_up.getImpairment().toString())
+                       << ::std::format("down: {}", m_down.getImpairment().toString());
+            m_scheduler.spawn(co_listen());
+            m_scheduler.spawn(co_deliver());
+            if (m_stats_interval_s > 0) {
+                m_scheduler.spawn(co_report());
+            }
+            m_scheduler.run();
+        }
+
+    private:
+        struct Session {
+            SOCKET socket;
+            Peer client;
+            TimePoint last_active;
+        };
+        struct Packet {
+            TimePoint departure;
+            long long order;
+            // 上行包从会话的上游 socket 发给服务端，下行包从监听 socket 发给客户端
+            bool upstream;
+            unsigned long long key;
+            ::std::shared_ptr<::std::vector<char>> data;
+
+            // 同一时刻按到达顺序发出
+            bool operator>(const Packet &other) const noexcept { return departure != other.departure ? departure > other.departure : order > other.order; }
+        };
+
+        Host m_listen;
+        Peer m_server;
+        ImpairedLink m_up;
+        ImpairedLink m_down;
+        int m_stats_interval_s;
+        CoScheduler m_scheduler;
+        ::std::unordered_map<unsigned long long, ::std::unique_ptr<Session>> m_sessions;
+        ::std::priority_queue<Packet, ::std::vector<Packet>, ::std::greater<>> m_packets;
+        long long m_order = 0;
+        CoScheduler::WaitToken m_deliver_token;
+        TimePoint m_deliver_deadline = TimePoint::max();
+        ::std::vector<char> m_buffer = ::std::vector<char>(MAX_DATAGRAM_SIZE);
+
+        // 读一个数据报，失败时返回 -1
+        int recvDatagram(SOCKET socket, Peer &from)
+        {
+            sockaddr_in address;
+            socklen_t address_size = sizeof(address);
+            int size = recvfrom(socket, m_buffer.data(), MAX_DATAGRAM_SIZE, 0, reinterpret_cast<sockaddr *>(&address), &address_size);
+            if (size == SOCKET_ERROR) {
+                pretty_err << ::std::format("recvfrom() failed. Error code: {}", WSAGetLastError());
+                return -1;
+            }
+            from.setAddr(address);
+            return size;
+        }
+
+        // 按损伤排入发送队列，比发送协程正在等的时刻更早时提前唤醒它
+        void enqueue(ImpairedLink &link, bool upstream, unsigned long long key, int size)
+        {
+            TimePoint now = Clock::now();
+            const ::std::vector<TimePoint> &departures = link.admit(now, size);
+            if (departures.empty()) {
+                return;
+            }
+            auto data = ::std::make_shared<::std::vector<char>>(m_buffer.begin(), m_buffer.begin() + size);
+            for (TimePoint departure : departures) {
+                m_packets.push(Packet{departure, m_order++, upstream, key, data});
+                if (departure < m_deliver_deadline) {
+                    m_deliver_deadline = departure;
+                    m_scheduler.signal(m_deliver_token);
+                }
+            }
+        }
+
+        // 客户端发来的包，新客户端先建立会话
+        CoTask co_listen()
+        {
+            while (true) {
+                co_await ReadableAwaiter(m_listen.getSocket(), TimePoint::max());
+                Peer client;
+                int size = recvDatagram(m_listen.getSocket(), client);
+                if (size < 0) {
+                    continue;
+                }
+                unsigned long long key = UDPDemux::keyOf(client);
+                auto it = m_sessions.find(key);
+                if (it == m_sessions.end()) {
+                    it = m_sessions.emplace(key, ::std::make_unique<Session>(Session{create_udp_socket(0), client, {}})).first;
+                    m_scheduler.spawn(co_relay(key));
+                    pretty_log << ::std::format("Session {} opened, {} active", client.toString(), m_sessions.size());
+                }
+                it->second->last_active = Clock::now();
+                enqueue(m_up, true, key, size);
+            }
+        }
+
+        // 服务端发给某个会话的包，空闲超时后关闭会话
+        CoTask co_relay(unsigned long long key)
+        {
+            Session &session = *m_sessions.at(key);
+            while (true) {
+                TimePoint idle_deadline = session.last_active + ::std::chrono::milliseconds(IDLE_TIMEOUT_MS);
+                if (!co_await ReadableAwaiter(session.socket, idle_deadline)) {
+                    if (Clock::now() >= session.last_active + ::std::chrono::milliseconds(IDLE_TIMEOUT_MS)) {
+                        break;
+                    }
+                    continue;
+                }
+                Peer from;
+                int size = recvDatagram(session.socket, from);
+                if (size < 0 || !(from == m_server)) {
+                    continue;
+                }
+                session.last_active = Clock::now();
+                enqueue(m_down, false, key, size);
+            }
+            pretty_log << ::std::format("Session {} closed after {} s idle, {} active", session.client.toString(), IDLE_TIMEOUT_MS / 1000, m_sessions.size() - 1);
+            closesocket(session.socket);
+            m_sessions.erase(key);
+        }
+
+        // 到时刻的包按序发出，会话已关闭的包丢弃
+        CoTask co_deliver()
+        {
+            while (true) {
+                TimePoint now = Clock::now();
+                while (!m_packets.empty() && m_packets.top().departure <= now) {
+                    const Packet &packet = m_packets.top();
+                    auto it = m_sessions.find(packet.key);
+                    if (it != m_sessions.end()) {
+                        SOCKET socket = packet.upstream ? it->second->socket : m_listen.getSocket();
+                        const Peer &to = packet.upstream ? m_server : it->second->client;
+                        if (sendto(socket, packet.data->data(), (int)packet.data->size(), 0, to.getAddrPtr(), sizeof(sockaddr_in)) == SOCKET_ERROR) {
+                            pretty_err << ::std::format("sendto() failed. Error code: {}", WSAGetLastError());
+                        }
+                    }
+                    m_packets.pop();
+                }
+                m_deliver_deadline = m_packets.empty() ? TimePoint::max() : m_packets.top().departure;
+                co_await SignalAwaiter(m_deliver_token, m_deliver_deadline);
+            }
+        }
+
+        CoTask co_report()
+        {
+            ImpairedLink::Stats last_up, last_down;
+            CoScheduler::WaitToken token;
+            while (true) {
+                co_await SignalAwaiter(token, Clock::now() + ::std::chrono::seconds(m_stats_interval_s));
+                if (m_up.getStats().received == last_up.received && m_down.getStats().received == last_down.received) {
+                    continue;
+                }
+                last_up = m_up.getStats();
+                last_down = m_down.getStats();
+                pretty_log << "Impairment statistics:"
+                           << ::std::format("up:   {}", last_up.toString())
+                           << ::std::format("down: {}", last_down.toString());
+            }
+        }
+    };
+
+    bool parseProbability(const char *text, double &value)
+    {
+        char *end;
+        value = ::std::strtod(text, &end);
+        return *end == '\0' && value >= 0 && value <= 1;
+    }
+
+    bool parseNonNegative(const char *text, double &value)
+    {
+        char *end;
+        value = ::std::strtod(text, &end);
+        return *end == '\0' && value >= 0;
+    }
+
+    // 突发丢包时进入坏状态的概率 p = loss * r / (1 - loss) 不能超过 1，即 loss 不超过 burst / (burst + 1)
+    bool checkLoss(const Impairment &impairment, const char *direction)
+    {
+        if (impairment.burst > 1 && impairment.loss > impairment.burst / (impairment.burst + 1)) {
+            pretty_err << ::std::format("Loss {} is unreachable with burst {} on the {} direction, should not exceed {:.3f}",
+                                        impairment.loss, impairment.burst, direction, impairment.burst / (impairment.burst + 1));
+            return false;
+        }
+        return true;
+    }
+} // namespace
+
+int main(int argc, char const *argv[])
+{
+    unsigned short listen_port = 23456;
+    ::std::string server_ip = "127.0.0.1";
+    unsigned short server_port = 12345;
+    unsigned long long seed = 1;
+    int stats_interval_s = 5;
+    Impairment up, down;
+    bool apply_up = true;
+    bool apply_down = true;
+
+    for (int i = 1; i < argc; ++i) {
+        ::std::string token = argv[i];
+        if (token == "-up" || token == "-down" || token == "-both") {
+            apply_up = token != "-down";
+            apply_down = token != "-up";
+            continue;
+        }
+        if (i + 1 >= argc) {
+            pretty_err << ::std::format("Missing value for option \"{}\"", token);
+            return 1;
+        }
+        const char *value = argv[++i];
+
+        // 对选中的方向设置一项损伤参数
+        auto set = [&](auto member, auto parse) {
+            double number;
+            if (!parse(value, number)) {
+                pretty_err << ::std::format("Invalid value \"{}\" for option \"{}\"", value, token);
+                return false;
+            }
+            if (apply_up) {
+                up.*member = number;
+            }
+            if (apply_down) {
+                down.*member = number;
+            }
+            return true;
+        };
+
+        bool ok = true;
+        if (token == "-listen") {
+            listen_port = (unsigned short)::std::atoi(value);
+        } else if (token == "-server") {
+            ::std::string address = value;
+            ::std::size_t colon = address.find(':');
+            server_ip = address.substr(0, colon);
+            if (colon != ::std::string::npos) {
+                server_port = (unsigned short)::std::atoi(address.c_str() + colon + 1);
+            }
+        } else if (token == "-seed") {
+            seed = ::std::strtoull(value, nullptr, 10);
+        } else if (token == "-stats") {
+            stats_interval_s = ::std::max(0, ::std::atoi(value));
+        } else if (token == "-loss") {
+            ok = set(&Impairment::loss, parseProbability);
+        } else if (token == "-burst") {
+            ok = set(&Impairment::burst, parseNonNegative);
+        } else if (token == "-rate") {
+            ok = set(&Impairment::rate_mbps, parseNonNegative);
+        } else if (token == "-queue") {
+            int queue = ::std::max(1, ::std::atoi(value));
+            if (apply_up) {
+                up.queue = queue;
+            }
+            if (apply_down) {
+                down.queue = queue;
+            }
+        } else if (token == "-delay") {
+            ok = set(&Impairment::delay_ms, parseNonNegative);
+        } else if (token == "-jitter") {
+            ok = set(&Impairment::jitter_ms, parseNonNegative);
+        } else if (token == "-dist") {
+            ::std::string name = value;
+            if (name != "uniform" && name != "normal") {
+                pretty_err << ::std::format("Unknown delay distribution \"{}\", should be uniform or normal", name);
+                return 1;
+            }
+            auto distribution = name == "normal" ? Impairment::Distribution::NORMAL : Impairment::Distribution::UNIFORM;
+            if (apply_up) {
+                up.distribution = distribution;
+            }
+            if (apply_down) {
+                down.distribution = distribution;
+            }
+        } else if (token == "-reorder") {
+            ok = set(&Impairment::reorder, parseProbability);
+        } else if (token == "-dup") {
+            ok = set(&Impairment::duplicate, parseProbability);
+        } else {
+            pretty_err << ::std::format("Unknown option \"{}\"", token);
+            return 1;
+        }
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    if (!checkLoss(up, "up") || !checkLoss(down, "down")) {
+        return 1;
+    }
+
+    if (!wsa_initialized) {
+        init_wsa();
+    }
+    SOCKADDR_IN server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    server_addr.sin_addr.s_addr = inet_addr(server_ip.c_str());
+    if (server_addr.sin_addr.s_addr == INADDR_NONE) {
+        pretty_err << ::std::format("Invalid server address \"{}\"", server_ip);
+        return 1;
+    }
+
+    try {
+        ImpairProxy proxy(listen_port, Peer(server_addr), up, down, seed, stats_interval_s);
+        proxy.run();
+    } catch (const ::std::exception &e) {
+        pretty_err << ::std::format("catch by main(): {}", e.what());
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
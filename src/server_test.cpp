@@ -1,8 +1,12 @@
+#include <cstdlib>
+
 #include "../include/RDT_Server.hpp"
 
+// 可选参数为分片数（0 表示按硬件线程数）与指标文件路径
 int main(int argc, char const *argv[])
 {
-    ::my::SR_Server<5, 10> server;
+    int shard_count = argc > 1 ? ::std::atoi(argv[1]) : 1;
+    ::my::SR_Server<5, 10> server(shard_count, argc > 2 ? argv[2] : "./server_metrics.prom");
     server.run();
     return 0;
 }
\ No newline at end of file
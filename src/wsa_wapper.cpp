@@ -1,6 +1,7 @@
 #include "../include/wsa_wapper.h"
 #include "../include/pretty_log.hpp"
 #include <format>
+#include <stdexcept>
 
 bool ::my::wsa_initialized = false;
 
@@ -15,6 +16,7 @@ bool ::my::init_wsa()
         return true;
     }
 
+#ifdef _WIN32
     WSADATA wsaData;
     pretty_log
         << "Initializing Winsock..."
@@ -36,6 +38,7 @@ bool ::my::init_wsa()
         WSACleanup();
         return false;
     }
+#endif
 
     pretty_log << "Winsock initialized";
     wsa_initialized = true;
@@ -54,12 +57,14 @@ bool ::my::cleanup_wsa()
     }
 
     pretty_log << "Cleaning up Winsock...";
+#ifdef _WIN32
     if (WSACleanup()) {
         pretty_err
             << ::std::format("WSACleanup failed. Error code: {}", WSAGetLastError())
             << "Winsock cleanup failed";
         return false;
     }
+#endif
 
     pretty_log
         << "WSACleanup succeeded"
@@ -67,3 +72,85 @@ bool ::my::cleanup_wsa()
     wsa_initialized = false;
     return true;
 }
+
+/**
+ * @brief Enlarge the send and receive buffers of a socket.
+ * @return true if both options are accepted, the kernel may still cap the sizes.
+ */
+bool ::my::set_socket_buffers(SOCKET s, int bytes)
+{
+    bool ok = setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&bytes), sizeof(bytes)) != SOCKET_ERROR;
+    ok = setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char *>(&bytes), sizeof(bytes)) != SOCKET_ERROR && ok;
+    return ok;
+}
+
+/**
+ * @brief Create a UDP socket bound to 127.0.0.1:port with enlarged buffers.
+ * @return the socket, throws std::runtime_error on failure.
+ */
+SOCKET my::create_udp_socket(unsigned short port, bool reuse_port)
+{
+    SOCKET host_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (host_socket == INVALID_SOCKET) {
+        pretty_err << ::std::format("Create socket failed. Error code: {}", WSAGetLastError());
+        throw ::std::runtime_error("Create socket failed");
+    }
+
+    set_socket_buffers(host_socket);
+
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+        int enable = 1;
+        if (setsockopt(host_socket, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&enable), sizeof(enable)) == SOCKET_ERROR) {
+            pretty_err << ::std::format("Set SO_REUSEPORT failed. Error code: {}", WSAGetLastError());
+            closesocket(host_socket);
+            throw ::std::runtime_error("Set SO_REUSEPORT failed");
+        }
+#else
+        pretty_err << "SO_REUSEPORT is not supported on this platform";
+        closesocket(host_socket);
+        throw ::std::runtime_error("SO_REUSEPORT is not supported");
+#endif
+    }
+
+    SOCKADDR_IN host_addr;
+    host_addr.sin_family = AF_INET;
+    host_addr.sin_port = htons(port);
+    host_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (bind(host_socket, reinterpret_cast<SOCKADDR *>(&host_addr), sizeof(host_addr)) == SOCKET_ERROR) {
+        pretty_err << ::std::format("Bind socket failed. Error code: {}", WSAGetLastError());
+        closesocket(host_socket);
+        throw ::std::runtime_error("Bind socket failed");
+    }
+
+#ifdef _WIN32
+    // https://stackoverflow.com/questions/34242622/windows-udp-sockets-recvfrom-fails-with-error-10054
+    BOOL bNewBehavior = FALSE;
+    DWORD dwBytesReturned = 0;
+    WSAIoctl(host_socket, _WSAIOW(IOC_VENDOR, 12), &bNewBehavior, sizeof bNewBehavior, nullptr, 0, &dwBytesReturned, nullptr, nullptr);
+#endif
+
+    return host_socket;
+}
+
+/**
+ * @brief Set or clear the don't-fragment bit on outgoing IPv4 datagrams.
+ * @return true if the option is accepted.
+ */
+bool ::my::set_dont_fragment(SOCKET s, bool enable)
+{
+#if defined(_WIN32)
+    DWORD value = enable ? TRUE : FALSE;
+    return setsockopt(s, IPPROTO_IP, IP_DONTFRAGMENT, reinterpret_cast<const char *>(&value), sizeof(value)) != SOCKET_ERROR;
+#elif defined(IP_MTU_DISCOVER)
+    // PROBE 模式忽略内核缓存的路径 MTU，只受接口 MTU 限制，正适合由应用自行探测
+    int value = enable ? IP_PMTUDISC_PROBE : IP_PMTUDISC_WANT;
+    return setsockopt(s, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value)) != SOCKET_ERROR;
+#elif defined(IP_DONTFRAG)
+    int value = enable ? 1 : 0;
+    return setsockopt(s, IPPROTO_IP, IP_DONTFRAG, &value, sizeof(value)) != SOCKET_ERROR;
+#else
+    return false;
+#endif
+}